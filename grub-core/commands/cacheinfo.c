@@ -19,44 +19,81 @@
 
 #include <grub/dl.h>
 #include <grub/misc.h>
-#include <grub/command.h>
+#include <grub/extcmd.h>
 #include <grub/i18n.h>
 #include <grub/disk.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+static const struct grub_arg_option options[] =
+  {
+    {"size", 's', 0, N_("Set disk cache size in MiB."), N_("SIZE"),
+     ARG_TYPE_INT},
+    {"reset", 'r', 0, N_("Reset disk cache statistics."), 0, 0},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+/* Size of one cache set in bytes.  */
+#define CACHE_SET_SIZE ((GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS) \
+			* GRUB_DISK_CACHE_WAYS)
+
 static grub_err_t
-grub_rescue_cmd_info (struct grub_command *cmd __attribute__ ((unused)),
-    int argc __attribute__ ((unused)),
-    char *argv[] __attribute__ ((unused)))
+grub_cmd_cacheinfo (grub_extcmd_context_t ctxt,
+		    int argc __attribute__ ((unused)),
+		    char *argv[] __attribute__ ((unused)))
 {
-  unsigned long hits, misses;
+  struct grub_arg_list *state = ctxt->state;
+  struct grub_disk_cache_stats stats;
+  unsigned long accesses;
+
+  if (state[0].set)
+    {
+      const char *end;
+      unsigned long long size;
+
+      size = grub_strtoull (state[0].arg, &end, 0);
+      if (grub_errno != GRUB_ERR_NONE || *end != '\0' || size == 0
+	  || size > 0x10000)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT,
+			   N_("invalid disk cache size"));
+      if (grub_disk_cache_resize ((size << 20) / CACHE_SET_SIZE))
+	return grub_errno;
+    }
+
+  if (state[1].set)
+    grub_disk_cache_reset_stats ();
+
+  grub_disk_cache_get_stats (&stats);
+  grub_printf_ (N_("Disk cache size: %lu KiB (%u sets of %u), %u in use\n"),
+		(unsigned long) (stats.sets * (CACHE_SET_SIZE >> 10)),
+		stats.sets, GRUB_DISK_CACHE_WAYS, stats.used);
 
-  grub_disk_cache_get_performance (&hits, &misses);
-  if (hits + misses)
+  accesses = stats.hits + stats.misses;
+  if (accesses)
     {
-      unsigned long ratio = hits * 10000 / (hits + misses);
-      grub_printf ("(%lu.%lu%%)\n", ratio / 100, ratio % 100);
+      unsigned long ratio = stats.hits * 10000 / accesses;
       grub_printf_ (N_("Disk cache statistics: hits = %lu (%lu.%02lu%%),"
-		     " misses = %lu\n"), ratio / 100, ratio % 100,
-		    hits, misses);
+		       " misses = %lu, evictions = %lu\n"),
+		    stats.hits, ratio / 100, ratio % 100,
+		    stats.misses, stats.evictions);
     }
   else
-    grub_printf ("%s\n", _("No disk cache statistics available\n"));    
+    grub_printf ("%s\n", _("No disk cache statistics available"));
 
- return 0;
+  return 0;
 }
 
-static grub_command_t cmd_cacheinfo;
+static grub_extcmd_t cmd_cacheinfo;
 
 GRUB_MOD_INIT(cacheinfo)
 {
   cmd_cacheinfo =
-    grub_register_command ("cacheinfo", grub_rescue_cmd_info,
-			   0, N_("Get disk cache info."));
+    grub_register_extcmd ("cacheinfo", grub_cmd_cacheinfo, 0,
+			  N_("[--size=MIB] [--reset]"),
+			  N_("Get disk cache info."), options);
 }
 
 GRUB_MOD_FINI(cacheinfo)
 {
-  grub_unregister_command (cmd_cacheinfo);
+  grub_unregister_extcmd (cmd_cacheinfo);
 }
@@ -21,6 +21,7 @@
 #include <grub/disk.h>
 #include <grub/file.h>
 #include <grub/misc.h>
+#include <grub/mm.h>
 #include <grub/lib/crc.h>
 #include <grub/command.h>
 #include <grub/i18n.h>
@@ -28,13 +29,15 @@
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
+#define CRC_BUF_SIZE 0x100000
+
 static grub_err_t
 grub_cmd_crc32 (grub_command_t cmd __attribute__ ((unused)),
 	      int argc, char **args)
 
 {
   grub_file_t file;
-  char buf[GRUB_DISK_SECTOR_SIZE];
+  char *buf;
   grub_ssize_t size;
   grub_uint32_t crc;
   char crcstr[10];
@@ -46,8 +49,12 @@ grub_cmd_crc32 (grub_command_t cmd __attribute__ ((unused)),
   if (! file)
     return 0;
 
+  buf = grub_malloc (CRC_BUF_SIZE);
+  if (! buf)
+    goto fail;
+
   crc = 0;
-  while ((size = grub_file_read (file, buf, sizeof (buf))) > 0)
+  while ((size = grub_file_read (file, buf, CRC_BUF_SIZE)) > 0)
     crc = grub_getcrc32c (crc, buf, size);
 
   if (grub_errno)
@@ -61,6 +68,7 @@ grub_cmd_crc32 (grub_command_t cmd __attribute__ ((unused)),
     }
 
  fail:
+  grub_free (buf);
   grub_file_close (file);
   return GRUB_ERR_NONE;
 }
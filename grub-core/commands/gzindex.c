@@ -0,0 +1,196 @@
+/* gzindex.c - command to prebuild random access indexes for gzip files.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2020  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/mm.h>
+#include <grub/file.h>
+#include <grub/disk.h>
+#include <grub/misc.h>
+#include <grub/partition.h>
+#include <grub/deflate.h>
+#include <grub/extcmd.h>
+#include <grub/i18n.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+static const struct grub_arg_option options[] =
+  {
+    {"save", 's', 0,
+     N_("Also save the index to FILE.gzi, which must already exist "
+	"and be large enough."), 0, ARG_TYPE_NONE},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+struct blocklist
+{
+  grub_disk_addr_t sector;
+  unsigned offset;
+  unsigned length;
+  struct blocklist *next;
+};
+
+/* Context for gzindex_save.  */
+struct gzindex_save_ctx
+{
+  struct blocklist *head, *tail;
+  grub_size_t length;
+};
+
+/* Store blocklists in a linked list.  */
+static void
+gzindex_read_hook (grub_disk_addr_t sector, unsigned offset, unsigned length,
+		   void *data)
+{
+  struct gzindex_save_ctx *ctx = data;
+  struct blocklist *block;
+
+  block = grub_malloc (sizeof (*block));
+  if (! block)
+    return;
+
+  block->sector = sector;
+  block->offset = offset;
+  block->length = length;
+  ctx->length += length;
+
+  block->next = 0;
+  if (ctx->tail)
+    ctx->tail->next = block;
+  ctx->tail = block;
+  if (! ctx->head)
+    ctx->head = block;
+}
+
+/* Overwrite the start of the existing file NAME.gzi with DATA, in place,
+   the way save_env writes the environment block.  */
+static grub_err_t
+gzindex_save (const char *name, const char *data, grub_size_t size)
+{
+  struct gzindex_save_ctx ctx = {
+    .head = 0,
+    .tail = 0,
+    .length = 0
+  };
+  struct blocklist *p, *q;
+  grub_file_t file;
+  grub_disk_t disk;
+  grub_disk_addr_t part_start;
+  char *path, *buf = NULL;
+  grub_size_t index;
+
+  path = grub_xasprintf ("%s.gzi", name);
+  if (! path)
+    return grub_errno;
+  file = grub_file_open (path, GRUB_FILE_TYPE_SAVEENV
+			 | GRUB_FILE_TYPE_SKIP_SIGNATURE
+			 | GRUB_FILE_TYPE_NO_DECOMPRESS);
+  grub_free (path);
+  if (! file)
+    return grub_errno;
+
+  if (! file->device->disk)
+    {
+      grub_error (GRUB_ERR_BAD_DEVICE, "disk device required");
+      goto fail;
+    }
+  if (grub_file_size (file) < size)
+    {
+      grub_error (GRUB_ERR_OUT_OF_RANGE,
+		  "index file too small, %" PRIuGRUB_SIZE " bytes needed",
+		  size);
+      goto fail;
+    }
+
+  buf = grub_malloc (size);
+  if (! buf)
+    goto fail;
+  file->read_hook = gzindex_read_hook;
+  file->read_hook_data = &ctx;
+  grub_file_read (file, buf, size);
+  file->read_hook = 0;
+  if (grub_errno)
+    goto fail;
+  if (ctx.length != size)
+    {
+      grub_error (GRUB_ERR_FILE_READ_ERROR, "invalid blocklist");
+      goto fail;
+    }
+
+  disk = file->device->disk;
+  part_start = grub_partition_get_start (disk->partition);
+  index = 0;
+  for (p = ctx.head; p; index += p->length, p = p->next)
+    if (grub_disk_write (disk, p->sector - part_start,
+			 p->offset, p->length, data + index))
+      break;
+
+ fail:
+  for (p = ctx.head; p; p = q)
+    {
+      q = p->next;
+      grub_free (p);
+    }
+  grub_free (buf);
+  grub_file_close (file);
+  return grub_errno;
+}
+
+static grub_err_t
+grub_cmd_gzindex (grub_extcmd_context_t ctxt, int argc, char **args)
+{
+  struct grub_arg_list *state = ctxt->state;
+  grub_file_t file;
+  void *data = NULL;
+  grub_size_t size;
+
+  if (argc != 1)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("filename expected"));
+
+  file = grub_file_open (args[0], GRUB_FILE_TYPE_LOOPBACK);
+  if (! file)
+    return grub_errno;
+
+  /* The index stays cached for later opens of the same file.  */
+  if (grub_gzio_index_build (file))
+    goto fail;
+
+  if (state[0].set
+      && grub_gzio_index_export (file, &data, &size) == GRUB_ERR_NONE)
+    gzindex_save (args[0], data, size);
+
+ fail:
+  grub_free (data);
+  grub_file_close (file);
+  return grub_errno;
+}
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(gzindex)
+{
+  cmd = grub_register_extcmd ("gzindex", grub_cmd_gzindex, 0,
+			      N_("[-s|--save] FILE"),
+			      N_("Build a random access index for a gzip file."),
+			      options);
+}
+
+GRUB_MOD_FINI(gzindex)
+{
+  grub_unregister_extcmd (cmd);
+}
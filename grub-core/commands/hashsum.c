@@ -25,17 +25,21 @@
 #include <grub/crypto.h>
 #include <grub/normal.h>
 #include <grub/i18n.h>
+#include <grub/time.h>
 
 GRUB_MOD_LICENSE ("GPLv3+");
 
 static const struct grub_arg_option options[] = {
-  {"hash", 'h', 0, N_("Specify hash to use."), N_("HASH"), ARG_TYPE_STRING},
+  {"hash", 'h', GRUB_ARG_OPTION_REPEATABLE,
+   N_("Specify hash to use. Can be given several times."), N_("HASH"),
+   ARG_TYPE_STRING},
   {"check", 'c', 0, N_("Check hashes of files with hash list FILE."),
    N_("FILE"), ARG_TYPE_STRING},
   {"prefix", 'p', 0, N_("Base directory for hash list."), N_("DIR"),
    ARG_TYPE_STRING},
   {"keep-going", 'k', 0, N_("Don't stop after first error."), 0, 0},
   {"uncompress", 'u', 0, N_("Uncompress file before checksumming."), 0, 0},
+  {"speed", 's', 0, N_("Report the throughput for each file."), 0, 0},
   {0, 0, 0, 0, 0, 0}
 };
 
@@ -48,6 +52,15 @@ static struct { const char *name; const char *hashname; } aliases[] =
     {"crc", "crc32"},
   };
 
+/* Files are read in chunks as large as the disk read-ahead window, so long
+   files stream past the disk cache.  */
+#define BUF_SIZE (GRUB_DISK_READAHEAD_MAX \
+		  << (GRUB_DISK_CACHE_BITS + GRUB_DISK_SECTOR_BITS))
+#define BUF_SIZE_MIN 4096
+
+/* The most digests computed in a single pass over a file.  */
+#define MAX_HASHES 8
+
 static inline int
 hextoval (char c)
 {
@@ -60,133 +73,284 @@ hextoval (char c)
   return -1;
 }
 
+/* Compute all of HASHES over FILE, reading it only once.  */
 static grub_err_t
-hash_file (grub_file_t file, const gcry_md_spec_t *hash, void *result)
+hash_file (grub_file_t file, const gcry_md_spec_t **hashes, unsigned nhashes,
+	   grub_uint8_t results[][GRUB_CRYPTO_MAX_MDLEN], int report)
 {
-  void *context;
+  void *contexts[MAX_HASHES];
   grub_uint8_t *readbuf;
-#define BUF_SIZE 4096
-  readbuf = grub_malloc (BUF_SIZE);
+  grub_size_t bufsize = BUF_SIZE;
+  grub_uint64_t total = 0, start, elapsed, whole, fraction;
+  unsigned i;
+
+  readbuf = grub_malloc (bufsize);
+  if (!readbuf)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      bufsize = BUF_SIZE_MIN;
+      readbuf = grub_malloc (bufsize);
+    }
   if (!readbuf)
     return grub_errno;
-  context = grub_zalloc (hash->contextsize);
-  if (!readbuf || !context)
-    goto fail;
 
-  hash->init (context);
+  for (i = 0; i < nhashes; i++)
+    {
+      contexts[i] = grub_zalloc (hashes[i]->contextsize);
+      if (!contexts[i])
+	{
+	  nhashes = i;
+	  goto fail;
+	}
+      hashes[i]->init (contexts[i]);
+    }
+
+  start = grub_get_time_ms ();
   while (1)
     {
       grub_ssize_t r;
-      r = grub_file_read (file, readbuf, BUF_SIZE);
+      r = grub_file_read (file, readbuf, bufsize);
       if (r < 0)
 	goto fail;
       if (r == 0)
 	break;
-      hash->write (context, readbuf, r);
+      for (i = 0; i < nhashes; i++)
+	hashes[i]->write (contexts[i], readbuf, r);
+      total += r;
+    }
+  for (i = 0; i < nhashes; i++)
+    {
+      hashes[i]->final (contexts[i]);
+      grub_memcpy (results[i], hashes[i]->read (contexts[i]),
+		   hashes[i]->mdlen);
     }
-  hash->final (context);
-  grub_memcpy (result, hash->read (context), hash->mdlen);
+  elapsed = grub_get_time_ms () - start;
 
-  grub_free (readbuf);
-  grub_free (context);
+  if (report)
+    {
+      grub_printf ("%s: %s", file->name,
+		   grub_get_human_size (total, GRUB_HUMAN_SIZE_NORMAL));
+      whole = grub_divmod64 (elapsed, 1000, &fraction);
+      grub_printf_ (N_(" in %d.%03d s"), (unsigned) whole,
+		    (unsigned) fraction);
+      if (elapsed)
+	grub_printf (", %s",
+		     grub_get_human_size (grub_divmod64 (total * 100ULL
+							 * 1000ULL,
+							 elapsed, 0),
+					  GRUB_HUMAN_SIZE_SPEED));
+      grub_printf ("\n");
+    }
 
+  grub_free (readbuf);
+  for (i = 0; i < nhashes; i++)
+    grub_free (contexts[i]);
   return GRUB_ERR_NONE;
 
  fail:
   grub_free (readbuf);
-  grub_free (context);
+  for (i = 0; i < nhashes; i++)
+    grub_free (contexts[i]);
   return grub_errno;
 }
 
+static int
+parse_hex (const char **p, grub_uint8_t *out, grub_size_t len)
+{
+  grub_size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      int high, low;
+      high = hextoval ((*p)[0]);
+      if (high < 0)
+	return 0;
+      low = hextoval ((*p)[1]);
+      if (low < 0)
+	return 0;
+      out[i] = (high << 4) | low;
+      *p += 2;
+    }
+  return 1;
+}
+
+/* Parse a hash list line, either "HEX  FILE" for HASH or the tagged
+   "NAME (FILE) = HEX" written by BSD tools, `sha256sum --tag' and hashsum
+   with several hashes.  LINE is modified in place.  */
+static grub_err_t
+parse_line (char *line, const gcry_md_spec_t *hash,
+	    const gcry_md_spec_t **line_hash, grub_uint8_t *expected,
+	    const char **filename)
+{
+  const char *p = line;
+  char *lparen, *rparen;
+
+  while (grub_isspace (p[0]))
+    p++;
+
+  if (hash && parse_hex (&p, expected, hash->mdlen)
+      && (p[0] == ' ' || p[0] == '\t') && (p[1] == ' ' || p[1] == '\t'))
+    {
+      *line_hash = hash;
+      *filename = p + 2;
+      return GRUB_ERR_NONE;
+    }
+
+  p = line;
+  while (grub_isspace (p[0]))
+    p++;
+  lparen = grub_strstr (p, " (");
+  rparen = grub_strrchr (p, ')');
+  if (!lparen || !rparen || rparen < lparen
+      || grub_strncmp (rparen, ") = ", 4) != 0)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid hash list");
+  *lparen = '\0';
+  *rparen = '\0';
+
+  *line_hash = grub_crypto_lookup_md_by_name (p);
+  if (!*line_hash)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown hash `%s'", p);
+  if ((*line_hash)->mdlen > GRUB_CRYPTO_MAX_MDLEN)
+    return grub_error (GRUB_ERR_BUG, "mdlen is too long");
+
+  *filename = lparen + 2;
+  p = rparen + 4;
+  if (!parse_hex (&p, expected, (*line_hash)->mdlen))
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid hash list");
+  return GRUB_ERR_NONE;
+}
+
+/* Consecutive hash list lines for the same file, checked together.  */
+struct check_group
+{
+  char *filename;
+  unsigned nhashes;
+  const gcry_md_spec_t *hashes[MAX_HASHES];
+  grub_uint8_t expected[MAX_HASHES][GRUB_CRYPTO_MAX_MDLEN];
+};
+
+static grub_err_t
+check_group (struct check_group *group, const char *prefix, int keep,
+	     int uncompress, int report, unsigned *unread, unsigned *mismatch)
+{
+  grub_uint8_t actual[MAX_HASHES][GRUB_CRYPTO_MAX_MDLEN];
+  const char *p = group->filename;
+  grub_file_t file;
+  grub_err_t err;
+  unsigned i;
+
+  if (prefix)
+    {
+      char *filename;
+
+      filename = grub_xasprintf ("%s/%s", prefix, p);
+      if (!filename)
+	return grub_errno;
+      file = grub_file_open (filename, GRUB_FILE_TYPE_TO_HASH
+			     | (!uncompress ? GRUB_FILE_TYPE_NO_DECOMPRESS
+				: GRUB_FILE_TYPE_NONE));
+      grub_free (filename);
+    }
+  else
+    file = grub_file_open (p, GRUB_FILE_TYPE_TO_HASH
+			   | (!uncompress ? GRUB_FILE_TYPE_NO_DECOMPRESS
+			      : GRUB_FILE_TYPE_NONE));
+  if (!file)
+    return grub_errno;
+  err = hash_file (file, group->hashes, group->nhashes, actual, report);
+  grub_file_close (file);
+  if (err)
+    {
+      grub_printf_ (N_("%s: READ ERROR\n"), p);
+      if (!keep)
+	return err;
+      grub_print_error ();
+      grub_errno = GRUB_ERR_NONE;
+      (*unread)++;
+      return GRUB_ERR_NONE;
+    }
+  for (i = 0; i < group->nhashes; i++)
+    if (grub_crypto_memcmp (group->expected[i], actual[i],
+			    group->hashes[i]->mdlen) != 0)
+      {
+	grub_printf_ (N_("%s: HASH MISMATCH\n"), p);
+	if (!keep)
+	  return grub_error (GRUB_ERR_TEST_FAILURE,
+			     "hash of '%s' mismatches", p);
+	(*mismatch)++;
+	return GRUB_ERR_NONE;
+      }
+  grub_printf_ (N_("%s: OK\n"), p);
+  return GRUB_ERR_NONE;
+}
+
 static grub_err_t
 check_list (const gcry_md_spec_t *hash, const char *hashfilename,
-	    const char *prefix, int keep, int uncompress)
+	    const char *prefix, int keep, int uncompress, int report)
 {
-  grub_file_t hashlist, file;
+  grub_file_t hashlist;
   char *buf = NULL;
+  struct check_group group;
   grub_uint8_t expected[GRUB_CRYPTO_MAX_MDLEN];
-  grub_uint8_t actual[GRUB_CRYPTO_MAX_MDLEN];
-  grub_err_t err;
-  unsigned i;
+  const gcry_md_spec_t *line_hash;
+  const char *filename;
+  grub_err_t err = GRUB_ERR_NONE;
   unsigned unread = 0, mismatch = 0;
 
-  if (hash->mdlen > GRUB_CRYPTO_MAX_MDLEN)
+  if (hash && hash->mdlen > GRUB_CRYPTO_MAX_MDLEN)
     return grub_error (GRUB_ERR_BUG, "mdlen is too long");
 
   hashlist = grub_file_open (hashfilename, GRUB_FILE_TYPE_HASHLIST);
   if (!hashlist)
     return grub_errno;
-  
-  while (grub_free (buf), (buf = grub_file_getline (hashlist)))
+
+  group.filename = NULL;
+  group.nhashes = 0;
+  while ((buf = grub_file_getline (hashlist)))
     {
-      const char *p = buf;
-      while (grub_isspace (p[0]))
-	p++;
-      for (i = 0; i < hash->mdlen; i++)
-	{
-	  int high, low;
-	  high = hextoval (*p++);
-	  low = hextoval (*p++);
-	  if (high < 0 || low < 0)
-	    return grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid hash list");
-	  expected[i] = (high << 4) | low;
-	}
-      if ((p[0] != ' ' && p[0] != '\t') || (p[1] != ' ' && p[1] != '\t'))
-	return grub_error (GRUB_ERR_BAD_FILE_TYPE, "invalid hash list");
-      p += 2;
-      if (prefix)
-	{
-	  char *filename;
-	  
-	  filename = grub_xasprintf ("%s/%s", prefix, p);
-	  if (!filename)
-	    return grub_errno;
-	  file = grub_file_open (filename, GRUB_FILE_TYPE_TO_HASH
-				 | (!uncompress ? GRUB_FILE_TYPE_NO_DECOMPRESS
-				    : GRUB_FILE_TYPE_NONE));
-	  grub_free (filename);
-	}
-      else
-	file = grub_file_open (p, GRUB_FILE_TYPE_TO_HASH
-			       | (!uncompress ? GRUB_FILE_TYPE_NO_DECOMPRESS
-				  : GRUB_FILE_TYPE_NONE));
-      if (!file)
-	{
-	  grub_file_close (hashlist);
-	  grub_free (buf);
-	  return grub_errno;
-	}
-      err = hash_file (file, hash, actual);
-      grub_file_close (file);
+      err = parse_line (buf, hash, &line_hash, expected, &filename);
       if (err)
+	goto out;
+
+      /* Files listed with several hashes on consecutive lines are only
+	 read once.  */
+      if (group.filename
+	  && (grub_strcmp (group.filename, filename) != 0
+	      || group.nhashes == MAX_HASHES))
 	{
-	  grub_printf_ (N_("%s: READ ERROR\n"), p);
-	  if (!keep)
-	    {
-	      grub_file_close (hashlist);
-	      grub_free (buf);
-	      return err;
-	    }
-	  grub_print_error ();
-	  grub_errno = GRUB_ERR_NONE;
-	  unread++;
-	  continue;
+	  err = check_group (&group, prefix, keep, uncompress, report,
+			     &unread, &mismatch);
+	  grub_free (group.filename);
+	  group.filename = NULL;
+	  group.nhashes = 0;
+	  if (err)
+	    goto out;
 	}
-      if (grub_crypto_memcmp (expected, actual, hash->mdlen) != 0)
+      if (!group.filename)
 	{
-	  grub_printf_ (N_("%s: HASH MISMATCH\n"), p);
-	  if (!keep)
+	  group.filename = grub_strdup (filename);
+	  if (!group.filename)
 	    {
-	      grub_file_close (hashlist);
-	      grub_free (buf);
-	      return grub_error (GRUB_ERR_TEST_FAILURE,
-				 "hash of '%s' mismatches", p);
+	      err = grub_errno;
+	      goto out;
 	    }
-	  mismatch++;
-	  continue;	  
 	}
-      grub_printf_ (N_("%s: OK\n"), p);
+      group.hashes[group.nhashes] = line_hash;
+      grub_memcpy (group.expected[group.nhashes], expected,
+		   line_hash->mdlen);
+      group.nhashes++;
+      grub_free (buf);
     }
+  if (group.filename)
+    err = check_group (&group, prefix, keep, uncompress, report,
+		       &unread, &mismatch);
+
+ out:
+  grub_free (buf);
+  grub_free (group.filename);
+  grub_file_close (hashlist);
+  if (err)
+    return err;
   if (mismatch || unread)
     return grub_error (GRUB_ERR_TEST_FAILURE,
 		       "%d files couldn't be read and hash "
@@ -199,29 +363,36 @@ grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
 		  int argc, char **args)
 {
   struct grub_arg_list *state = ctxt->state;
-  const char *hashname = NULL;
+  const char *hashnames[MAX_HASHES];
+  const gcry_md_spec_t *hashes[MAX_HASHES];
+  unsigned nhashes = 0;
   const char *prefix = NULL;
-  const gcry_md_spec_t *hash;
   unsigned i;
   int keep = state[3].set;
   int uncompress = state[4].set;
+  int report = state[5].set;
   unsigned unread = 0;
 
   for (i = 0; i < ARRAY_SIZE (aliases); i++)
     if (grub_strcmp (ctxt->extcmd->cmd->name, aliases[i].name) == 0)
-      hashname = aliases[i].hashname;
+      hashnames[nhashes++] = aliases[i].hashname;
   if (state[0].set)
-    hashname = state[0].arg;
-
-  if (!hashname)
-    return grub_error (GRUB_ERR_BAD_ARGUMENT, "no hash specified");
+    {
+      if (state[0].set > MAX_HASHES)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "too many hashes");
+      for (nhashes = 0; state[0].args[nhashes]; nhashes++)
+	hashnames[nhashes] = state[0].args[nhashes];
+    }
 
-  hash = grub_crypto_lookup_md_by_name (hashname);
-  if (!hash)
-    return grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown hash");
+  for (i = 0; i < nhashes; i++)
+    {
+      hashes[i] = grub_crypto_lookup_md_by_name (hashnames[i]);
+      if (!hashes[i])
+	return grub_error (GRUB_ERR_BAD_ARGUMENT, "unknown hash");
 
-  if (hash->mdlen > GRUB_CRYPTO_MAX_MDLEN)
-    return grub_error (GRUB_ERR_BUG, "mdlen is too long");
+      if (hashes[i]->mdlen > GRUB_CRYPTO_MAX_MDLEN)
+	return grub_error (GRUB_ERR_BUG, "mdlen is too long");
+    }
 
   if (state[2].set)
     prefix = state[2].arg;
@@ -231,15 +402,23 @@ grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
       if (argc != 0)
 	return grub_error (GRUB_ERR_BAD_ARGUMENT,
 			   "--check is incompatible with file list");
-      return check_list (hash, state[1].arg, prefix, keep, uncompress);
+      /* Tagged hash lists name the hash on each line.  */
+      if (nhashes > 1)
+	return grub_error (GRUB_ERR_BAD_ARGUMENT,
+			   "--check takes at most one hash");
+      return check_list (nhashes ? hashes[0] : NULL, state[1].arg, prefix,
+			 keep, uncompress, report);
     }
 
+  if (!nhashes)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "no hash specified");
+
   for (i = 0; i < (unsigned) argc; i++)
     {
-      GRUB_PROPERLY_ALIGNED_ARRAY (result, GRUB_CRYPTO_MAX_MDLEN);
+      grub_uint8_t result[MAX_HASHES][GRUB_CRYPTO_MAX_MDLEN];
       grub_file_t file;
       grub_err_t err;
-      unsigned j;
+      unsigned j, k;
       file = grub_file_open (args[i], GRUB_FILE_TYPE_TO_HASH
 			     | (!uncompress ? GRUB_FILE_TYPE_NO_DECOMPRESS
 				: GRUB_FILE_TYPE_NONE));
@@ -252,7 +431,7 @@ grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
 	  unread++;
 	  continue;
 	}
-      err = hash_file (file, hash, result);
+      err = hash_file (file, hashes, nhashes, result, report);
       grub_file_close (file);
       if (err)
 	{
@@ -263,9 +442,19 @@ grub_cmd_hashsum (struct grub_extcmd_context *ctxt,
 	  unread++;
 	  continue;
 	}
-      for (j = 0; j < hash->mdlen; j++)
-	grub_printf ("%02x", ((grub_uint8_t *) result)[j]);
-      grub_printf ("  %s\n", args[i]);
+      /* With several hashes, print the tagged format, which --check
+	 reads back.  */
+      for (k = 0; k < nhashes; k++)
+	{
+	  if (nhashes > 1)
+	    grub_printf ("%s (%s) = ", hashes[k]->name, args[i]);
+	  for (j = 0; j < hashes[k]->mdlen; j++)
+	    grub_printf ("%02x", result[k][j]);
+	  if (nhashes > 1)
+	    grub_printf ("\n");
+	  else
+	    grub_printf ("  %s\n", args[i]);
+	}
     }
 
   if (unread)
@@ -279,8 +468,8 @@ static grub_extcmd_t cmd, cmd_md5, cmd_sha1, cmd_sha256, cmd_sha512, cmd_crc;
 GRUB_MOD_INIT(hashsum)
 {
   cmd = grub_register_extcmd ("hashsum", grub_cmd_hashsum, 0,
-			      N_("-h HASH [-c FILE [-p PREFIX]] "
-				 "[FILE1 [FILE2 ...]]"),
+			      N_("-h HASH [-h HASH ...] [-c FILE [-p PREFIX]] "
+				 "[-s] [FILE1 [FILE2 ...]]"),
 			      /* TRANSLATORS: "hash checksum" is just to
 				 be a bit more precise, you can treat it as
 				 just "hash".  */
@@ -114,7 +114,15 @@ print_files_long (const char *filename, const struct grub_dirhook_info *info,
   if ((! ctx->all) && (filename[0] == '.'))
     return 0;
 
-  if (! info->dir)
+  if (! info->dir && info->sizeset)
+    {
+      if (! ctx->human)
+	grub_printf ("%-12llu", (unsigned long long) info->size);
+      else
+	grub_printf ("%-12s", grub_get_human_size (info->size,
+						   GRUB_HUMAN_SIZE_SHORT));
+    }
+  else if (! info->dir)
     {
       grub_file_t file;
       char *pathname;
@@ -239,6 +247,9 @@ grub_ls_list_files (char *dirname, int longlist, int all, int human)
 	  if (! file)
 	    goto fail;
 
+	  grub_memset (&info, 0, sizeof (info));
+	  info.sizeset = 1;
+	  info.size = file->size;
 	  grub_file_close (file);
 
 	  p = grub_strrchr (dirname, '/') + 1;
@@ -247,7 +258,6 @@ grub_ls_list_files (char *dirname, int longlist, int all, int human)
 	    goto fail;
 
 	  all = 1;
-	  grub_memset (&info, 0, sizeof (info));
 	  if (longlist)
 	    print_files_long (p, &info, &ctx);
 	  else
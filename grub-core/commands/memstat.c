@@ -0,0 +1,238 @@
+/* memstat.c - report the state of the heap.  */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2020  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/dl.h>
+#include <grub/misc.h>
+#include <grub/extcmd.h>
+#include <grub/env.h>
+#include <grub/i18n.h>
+#include <grub/mm.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+static const struct grub_arg_option options[] =
+  {
+    {"sites", 's', 0,
+     N_("Show usage by call site (needs a build with --enable-mm-debug)."),
+     0, 0},
+    {"reset", 'r', 0, N_("Reset the peak and the allocation counts."), 0, 0},
+    {0, 0, 0, 0, 0, 0}
+  };
+
+#ifndef GRUB_MACHINE_EMU
+/* Share of the free memory which is not in the largest free block, in
+   percent.  */
+static unsigned
+fragmentation (const struct grub_mm_stats *stats)
+{
+  if (! stats->free)
+    return 0;
+  return 100 - (unsigned) ((grub_uint64_t) stats->largest_free * 100
+			   / stats->free);
+}
+
+#ifdef MM_DEBUG
+static void
+print_sites (void)
+{
+  struct grub_mm_site_info *sites, info;
+  unsigned i, j, n = 0;
+
+  for (i = 0; grub_mm_site_info (i, &info); i++);
+  sites = grub_malloc (i * sizeof (*sites));
+  if (! sites)
+    return;
+
+  /* Largest current usage first.  */
+  for (i = 0; grub_mm_site_info (i, &info); i++)
+    {
+      if (! info.file || (! info.in_use && ! info.allocs))
+	continue;
+      for (j = n; j > 0 && sites[j - 1].in_use < info.in_use; j--)
+	sites[j] = sites[j - 1];
+      sites[j] = info;
+      n++;
+    }
+
+  grub_printf_ (N_("%10s %10s %8s  call site\n"), "in use", "peak",
+		"allocs");
+  for (i = 0; i < n; i++)
+    grub_printf ("%10" PRIuGRUB_SIZE " %10" PRIuGRUB_SIZE " %8"
+		 PRIuGRUB_SIZE "  %s:%d\n", sites[i].in_use, sites[i].peak,
+		 sites[i].allocs, sites[i].file, sites[i].line);
+
+  grub_free (sites);
+}
+#endif
+#endif
+
+static grub_err_t
+grub_cmd_memstat (grub_extcmd_context_t ctxt,
+		  int argc __attribute__ ((unused)),
+		  char **args __attribute__ ((unused)))
+{
+#ifndef GRUB_MACHINE_EMU
+  struct grub_arg_list *state = ctxt->state;
+  struct grub_mm_slab_info info;
+  struct grub_mm_stats stats;
+  unsigned cls, i;
+
+  if (state[1].set)
+    {
+      grub_mm_reset_stats ();
+      return GRUB_ERR_NONE;
+    }
+
+  if (state[0].set)
+    {
+#ifdef MM_DEBUG
+      print_sites ();
+      return grub_errno;
+#else
+      return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+			 "call sites are only tracked with --enable-mm-debug");
+#endif
+    }
+
+  grub_mm_get_stats (&stats);
+
+  grub_printf_ (N_("Heap: %" PRIuGRUB_SIZE " bytes, %" PRIuGRUB_SIZE
+		   " in use, peak %" PRIuGRUB_SIZE "\n"),
+		stats.heap_size, stats.in_use, stats.peak);
+  grub_printf_ (N_("Free: %" PRIuGRUB_SIZE " bytes, largest block %"
+		   PRIuGRUB_SIZE ", fragmentation %u%%\n"),
+		stats.free, stats.largest_free, fragmentation (&stats));
+
+  grub_printf_ (N_("Allocations by size:\n"));
+  for (i = 0; i < GRUB_MM_STAT_BUCKETS; i++)
+    {
+      if (! stats.allocs[i])
+	continue;
+      if (i < GRUB_MM_STAT_BUCKETS - 1)
+	grub_printf ("%10s %9" PRIuGRUB_SIZE ": %" PRIuGRUB_SIZE "\n", "<=",
+		     (grub_size_t) GRUB_MM_STAT_BUCKET_MIN << i,
+		     stats.allocs[i]);
+      else
+	grub_printf ("%10s %9" PRIuGRUB_SIZE ": %" PRIuGRUB_SIZE "\n", ">",
+		     (grub_size_t) GRUB_MM_STAT_BUCKET_MIN << (i - 1),
+		     stats.allocs[i]);
+    }
+
+  grub_printf_ (N_("Slab occupancy:\n"));
+  for (cls = 0; grub_mm_slab_info (cls, &info); cls++)
+    {
+      grub_printf_ (N_("%6" PRIuGRUB_SIZE " bytes: %" PRIuGRUB_SIZE
+		       "/%" PRIuGRUB_SIZE " objects in use, %"
+		       PRIuGRUB_SIZE " slabs"),
+		    info.size, info.inuse, info.objects, info.slabs);
+      if (info.objects)
+	grub_printf (" (%" PRIuGRUB_SIZE "%%)",
+		     info.inuse * 100 / info.objects);
+      grub_printf ("\n");
+    }
+
+  return GRUB_ERR_NONE;
+#else
+  (void) ctxt;
+  return grub_error (GRUB_ERR_NOT_IMPLEMENTED_YET,
+		     "heap statistics are not available");
+#endif
+}
+
+#ifndef GRUB_MACHINE_EMU
+/* Read-only variables with the current counters, for scripts.  */
+static const char *
+mm_get_env (struct grub_env_var *var, const char *val __attribute__ ((unused)))
+{
+  static char buf[32];
+  struct grub_mm_stats stats;
+  grub_size_t value;
+
+  grub_mm_get_stats (&stats);
+  if (grub_strcmp (var->name, "mm_in_use") == 0)
+    value = stats.in_use;
+  else if (grub_strcmp (var->name, "mm_peak") == 0)
+    value = stats.peak;
+  else if (grub_strcmp (var->name, "mm_largest_free") == 0)
+    value = stats.largest_free;
+  else
+    value = fragmentation (&stats);
+
+  grub_snprintf (buf, sizeof (buf), "%" PRIuGRUB_SIZE, value);
+  return buf;
+}
+
+static char *
+mm_set_env_readonly (struct grub_env_var *var __attribute__ ((unused)),
+		     const char *val __attribute__ ((unused)))
+{
+  return NULL;
+}
+
+static const char *const env_vars[] =
+  {
+    "mm_in_use", "mm_peak", "mm_largest_free", "mm_fragmentation"
+  };
+
+#ifdef MM_DEBUG
+/* Setting mm_debug traces every allocation and free on the console.  */
+static char *
+mm_debug_set_env (struct grub_env_var *var __attribute__ ((unused)),
+		  const char *val)
+{
+  grub_mm_debug = (val[0] && grub_strcmp (val, "0") != 0);
+  return grub_strdup (val);
+}
+#endif
+#endif
+
+static grub_extcmd_t cmd;
+
+GRUB_MOD_INIT(memstat)
+{
+#ifndef GRUB_MACHINE_EMU
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (env_vars); i++)
+    grub_register_variable_hook (env_vars[i], mm_get_env,
+				 mm_set_env_readonly);
+#ifdef MM_DEBUG
+  grub_register_variable_hook ("mm_debug", 0, mm_debug_set_env);
+#endif
+#endif
+
+  cmd = grub_register_extcmd ("memstat", grub_cmd_memstat, 0,
+			      N_("[-s|-r]"),
+			      N_("Show heap statistics."), options);
+}
+
+GRUB_MOD_FINI(memstat)
+{
+#ifndef GRUB_MACHINE_EMU
+  unsigned i;
+
+  for (i = 0; i < ARRAY_SIZE (env_vars); i++)
+    grub_register_variable_hook (env_vars[i], 0, 0);
+#ifdef MM_DEBUG
+  grub_register_variable_hook ("mm_debug", 0, 0);
+#endif
+#endif
+
+  grub_unregister_extcmd (cmd);
+}
@@ -121,6 +121,7 @@ grub_cmd_loopback (grub_extcmd_context_t ctxt, int argc, char **args)
       grub_free (newdev->addr);
     newdev->file = file;
     newdev->addr = addr;
+    grub_disk_changed ();
     return 0;
   }
 
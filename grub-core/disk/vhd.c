@@ -1033,6 +1033,7 @@ grub_cmd_vhd (grub_extcmd_context_t ctxt, int argc, char **args)
       /* Set has_partitions when `--partitions' was used.  */
       newdev->has_partitions = state[1].set;
 
+      grub_disk_changed ();
       return 0;
     }
 
@@ -2330,6 +2330,11 @@ grub_btrfs_dir (grub_device_t device, const char *path,
 	  c = cdirel->name[grub_le_to_cpu16 (cdirel->n)];
 	  cdirel->name[grub_le_to_cpu16 (cdirel->n)] = 0;
 	  info.dir = (cdirel->type == GRUB_BTRFS_DIR_ITEM_TYPE_DIRECTORY);
+	  if (!err && cdirel->type == GRUB_BTRFS_DIR_ITEM_TYPE_REGULAR)
+	    {
+	      info.size = grub_le_to_cpu64 (inode.size);
+	      info.sizeset = 1;
+	    }
 	  if (hook (cdirel->name, &info, hook_data))
 	    goto out;
 	  cdirel->name[grub_le_to_cpu16 (cdirel->n)] = c;
@@ -184,8 +184,12 @@ grub_ext4_find_leaf (struct grub_ext2_data *data,
   return 0;
 }
 
+/* Translate FILEBLOCK and set *COUNT to the length of the run it starts:
+   the rest of its extent, or up to the next extent for a hole.  Block
+   mapped files are translated a block at a time.  */
 static grub_disk_addr_t
-grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
+grub_ext2_read_extent (grub_fshelp_node_t node, grub_disk_addr_t fileblock,
+		       grub_disk_addr_t *count)
 {
   struct grub_ext2_data *data = node->data;
   struct grub_ext2_inode *inode = &node->inode;
@@ -196,12 +200,15 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
   grub_uint32_t indir;
   int shift;
 
+  *count = 1;
+
   if (inode->flags & grub_cpu_to_le32_compile_time (EXT4_EXTENTS_FLAG))
     {
       struct grub_ext4_extent_header *leaf;
       struct grub_ext4_extent *ext;
       int i;
       grub_disk_addr_t ret;
+      grub_disk_addr_t block = fileblock;
 
       leaf = grub_ext4_find_leaf (data, (struct grub_ext4_extent_header *) inode->blocks.dir_blocks, fileblock);
       if (! leaf)
@@ -219,9 +226,27 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
 
       if (--i >= 0)
         {
+	  grub_uint32_t len = grub_le_to_cpu16 (ext[i].len);
+	  int unwritten = 0;
+
+	  if (len > EXT4_EXT_INIT_MAX_LEN)
+	    {
+	      len -= EXT4_EXT_INIT_MAX_LEN;
+	      unwritten = 1;
+	    }
+
           fileblock -= grub_le_to_cpu32 (ext[i].block);
-          if (fileblock >= grub_le_to_cpu16 (ext[i].len))
-	    ret = 0;
+          if (fileblock >= len)
+	    {
+	      ret = 0;
+	      if (i + 1 < grub_le_to_cpu16 (leaf->entries))
+		*count = grub_le_to_cpu32 (ext[i + 1].block) - block;
+	    }
+	  else if (unwritten)
+	    {
+	      ret = 0;
+	      *count = len - fileblock;
+	    }
           else
             {
               grub_disk_addr_t start;
@@ -230,7 +255,13 @@ grub_ext2_read_block (grub_fshelp_node_t node, grub_disk_addr_t fileblock)
               start = (start << 32) + grub_le_to_cpu32 (ext[i].start);
 
               ret = fileblock + start;
+	      *count = len - fileblock;
             }
+
+	  /* Never run into the next extent, whatever this one claims.  */
+	  if (i + 1 < grub_le_to_cpu16 (leaf->entries)
+	      && *count > grub_le_to_cpu32 (ext[i + 1].block) - block)
+	    *count = grub_le_to_cpu32 (ext[i + 1].block) - block;
         }
       else
         {
@@ -301,12 +332,12 @@ grub_ext2_read_file (grub_fshelp_node_t node,
 		     grub_disk_read_hook_t read_hook, void *read_hook_data, int blocklist,
 		     grub_off_t pos, grub_size_t len, char *buf)
 {
-  return grub_fshelp_read_file (node->data->disk, node,
-				read_hook, read_hook_data, blocklist,
-				pos, len, buf, grub_ext2_read_block,
-				grub_cpu_to_le32 (node->inode.size)
-				| (((grub_off_t) grub_cpu_to_le32 (node->inode.size_high)) << 32),
-				LOG2_EXT2_BLOCK_SIZE (node->data), 0);
+  return grub_fshelp_read_file_extents (node->data->disk, node,
+					read_hook, read_hook_data, blocklist,
+					pos, len, buf, grub_ext2_read_extent,
+					grub_cpu_to_le32 (node->inode.size)
+					| (((grub_off_t) grub_cpu_to_le32 (node->inode.size_high)) << 32),
+					LOG2_EXT2_BLOCK_SIZE (node->data), 0);
 
 }
 
@@ -676,13 +707,19 @@ grub_ext2_dir_iter (const char *filename, enum grub_fshelp_filetype filetype,
 	node->inode_read = 1;
       grub_errno = GRUB_ERR_NONE;
     }
+  info.dir = ((filetype & GRUB_FSHELP_TYPE_MASK) == GRUB_FSHELP_DIR);
   if (node->inode_read)
     {
       info.mtimeset = 1;
       info.mtime = grub_le_to_cpu32 (node->inode.mtime);
+      if ((filetype & GRUB_FSHELP_TYPE_MASK) == GRUB_FSHELP_REG)
+	{
+	  info.sizeset = 1;
+	  info.size = grub_le_to_cpu32 (node->inode.size);
+	  info.size |= ((grub_off_t) grub_le_to_cpu32 (node->inode.size_high)) << 32;
+	}
     }
 
-  info.dir = ((filetype & GRUB_FSHELP_TYPE_MASK) == GRUB_FSHELP_DIR);
   grub_free (node);
   return ctx->hook (filename, &info, ctx->hook_data);
 }
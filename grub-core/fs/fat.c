@@ -185,6 +185,15 @@ struct grub_fat_data
   grub_uint32_t uuid;
 };
 
+/* A stretch of a cluster chain whose clusters follow each other on disk,
+   starting with the LOGICAL'th cluster of the file.  */
+struct grub_fat_run
+{
+  grub_uint32_t logical;
+  grub_uint32_t cluster;
+  grub_uint32_t count;
+};
+
 struct grub_fshelp_node {
   grub_disk_t disk;
   struct grub_fat_data *data;
@@ -199,11 +208,18 @@ struct grub_fshelp_node {
   grub_uint32_t cur_cluster_num;
   grub_uint32_t cur_cluster;
 
+  /* The cluster chain of an opened file, mapped on its first read.  */
+  struct grub_fat_run *runs;
+  grub_uint32_t nruns;
+
 #ifdef MODE_EXFAT
   int is_contiguous;
 #endif
 };
 
+/* Bytes of the FAT read at once while mapping a cluster chain.  */
+#define FAT_BATCH_SIZE	0x8000
+
 static grub_dl_t my_mod;
 
 #ifndef MODE_EXFAT
@@ -449,6 +465,216 @@ grub_fat_mount (grub_disk_t disk)
   return 0;
 }
 
+/* Map the cluster chain of NODE, as far as its size requires, to runs of
+   clusters which are contiguous on disk.  The FAT is read FAT_BATCH_SIZE
+   bytes at a time.  */
+static grub_err_t
+grub_fat_map_runs (grub_disk_t disk, grub_fshelp_node_t node)
+{
+  struct grub_fat_data *data = node->data;
+  unsigned logical_cluster_bits = data->cluster_bits + GRUB_DISK_SECTOR_BITS;
+  unsigned entry_bytes = (data->fat_size + 7) >> 3;
+  grub_uint64_t fat_bytes = ((grub_uint64_t) data->sectors_per_fat
+			     << GRUB_DISK_SECTOR_BITS);
+  grub_uint64_t win_start = 0, win_len = 0, nclusters;
+  grub_uint8_t *fat = NULL;
+  struct grub_fat_run *runs;
+  grub_uint32_t nruns = 0, alloc = 16;
+  grub_uint32_t cluster = node->file_cluster;
+  grub_uint32_t logical;
+
+  nclusters = ((node->file_size + (1ULL << logical_cluster_bits) - 1)
+	       >> logical_cluster_bits);
+  if (nclusters > data->num_clusters)
+    nclusters = data->num_clusters;
+
+  runs = grub_malloc (alloc * sizeof (*runs));
+  if (! runs)
+    return grub_errno;
+
+  for (logical = 0; logical < nclusters; logical++)
+    {
+      grub_uint64_t fat_offset;
+      grub_uint8_t *entry;
+      grub_uint32_t next_cluster;
+
+      if (cluster < 2 || cluster >= data->num_clusters)
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u", cluster);
+	  goto fail;
+	}
+
+      if (nruns && runs[nruns - 1].cluster + runs[nruns - 1].count == cluster)
+	runs[nruns - 1].count++;
+      else
+	{
+	  if (nruns == alloc)
+	    {
+	      struct grub_fat_run *new_runs;
+
+	      alloc *= 2;
+	      new_runs = grub_realloc (runs, alloc * sizeof (*runs));
+	      if (! new_runs)
+		goto fail;
+	      runs = new_runs;
+	    }
+	  runs[nruns].logical = logical;
+	  runs[nruns].cluster = cluster;
+	  runs[nruns].count = 1;
+	  nruns++;
+	}
+
+      if (logical + 1 == nclusters)
+	break;
+
+      switch (data->fat_size)
+	{
+	case 32:
+	  fat_offset = (grub_uint64_t) cluster << 2;
+	  break;
+	case 16:
+	  fat_offset = (grub_uint64_t) cluster << 1;
+	  break;
+	default:
+	  /* case 12: */
+	  fat_offset = cluster + (cluster >> 1);
+	  break;
+	}
+
+      if (fat_offset + entry_bytes > fat_bytes)
+	{
+	  grub_error (GRUB_ERR_BAD_FS, "invalid cluster %u", cluster);
+	  goto fail;
+	}
+
+      if (fat_offset < win_start || fat_offset + entry_bytes > win_start + win_len)
+	{
+	  if (! fat)
+	    {
+	      fat = grub_malloc (FAT_BATCH_SIZE);
+	      if (! fat)
+		goto fail;
+	    }
+	  win_start = fat_offset & ~(grub_uint64_t) (GRUB_DISK_SECTOR_SIZE - 1);
+	  win_len = fat_bytes - win_start;
+	  if (win_len > FAT_BATCH_SIZE)
+	    win_len = FAT_BATCH_SIZE;
+	  if (grub_disk_read (disk, data->fat_sector, win_start, win_len, fat))
+	    goto fail;
+	}
+
+      entry = fat + (fat_offset - win_start);
+      switch (data->fat_size)
+	{
+	case 32:
+	  next_cluster = grub_get_unaligned32 (entry);
+	  next_cluster = grub_le_to_cpu32 (next_cluster);
+	  break;
+	case 16:
+	  next_cluster = entry[0] | (entry[1] << 8);
+	  break;
+	default:
+	  /* case 12: */
+	  next_cluster = entry[0] | (entry[1] << 8);
+	  if (cluster & 1)
+	    next_cluster >>= 4;
+	  next_cluster &= 0x0FFF;
+	  break;
+	}
+
+      /* Check the end.  */
+      if (next_cluster >= data->cluster_eof_mark)
+	break;
+
+      cluster = next_cluster;
+    }
+
+  grub_dprintf ("fat", "cluster chain of %u clusters in %u runs\n",
+		logical, nruns);
+
+  grub_free (fat);
+  node->runs = runs;
+  node->nruns = nruns;
+  return GRUB_ERR_NONE;
+
+ fail:
+  grub_free (fat);
+  grub_free (runs);
+  return grub_errno;
+}
+
+/* Find the run holding the LOGICAL'th cluster of NODE.  */
+static const struct grub_fat_run *
+grub_fat_find_run (grub_fshelp_node_t node, grub_uint32_t logical)
+{
+  grub_uint32_t lo = 0, hi = node->nruns;
+
+  if (! node->nruns)
+    return NULL;
+
+  while (hi - lo > 1)
+    {
+      grub_uint32_t mid = lo + (hi - lo) / 2;
+
+      if (node->runs[mid].logical <= logical)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  if (logical - node->runs[lo].logical >= node->runs[lo].count)
+    return NULL;
+  return &node->runs[lo];
+}
+
+/* Read from a file whose cluster chain is mapped, a run at a time.  */
+static grub_ssize_t
+grub_fat_read_runs (grub_disk_t disk, grub_fshelp_node_t node,
+		    grub_disk_read_hook_t read_hook, void *read_hook_data,
+		    int blocklist, grub_off_t offset, grub_size_t len,
+		    char *buf)
+{
+  unsigned logical_cluster_bits = (node->data->cluster_bits
+				   + GRUB_DISK_SECTOR_BITS);
+  grub_uint32_t logical = offset >> logical_cluster_bits;
+  const struct grub_fat_run *run, *end = node->runs + node->nruns;
+  grub_ssize_t ret = 0;
+
+  offset &= (1ULL << logical_cluster_bits) - 1;
+
+  for (run = grub_fat_find_run (node, logical); run && run < end && len;
+       run++)
+    {
+      grub_uint32_t skip = logical - run->logical;
+      grub_disk_addr_t sector;
+      grub_uint64_t avail;
+      grub_size_t size;
+
+      sector = (node->data->cluster_sector
+		+ ((grub_disk_addr_t) (run->cluster + skip - 2)
+		   << node->data->cluster_bits));
+      avail = (((grub_uint64_t) (run->count - skip) << logical_cluster_bits)
+	       - offset);
+      size = avail < len ? avail : len;
+
+      disk->read_hook = read_hook;
+      disk->read_hook_data = read_hook_data;
+      grub_disk_read_ex (disk, sector, offset, size, buf, blocklist);
+      disk->read_hook = 0;
+      if (grub_errno)
+	return -1;
+
+      len -= size;
+      if (buf)
+	buf += size;
+      ret += size;
+      logical = run->logical + run->count;
+      offset = 0;
+    }
+
+  return ret;
+}
+
 static grub_ssize_t
 grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
 		    grub_disk_read_hook_t read_hook, void *read_hook_data, int blocklist,
@@ -497,6 +723,10 @@ grub_fat_read_data (grub_disk_t disk, grub_fshelp_node_t node,
     }
 #endif
 
+  if (node->runs)
+    return grub_fat_read_runs (disk, node, read_hook, read_hook_data,
+			       blocklist, offset, len, buf);
+
   /* Calculate the logical cluster number and offset.  */
   logical_cluster_bits = (node->data->cluster_bits
 			  + GRUB_DISK_SECTOR_BITS);
@@ -954,6 +1184,8 @@ static grub_err_t lookup_file (grub_fshelp_node_t node,
 	    (*foundnode)->file_cluster = node->data->root_cluster;
 #endif
 	  (*foundnode)->cur_cluster_num = ~0U;
+	  (*foundnode)->runs = NULL;
+	  (*foundnode)->nruns = 0;
 	  (*foundnode)->data = node->data;
 	  (*foundnode)->disk = node->disk;
 
@@ -1022,13 +1254,16 @@ grub_fat_dir (grub_device_t device, const char *path, grub_fs_dir_hook_t hook,
       info.mtimeset = grub_exfat_timestamp (grub_le_to_cpu32 (ctxt.entry.type_specific.file.m_time),
 					    ctxt.entry.type_specific.file.m_time_tenth,
 					    &info.mtime);
+      info.size = ctxt.dir.file_size;
 #else
       if (ctxt.dir.attr & GRUB_FAT_ATTR_VOLUME_ID)
 	continue;
       info.mtimeset = grub_fat_timestamp (grub_le_to_cpu16 (ctxt.dir.w_time),
 					  grub_le_to_cpu16 (ctxt.dir.w_date),
 					  &info.mtime);
+      info.size = grub_le_to_cpu32 (ctxt.dir.file_size);
 #endif
+      info.sizeset = ! info.dir;
       if (info.mtimeset == 0)
 	grub_error (GRUB_ERR_OUT_OF_RANGE,
 		    "invalid modification timestamp for %s", path);
@@ -1102,6 +1337,16 @@ grub_fat_open (grub_file_t file, const char *name)
 static grub_ssize_t
 grub_fat_read (grub_file_t file, char *buf, grub_size_t len)
 {
+  grub_fshelp_node_t node = file->data;
+
+  /* Seeks then find their cluster without walking the chain again.  */
+  if (! node->runs
+#ifdef MODE_EXFAT
+      && ! node->is_contiguous
+#endif
+      && grub_fat_map_runs (file->device->disk, node))
+    return -1;
+
   return grub_fat_read_data (file->device->disk, file->data,
 			     file->read_hook, file->read_hook_data, file->blocklist,
 			     file->offset, len, buf);
@@ -1112,6 +1357,7 @@ grub_fat_close (grub_file_t file)
 {
   grub_fshelp_node_t node = file->data;
 
+  grub_free (node->runs);
   grub_free (node->data);
   grub_free (node);
 
@@ -349,23 +349,40 @@ grub_fshelp_find_file_lookup (const char *path, grub_fshelp_node_t rootnode,
 
 }
 
-/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
-   beginning with the block POS.  READ_HOOK should be set before
-   reading a block from the file.  READ_HOOK_DATA is passed through as
-   the DATA argument to READ_HOOK.  GET_BLOCK is used to translate
-   file blocks to disk blocks.  The file is FILESIZE bytes big and the
-   blocks have a size of LOG2BLOCKSIZE (in log2).  */
-grub_ssize_t
-grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
-		       grub_disk_read_hook_t read_hook, void *read_hook_data, int blocklist,
-		       grub_off_t pos, grub_size_t len, char *buf,
-		       grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
-                                                      grub_disk_addr_t block),
-		       grub_off_t filesize, int log2blocksize,
-		       grub_disk_addr_t blocks_start)
+/* Translate the file block BLOCK with GET_EXTENT or, without it, with
+   GET_BLOCK a block at a time.  */
+static grub_disk_addr_t
+map_blocks (grub_fshelp_node_t node, grub_disk_addr_t block,
+	    grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+					   grub_disk_addr_t block),
+	    grub_fshelp_get_extent_t get_extent, grub_disk_addr_t *count)
+{
+  grub_disk_addr_t blknr;
+
+  *count = 1;
+  if (! get_extent)
+    return get_block (node, block);
+
+  blknr = get_extent (node, block, count);
+  if (*count == 0)
+    *count = 1;
+  return blknr;
+}
+
+static grub_ssize_t
+read_file_real (grub_disk_t disk, grub_fshelp_node_t node,
+		grub_disk_read_hook_t read_hook, void *read_hook_data,
+		int blocklist, grub_off_t pos, grub_size_t len, char *buf,
+		grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+					       grub_disk_addr_t block),
+		grub_fshelp_get_extent_t get_extent,
+		grub_off_t filesize, int log2blocksize,
+		grub_disk_addr_t blocks_start)
 {
   grub_disk_addr_t i, blockcnt;
-  int blocksize = 1 << (log2blocksize + GRUB_DISK_SECTOR_BITS);
+  grub_disk_addr_t next_blknr = 0, next_count = 0;
+  int log2bytes = log2blocksize + GRUB_DISK_SECTOR_BITS;
+  grub_off_t end;
 
   if (pos > filesize)
     {
@@ -378,39 +395,60 @@ grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
   if (pos + len > filesize)
     len = filesize - pos;
 
-  blockcnt = ((len + pos) + blocksize - 1) >> (log2blocksize + GRUB_DISK_SECTOR_BITS);
+  end = pos + len;
+  blockcnt = (end + (1 << log2bytes) - 1) >> log2bytes;
 
-  for (i = pos >> (log2blocksize + GRUB_DISK_SECTOR_BITS); i < blockcnt; i++)
+  for (i = pos >> log2bytes; i < blockcnt; )
     {
-      grub_disk_addr_t blknr;
-      int blockoff = pos & (blocksize - 1);
-      int blockend = blocksize;
-
-      int skipfirst = 0;
-
-      blknr = get_block (node, i);
-      if (grub_errno)
-	return -1;
-
-      blknr = blknr << log2blocksize;
+      grub_disk_addr_t blknr, count;
+      grub_off_t start, stop;
 
-      /* Last block.  */
-      if (i == blockcnt - 1)
+      if (next_count)
 	{
-	  blockend = (len + pos) & (blocksize - 1);
-
-	  /* The last portion is exactly blocksize.  */
-	  if (! blockend)
-	    blockend = blocksize;
+	  blknr = next_blknr;
+	  count = next_count;
+	  next_count = 0;
+	}
+      else
+	{
+	  blknr = map_blocks (node, i, get_block, get_extent, &count);
+	  if (grub_errno)
+	    return -1;
 	}
 
-      /* First block.  */
-      if (i == (pos >> (log2blocksize + GRUB_DISK_SECTOR_BITS)))
+      /* Extend the run for as long as the following blocks are contiguous
+	 on disk, so it takes a single read.  A block which breaks the run
+	 starts the next one.  */
+      while (i + count < blockcnt)
 	{
-	  skipfirst = blockoff;
-	  blockend -= skipfirst;
+	  grub_disk_addr_t nblknr, ncount;
+
+	  nblknr = map_blocks (node, i + count, get_block, get_extent,
+			       &ncount);
+	  if (grub_errno)
+	    return -1;
+
+	  if ((blknr == 0 && nblknr == 0)
+	      || (blknr != 0 && nblknr == blknr + count))
+	    count += ncount;
+	  else
+	    {
+	      next_blknr = nblknr;
+	      next_count = ncount;
+	      break;
+	    }
 	}
 
+      if (count > blockcnt - i)
+	count = blockcnt - i;
+
+      start = i << log2bytes;
+      if (start < pos)
+	start = pos;
+      stop = (i + count) << log2bytes;
+      if (stop > end)
+	stop = end;
+
       /* If the block number is 0 this block is not stored on disk but
 	 is zero filled instead.  */
       if (blknr)
@@ -418,21 +456,60 @@ grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
 	  disk->read_hook = read_hook;
 	  disk->read_hook_data = read_hook_data;
 
-	  grub_disk_read_ex (disk, blknr + blocks_start, skipfirst,
-			  blockend, buf, blocklist);
+	  grub_disk_read_ex (disk, (blknr << log2blocksize) + blocks_start,
+			     start - (i << log2bytes), stop - start, buf,
+			     blocklist);
 	  disk->read_hook = 0;
 	  if (grub_errno)
 	    return -1;
 	}
       else
-    {
-      if (buf)
-        grub_memset (buf, 0, blockend);
-    }
+	{
+	  if (buf)
+	    grub_memset (buf, 0, stop - start);
+	}
 
       if (buf)
-        buf += blocksize - skipfirst;
+	buf += stop - start;
+      i += count;
     }
 
   return len;
 }
+
+/* Read LEN bytes from the file NODE on disk DISK into the buffer BUF,
+   beginning with the block POS.  READ_HOOK should be set before
+   reading a block from the file.  READ_HOOK_DATA is passed through as
+   the DATA argument to READ_HOOK.  GET_BLOCK is used to translate
+   file blocks to disk blocks.  The file is FILESIZE bytes big and the
+   blocks have a size of LOG2BLOCKSIZE (in log2).  Blocks which follow
+   each other on disk are read at once.  */
+grub_ssize_t
+grub_fshelp_read_file (grub_disk_t disk, grub_fshelp_node_t node,
+		       grub_disk_read_hook_t read_hook, void *read_hook_data, int blocklist,
+		       grub_off_t pos, grub_size_t len, char *buf,
+		       grub_disk_addr_t (*get_block) (grub_fshelp_node_t node,
+                                                      grub_disk_addr_t block),
+		       grub_off_t filesize, int log2blocksize,
+		       grub_disk_addr_t blocks_start)
+{
+  return read_file_real (disk, node, read_hook, read_hook_data, blocklist,
+			 pos, len, buf, get_block, NULL, filesize,
+			 log2blocksize, blocks_start);
+}
+
+/* Like grub_fshelp_read_file, with GET_EXTENT translating file blocks to
+   whole runs of disk blocks.  */
+grub_ssize_t
+grub_fshelp_read_file_extents (grub_disk_t disk, grub_fshelp_node_t node,
+			       grub_disk_read_hook_t read_hook,
+			       void *read_hook_data, int blocklist,
+			       grub_off_t pos, grub_size_t len, char *buf,
+			       grub_fshelp_get_extent_t get_extent,
+			       grub_off_t filesize, int log2blocksize,
+			       grub_disk_addr_t blocks_start)
+{
+  return read_file_real (disk, node, read_hook, read_hook_data, blocklist,
+			 pos, len, buf, NULL, get_extent, filesize,
+			 log2blocksize, blocks_start);
+}
@@ -622,6 +622,9 @@ list_file (struct grub_ntfs_file *diro, grub_uint8_t *pos,
 	  fdiro->data = diro->data;
 	  fdiro->ino = u64at (pos, 0) & 0xffffffffffffULL;
 	  fdiro->mtime = u64at (pos, 0x20);
+	  /* Real size as recorded in the index; init_file replaces it
+	     with the $DATA size if the file is opened.  */
+	  fdiro->size = u64at (pos, 0x40);
 
 	  ustr = get_utf8 (np, ns);
 	  if (ustr == NULL)
@@ -1002,6 +1005,11 @@ grub_ntfs_dir_iter (const char *filename, enum grub_fshelp_filetype filetype,
   info.mtime = grub_divmod64 (node->mtime, 10000000, 0) 
     - 86400ULL * 365 * (1970 - 1601)
     - 86400ULL * ((1970 - 1601) / 4) + 86400ULL * ((1970 - 1601) / 100);
+  if ((filetype & GRUB_FSHELP_TYPE_MASK) == GRUB_FSHELP_REG)
+    {
+      info.sizeset = 1;
+      info.size = node->size;
+    }
   grub_free (node);
   return ctx->hook (filename, &info, ctx->hook_data);
 }
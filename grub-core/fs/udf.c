@@ -817,6 +817,11 @@ grub_udf_dir_iter (const char *filename, enum grub_fshelp_filetype filetype,
 
       info.mtime -= 60 * tz;
     }
+  if ((filetype & GRUB_FSHELP_TYPE_MASK) == GRUB_FSHELP_REG && tstamp)
+    {
+      info.sizeset = 1;
+      info.size = U64 (node->block.fe.file_size);
+    }
   grub_free (node);
   return ctx->hook (filename, &info, ctx->hook_data);
 }
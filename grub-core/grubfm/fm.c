@@ -424,4 +424,5 @@ GRUB_MOD_FINI(grubfm)
   grub_unregister_extcmd (cmd_cat);
   grub_unregister_extcmd (cmd_nt);
   grub_unregister_extcmd (cmd_html);
+  grubfm_dir_cache_flush ();
 }
@@ -28,6 +28,15 @@
 
 #include <ini.h>
 
+struct grubfm_arena_block;
+
+/* Strings allocated in blocks and freed together.  */
+struct grubfm_arena
+{
+  struct grubfm_arena_block *head;
+  grub_size_t size; /* bytes allocated */
+};
+
 struct grubfm_ini_enum_list
 {
   int n;
@@ -37,6 +46,11 @@ struct grubfm_ini_enum_list
   int *display;
   char **condition;
   ini_t **config;
+  int max;
+  struct grubfm_arena arena;
+  /* open addressing, slots hold index + 1 */
+  int *hash;
+  int hash_size;
 };
 
 struct grubfm_enum_file_info
@@ -46,6 +60,9 @@ struct grubfm_enum_file_info
   int display;
   char *condition;
   int ext; /* index */
+  const char *icon;
+  char *title;
+  char *key; /* sort key */
 };
 
 struct grubfm_enum_file_list
@@ -55,8 +72,9 @@ struct grubfm_enum_file_list
   int ndirs;
   struct grubfm_enum_file_info *dir_list;
   char *dirname;
-  int f;
-  int d;
+  int maxfiles;
+  int maxdirs;
+  struct grubfm_arena arena;
 };
 
 extern char grubfm_root[];
@@ -108,12 +126,20 @@ void
 grubfm_gfx_printf (grub_video_color_t color, int x, int y, const char *fmt, ...);
 void
 grubfm_gfx_clear (void);
+char *
+grubfm_arena_strdup (struct grubfm_arena *arena, const char *str);
+void
+grubfm_arena_free (struct grubfm_arena *arena);
+int
+grubfm_array_reserve (void **array, int *max, int n, grub_size_t elsize);
 /* list.c */
 int
 grubfm_enum_device (void);
 int
 grubfm_enum_file (char *dirname);
 void
+grubfm_dir_cache_flush (void);
+void
 grubfm_html_menu (char *buf, const char *prefix);
 
 /* type.c */
@@ -272,3 +272,79 @@ grubfm_gfx_clear (void)
     return;
   grubfm_draw_rect (black, 0, 0, w, h);
 }
+
+#define GRUBFM_ARENA_BLOCK_SIZE 4096
+
+struct grubfm_arena_block
+{
+  struct grubfm_arena_block *next;
+  grub_size_t used;
+  grub_size_t size;
+  char data[0];
+};
+
+/* Copy STR into ARENA.  The copy lives until grubfm_arena_free.  */
+char *
+grubfm_arena_strdup (struct grubfm_arena *arena, const char *str)
+{
+  struct grubfm_arena_block *block = arena->head;
+  grub_size_t len = grub_strlen (str) + 1;
+  char *ret;
+
+  if (!block || block->size - block->used < len)
+  {
+    grub_size_t size = GRUBFM_ARENA_BLOCK_SIZE;
+    if (len > size)
+      size = len;
+    block = grub_malloc (sizeof (*block) + size);
+    if (!block)
+      return NULL;
+    block->used = 0;
+    block->size = size;
+    block->next = arena->head;
+    arena->head = block;
+    arena->size += sizeof (*block) + size;
+  }
+  ret = block->data + block->used;
+  grub_memcpy (ret, str, len);
+  block->used += len;
+  return ret;
+}
+
+void
+grubfm_arena_free (struct grubfm_arena *arena)
+{
+  struct grubfm_arena_block *block, *next;
+  for (block = arena->head; block; block = next)
+  {
+    next = block->next;
+    grub_free (block);
+  }
+  arena->head = NULL;
+  arena->size = 0;
+}
+
+/* Make room for element N in the growable array *ARRAY of *MAX
+   elements of ELSIZE bytes, doubling it as required.  New elements
+   are zeroed.  */
+int
+grubfm_array_reserve (void **array, int *max, int n, grub_size_t elsize)
+{
+  int newmax;
+  void *p;
+
+  if (n < *max)
+    return 0;
+  if (*max > GRUB_INT_MAX / 2)
+    return 1;
+  newmax = *max ? *max * 2 : 64;
+  if (newmax <= n || (grub_size_t) newmax > GRUB_SIZE_MAX / elsize)
+    return 1;
+  p = grub_realloc (*array, newmax * elsize);
+  if (!p)
+    return 1;
+  grub_memset ((char *) p + *max * elsize, 0, (newmax - *max) * elsize);
+  *array = p;
+  *max = newmax;
+  return 0;
+}
@@ -24,6 +24,8 @@
 #include <grub/extcmd.h>
 #include <grub/i18n.h>
 #include <grub/device.h>
+#include <grub/disk.h>
+#include <grub/partition.h>
 #include <grub/file.h>
 #include <grub/fs.h>
 #include <grub/normal.h>
@@ -57,14 +59,11 @@ grubfm_add_menu_parent (const char *dirname)
 }
 
 static void
-grubfm_add_menu_dir (const char *filename, char *pathname)
+grubfm_add_menu_dir (struct grubfm_enum_file_info *dir, char *pathname)
 {
-  char *title = NULL;
-  title = grub_xasprintf ("%-10s [%s]", _("DIR"), filename);
   char *src = NULL;
   src = grub_xasprintf ("grubfm \"%s/\"", pathname);
-  grubfm_add_menu (title, "dir", NULL, src, 0);
-  grub_free (title);
+  grubfm_add_menu (dir->title, "dir", NULL, src, 0);
   grub_free (src);
 }
 
@@ -87,50 +86,76 @@ grubfm_file_condition_check (const char *condition, const char *pathname)
 static void
 grubfm_add_menu_file (struct grubfm_enum_file_info *file, char *pathname)
 {
-  char *title = NULL;
-  title = grub_xasprintf ("%-10s %s", file->size, file->name);
   char *src = NULL;
   src = grub_xasprintf ("grubfm_open \"%s\"", pathname);
-  const char *icon = NULL;
-  icon = grubfm_get_file_icon (file, &grubfm_usr_table);
-  if (file->ext < 0)
-    icon = grubfm_get_file_icon (file, &grubfm_ext_table);
   if (!grubfm_hide || file->display
       || grubfm_file_condition_check (file->condition, pathname))
-    grubfm_add_menu (title, icon, NULL, src, 0);
-  grub_free (title);
+    grubfm_add_menu (file->title, file->icon, NULL, src, 0);
   grub_free (src);
 }
 
 static void
 grubfm_enum_file_list_close (struct grubfm_enum_file_list *ctx)
 {
-  int i;
-  if (!ctx->dir_list)
-    goto free_f;
-  for (i = 0; i < ctx->ndirs; i++)
-  {
-    if (ctx->dir_list[i].name)
-      grub_free (ctx->dir_list[i].name);
-  }
   grub_free (ctx->dir_list);
-free_f:
-  if (!ctx->file_list)
-    return;
-  for (i = 0; i < ctx->nfiles; i++)
+  grub_free (ctx->file_list);
+  grubfm_arena_free (&ctx->arena);
+}
+
+static void
+grubfm_add_menu_device (const char *name, grub_device_t dev, grub_fs_t fs)
+{
+  char *label = NULL;
+  char *label_real = NULL;
+  const char *human_size = NULL;
+  const char *icon = "hdd";
+  char *title = NULL;
+  char *src = NULL;
+
+  if (fs && fs->fs_label)
   {
-    if (ctx->file_list[i].name)
-      grub_free (ctx->file_list[i].name);
-    if (ctx->file_list[i].size)
-    grub_free (ctx->file_list[i].size);
+    int err;
+    err = fs->fs_label (dev, &label);
+    if (err)
+    {
+      grub_errno = 0;
+      label = NULL;
+    }
   }
-  grub_free (ctx->file_list);
+  if (label && grub_strlen(label))
+    label_real = grub_xasprintf ("[%s] ", label);
+
+  if (dev->disk)
+    human_size = grub_get_human_size (grub_disk_get_size (dev->disk)
+          << GRUB_DISK_SECTOR_BITS, GRUB_HUMAN_SIZE_SHORT);
+  if (fs)
+    title = grub_xasprintf ("(%s) %s%s %s", name,
+              label_real? label_real : "",
+              fs->name, human_size? human_size : "");
+  else
+    title = grub_xasprintf ("(%s) %s", name, human_size? human_size : "");
+  src = grub_xasprintf ("grubfm \"(%s)/\"", name);
+  if (fs && (grub_strcmp (fs->name, "iso9660") == 0 ||
+             grub_strcmp (fs->name, "udf") == 0))
+    icon = "iso";
+  else if (!fs && grub_strncmp (name, "cd", 2) == 0)
+    icon = "iso";
+  grubfm_add_menu (title, icon, NULL, src, 0);
+  grub_free (title);
+  grub_free (src);
+  if (label)
+    grub_free (label);
+  if (label_real)
+    grub_free (label_real);
 }
 
+/* With grubfm_lazy_probe=1, devices that haven't been probed yet are
+   listed by name and size only.  Opening one probes it, and the result
+   is cached, so the next device listing shows its type and label.  */
 static int
-grubfm_enum_device_iter (const char *name,
-                         void *data __attribute__ ((unused)))
+grubfm_enum_device_iter (const char *name, void *data)
 {
+  int *lazy = data;
   if (grub_strcmp (name, "memdisk") == 0 ||
       grub_strcmp (name, "proc") == 0 ||
       grub_strcmp (name, "python") == 0)
@@ -142,48 +167,21 @@ grubfm_enum_device_iter (const char *name,
   {
     grub_fs_t fs;
 
-    fs = grub_fs_probe (dev);
-    if (fs)
+    if (grub_fs_probe_cached (dev, &fs))
     {
-      char *label = NULL;
-      char *label_real = NULL;
-      const char *human_size = NULL;
-      if (fs->fs_label)
-      {
-        int err;
-        err = fs->fs_label (dev, &label);
-        if (err)
-        {
-          grub_errno = 0;
-          label = NULL;
-        }
-      }
-      if (label && grub_strlen(label))
-        label_real = grub_xasprintf ("[%s] ", label);
-
-      if (dev->disk)
-        human_size = grub_get_human_size (grub_disk_get_size (dev->disk)
-              << GRUB_DISK_SECTOR_BITS, GRUB_HUMAN_SIZE_SHORT);
-      char *title = NULL;
-      title = grub_xasprintf ("(%s) %s%s %s", name,
-                label_real? label_real : "",
-                fs->name, human_size? human_size : "");
-      char *src = NULL;
-      src = grub_xasprintf ("grubfm \"(%s)/\"", name);
-      if (grub_strcmp (fs->name, "iso9660") == 0 ||
-          grub_strcmp (fs->name, "udf") == 0)
-        grubfm_add_menu (title, "iso", NULL, src, 0);
-      else
-        grubfm_add_menu (title, "hdd", NULL, src, 0);
-      grub_free (title);
-      grub_free (src);
-      if (label)
-        grub_free (label);
-      if (label_real)
-        grub_free (label_real);
+      if (fs)
+        grubfm_add_menu_device (name, dev, fs);
     }
+    else if (*lazy && dev->disk)
+      grubfm_add_menu_device (name, dev, NULL);
     else
-      grub_errno = 0;
+    {
+      fs = grub_fs_probe (dev);
+      if (fs)
+        grubfm_add_menu_device (name, dev, fs);
+      else
+        grub_errno = 0;
+    }
     grub_device_close (dev);
   }
   else
@@ -195,29 +193,57 @@ grubfm_enum_device_iter (const char *name,
 int
 grubfm_enum_device (void)
 {
-  grub_device_iterate (grubfm_enum_device_iter, NULL);
+  const char *lazy_probe = NULL;
+  int lazy;
+  lazy_probe = grub_env_get ("grubfm_lazy_probe");
+  lazy = (lazy_probe && lazy_probe[0] == '1');
+  grub_device_iterate (grubfm_enum_device_iter, &lazy);
   return 0;
 }
 
 #define SYS_VOL_INFO_DIR "System Volume Information"
 
-static int
-grubfm_enum_file_count (const char *filename,
-                        const struct grub_dirhook_info *info,
-                        void *data)
+/* Append an entry named FILENAME to the growable array *LIST.  */
+static struct grubfm_enum_file_info *
+grubfm_enum_file_add (struct grubfm_enum_file_info **list, int *n, int *max,
+                      struct grubfm_arena *arena, const char *filename)
 {
-  struct grubfm_enum_file_list *ctx = data;
+  void *p = *list;
+  struct grubfm_enum_file_info *info;
 
-  if (grub_strcmp (filename, ".") == 0 ||
-      grub_strcmp (filename, "..") == 0 ||
-      filename[0] == '$' ||
-      grub_strcmp (filename, SYS_VOL_INFO_DIR) == 0)
-    return 0;
+  if (grubfm_array_reserve (&p, max, *n, sizeof (**list)))
+    return NULL;
+  *list = p;
+  info = &(*list)[*n];
+  info->name = grubfm_arena_strdup (arena, filename);
+  if (!info->name)
+    return NULL;
+  (*n)++;
+  return info;
+}
 
-  if (info->dir)
-    ctx->ndirs++;
-  else
-    ctx->nfiles++;
+/* Sort keys are computed once per listing, so that comparisons neither
+   look up the collation mode nor fold case.  */
+static int
+grubfm_enum_file_keys (struct grubfm_enum_file_info *list, int n,
+                       struct grubfm_arena *arena, int fold)
+{
+  char *p;
+  int i;
+
+  for (i = 0; i < n; i++)
+  {
+    if (!fold)
+    {
+      list[i].key = list[i].name;
+      continue;
+    }
+    list[i].key = grubfm_arena_strdup (arena, list[i].name);
+    if (!list[i].key)
+      return 1;
+    for (p = list[i].key; *p; p++)
+      *p = grub_tolower (*p);
+  }
   return 0;
 }
 
@@ -227,12 +253,12 @@ list_compare (const void *f1,
 {
   const struct grubfm_enum_file_info *d1 = f1;
   const struct grubfm_enum_file_info *d2 = f2;
-  const char *case_sensitive = NULL;
-  case_sensitive = grub_env_get ("grub_fs_case_sensitive");
-  if (! case_sensitive || case_sensitive[0] != '1')
-    return (grub_strcasecmp(d1->name, d2->name));
-  else
-    return (grub_strcmp(d1->name, d2->name));
+  int r;
+
+  r = natural_compare (d1->key, d2->key);
+  if (r == 0)
+    r = grub_strcmp (d1->name, d2->name);
+  return r;
 }
 
 static int
@@ -247,47 +273,281 @@ grubfm_enum_file_iter (const char *filename,
       filename[0] == '$' ||
       grub_strcmp (filename, SYS_VOL_INFO_DIR) == 0)
     return 0;
+  struct grubfm_enum_file_info *entry;
+  grub_uint64_t size;
   char *pathname;
+  grub_file_t file = 0;
 
-  if (dirname[grub_strlen (dirname) - 1] == '/')
-    pathname = grub_xasprintf ("%s%s", dirname, filename);
-  else
-    pathname = grub_xasprintf ("%s/%s", dirname, filename);
-  if (!pathname)
-    return 1;
   if (info->dir)
-  {
-    ctx->dir_list[ctx->d].name = grub_strdup(filename);
-    ctx->d++;
-  }
+    return grubfm_enum_file_add (&ctx->dir_list, &ctx->ndirs, &ctx->maxdirs,
+                                 &ctx->arena, filename) ? 0 : 1;
+
+  if (info->sizeset)
+    size = info->size;
   else
   {
-    grub_file_t file = 0;
+    /* The filesystem did not report the size, so open the file.  */
+    if (dirname[grub_strlen (dirname) - 1] == '/')
+      pathname = grub_xasprintf ("%s%s", dirname, filename);
+    else
+      pathname = grub_xasprintf ("%s/%s", dirname, filename);
+    if (!pathname)
+      return 1;
     file = grub_file_open (pathname, GRUB_FILE_TYPE_GET_SIZE |
                            GRUB_FILE_TYPE_NO_DECOMPRESS);
+    grub_free (pathname);
     if (! file)
     {
       grub_errno = 0;
-      grub_free (pathname);
       return 0;
     }
-    ctx->file_list[ctx->f].name = grub_strdup (filename);
-    ctx->file_list[ctx->f].size = grub_strdup (
-        grub_get_human_size (file->size, GRUB_HUMAN_SIZE_SHORT));
+    size = file->size;
     grub_file_close (file);
-    ctx->f++;
   }
-  grub_free (pathname);
+
+  entry = grubfm_enum_file_add (&ctx->file_list, &ctx->nfiles, &ctx->maxfiles,
+                                &ctx->arena, filename);
+  if (!entry)
+    return 1;
+  entry->size = grubfm_arena_strdup (&ctx->arena,
+                    grub_get_human_size (size, GRUB_HUMAN_SIZE_SHORT));
+  if (!entry->size)
+    return 1;
+  return 0;
+}
+
+/* Work out the menu title and icon of each entry, once per listing.  */
+static int
+grubfm_enum_file_annotate (struct grubfm_enum_file_list *ctx)
+{
+  char *title;
+  int i;
+
+  for (i = 0; i < ctx->ndirs; i++)
+  {
+    title = grub_xasprintf ("%-10s [%s]", _("DIR"), ctx->dir_list[i].name);
+    if (!title)
+      return 1;
+    ctx->dir_list[i].title = grubfm_arena_strdup (&ctx->arena, title);
+    grub_free (title);
+    if (!ctx->dir_list[i].title)
+      return 1;
+  }
+  for (i = 0; i < ctx->nfiles; i++)
+  {
+    struct grubfm_enum_file_info *file = &ctx->file_list[i];
+    title = grub_xasprintf ("%-10s %s", file->size, file->name);
+    if (!title)
+      return 1;
+    file->title = grubfm_arena_strdup (&ctx->arena, title);
+    grub_free (title);
+    if (!file->title)
+      return 1;
+    file->icon = grubfm_get_file_icon (file, &grubfm_usr_table);
+    if (file->ext < 0)
+      file->icon = grubfm_get_file_icon (file, &grubfm_ext_table);
+  }
   return 0;
 }
 
+/* Listings of recently visited directories, most recent first.  A
+   listing is only reused for the same path on the same disk, partition
+   and size, sorted the same way.  Any disk write or replaced device
+   discards them all, since it may have changed any of them.  */
+#define GRUBFM_DIR_CACHE_MAX_MEM (1 << 20)
+
+struct grubfm_dir_cache_key
+{
+  unsigned long dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t start;
+  grub_disk_addr_t total_sectors;
+  int sort;
+};
+
+struct grubfm_dir_cache
+{
+  struct grubfm_dir_cache *next;
+  char *dirname;
+  struct grubfm_dir_cache_key key;
+  grub_size_t mem;
+  struct grubfm_enum_file_list list;
+};
+
+static struct grubfm_dir_cache *grubfm_dir_cache;
+static grub_size_t grubfm_dir_cache_mem;
+static unsigned long grubfm_dir_cache_write_count;
+static unsigned long grubfm_dir_cache_change_count;
+
+static void
+grubfm_dir_cache_free (struct grubfm_dir_cache *entry)
+{
+  grubfm_dir_cache_mem -= entry->mem;
+  grubfm_enum_file_list_close (&entry->list);
+  grub_free (entry->dirname);
+  grub_free (entry);
+}
+
+void
+grubfm_dir_cache_flush (void)
+{
+  struct grubfm_dir_cache *entry, *next;
+  for (entry = grubfm_dir_cache; entry; entry = next)
+  {
+    next = entry->next;
+    grubfm_dir_cache_free (entry);
+  }
+  grubfm_dir_cache = NULL;
+}
+
+/* How listings are sorted: 0 not at all, 1 ignoring case, 2 by case.  */
+static int
+grubfm_enum_file_sort_mode (void)
+{
+  const char *env;
+
+  env = grub_env_get ("grubfm_disable_qsort");
+  if (env && env[0] == '1')
+    return 0;
+  env = grub_env_get ("grub_fs_case_sensitive");
+  return (env && env[0] == '1') ? 2 : 1;
+}
+
+static void
+grubfm_dir_cache_key_init (struct grubfm_dir_cache_key *key,
+                           grub_device_t dev)
+{
+  grub_memset (key, 0, sizeof (*key));
+  if (dev->disk)
+  {
+    key->dev_id = dev->disk->dev->id;
+    key->disk_id = dev->disk->id;
+    key->start = grub_partition_get_start (dev->disk->partition);
+    key->total_sectors = dev->disk->total_sectors;
+  }
+  key->sort = grubfm_enum_file_sort_mode ();
+}
+
+static struct grubfm_enum_file_list *
+grubfm_dir_cache_find (const char *dirname,
+                       const struct grubfm_dir_cache_key *key)
+{
+  struct grubfm_dir_cache **prev, *entry;
+
+  if (grubfm_dir_cache_write_count != grub_disk_write_count
+      || grubfm_dir_cache_change_count != grub_disk_change_count)
+  {
+    grubfm_dir_cache_flush ();
+    grubfm_dir_cache_write_count = grub_disk_write_count;
+    grubfm_dir_cache_change_count = grub_disk_change_count;
+    return NULL;
+  }
+  for (prev = &grubfm_dir_cache; (entry = *prev); prev = &entry->next)
+  {
+    if (entry->key.dev_id != key->dev_id
+        || entry->key.disk_id != key->disk_id
+        || entry->key.start != key->start
+        || entry->key.total_sectors != key->total_sectors
+        || entry->key.sort != key->sort
+        || grub_strcmp (entry->dirname, dirname) != 0)
+      continue;
+    *prev = entry->next;
+    entry->next = grubfm_dir_cache;
+    grubfm_dir_cache = entry;
+    return &entry->list;
+  }
+  return NULL;
+}
+
+/* Move the listing CTX into the cache, evicting the least recently
+   used listings to stay within the memory bound.  Returns the cached
+   listing, or NULL if CTX was not cached and still belongs to the
+   caller.  */
+static struct grubfm_enum_file_list *
+grubfm_dir_cache_insert (const char *dirname,
+                         const struct grubfm_dir_cache_key *key,
+                         struct grubfm_enum_file_list *ctx)
+{
+  struct grubfm_dir_cache *entry, **prev;
+  grub_size_t mem;
+
+  mem = sizeof (*entry) + grub_strlen (dirname) + 1 + ctx->arena.size
+        + (ctx->maxdirs + ctx->maxfiles) * sizeof (ctx->file_list[0]);
+  if (mem > GRUBFM_DIR_CACHE_MAX_MEM)
+    return NULL;
+  entry = grub_malloc (sizeof (*entry));
+  if (!entry)
+    goto fail;
+  entry->dirname = grub_strdup (dirname);
+  if (!entry->dirname)
+  {
+    grub_free (entry);
+    goto fail;
+  }
+  entry->key = *key;
+  entry->mem = mem;
+  entry->list = *ctx;
+  entry->list.dirname = entry->dirname;
+  entry->next = grubfm_dir_cache;
+  grubfm_dir_cache = entry;
+  grubfm_dir_cache_mem += mem;
+
+  while (grubfm_dir_cache_mem > GRUBFM_DIR_CACHE_MAX_MEM)
+  {
+    for (prev = &grubfm_dir_cache; (*prev)->next; prev = &(*prev)->next)
+      ;
+    entry = *prev;
+    *prev = NULL;
+    grubfm_dir_cache_free (entry);
+  }
+  return &grubfm_dir_cache->list;
+
+ fail:
+  grub_errno = GRUB_ERR_NONE;
+  return NULL;
+}
+
+static void
+grubfm_enum_file_render (struct grubfm_enum_file_list *ctx,
+                         const char *dirname)
+{
+  int i;
+
+  for (i = 0; i < ctx->ndirs; i++)
+  {
+    char *pathname;
+    if (dirname[grub_strlen (dirname) - 1] == '/')
+      pathname = grub_xasprintf ("%s%s", dirname, ctx->dir_list[i].name);
+    else
+      pathname = grub_xasprintf ("%s/%s", dirname, ctx->dir_list[i].name);
+    if (!pathname)
+      return;
+    grubfm_add_menu_dir (&ctx->dir_list[i], pathname);
+    grub_free (pathname);
+  }
+  for (i = 0; i < ctx->nfiles; i++)
+  {
+    char *pathname;
+    if (dirname[grub_strlen (dirname) - 1] == '/')
+      pathname = grub_xasprintf ("%s%s", dirname, ctx->file_list[i].name);
+    else
+      pathname = grub_xasprintf ("%s/%s", dirname, ctx->file_list[i].name);
+    if (!pathname)
+      return;
+    grubfm_add_menu_file (&ctx->file_list[i], pathname);
+    grub_free (pathname);
+  }
+}
+
 int
 grubfm_enum_file (char *dirname)
 {
   char *device_name;
   grub_fs_t fs;
   const char *path;
-  grub_device_t dev;
+  grub_device_t dev = NULL;
+  struct grubfm_enum_file_list *cached;
+  struct grubfm_dir_cache_key key;
 
   grubfm_add_menu_parent (dirname);
 
@@ -296,6 +556,14 @@ grubfm_enum_file (char *dirname)
   if (!dev)
     goto fail;
 
+  grubfm_dir_cache_key_init (&key, dev);
+  cached = grubfm_dir_cache_find (dirname, &key);
+  if (cached)
+  {
+    grubfm_enum_file_render (cached, dirname);
+    goto fail;
+  }
+
   fs = grub_fs_probe (dev);
   path = grub_strchr (dirname, ')');
   if (!path)
@@ -317,55 +585,42 @@ grubfm_enum_file (char *dirname)
   }
   else if (fs)
   {
-    const char *disable_qsort = NULL;
-    disable_qsort = grub_env_get ("grubfm_disable_qsort");
-    struct grubfm_enum_file_list ctx = { 0, NULL, 0, NULL, NULL , 0, 0};
+    struct grubfm_enum_file_list ctx;
+    grub_memset (&ctx, 0, sizeof (ctx));
     ctx.dirname = dirname;
-    (fs->fs_dir) (dev, path, grubfm_enum_file_count, &ctx);
-    ctx.file_list = grub_zalloc (ctx.nfiles * sizeof (ctx.file_list[0]));
-    if (!ctx.file_list)
-      return 0;
-    ctx.dir_list = grub_zalloc (ctx.ndirs * sizeof (ctx.dir_list[0]));
-    if (!ctx.dir_list)
-      return 0;
     (fs->fs_dir) (dev, path, grubfm_enum_file_iter, &ctx);
-    ctx.ndirs = ctx.d;
-    ctx.nfiles = ctx.f;
-    if (!disable_qsort || disable_qsort[0] != '1')
-      perform_quick_sort (ctx.dir_list, ctx.ndirs,
-                          sizeof(struct grubfm_enum_file_info), list_compare);
-    for (ctx.d = 0; ctx.d < ctx.ndirs; ctx.d++)
+    if (key.sort)
     {
-      char *pathname;
-      if (dirname[grub_strlen (dirname) - 1] == '/')
-        pathname = grub_xasprintf ("%s%s", dirname,
-                                   ctx.dir_list[ctx.d].name);
+      int fold = (key.sort == 1);
+      if (grubfm_enum_file_keys (ctx.dir_list, ctx.ndirs, &ctx.arena, fold)
+          || grubfm_enum_file_keys (ctx.file_list, ctx.nfiles,
+                                    &ctx.arena, fold))
+        grub_errno = GRUB_ERR_NONE;
       else
-        pathname = grub_xasprintf ("%s/%s", dirname,
-                                   ctx.dir_list[ctx.d].name);
-      if (!pathname)
-        return 1;
-      grubfm_add_menu_dir (ctx.dir_list[ctx.d].name, pathname);
-      grub_free (pathname);
+      {
+        perform_merge_sort (ctx.dir_list, ctx.ndirs,
+                            sizeof(struct grubfm_enum_file_info),
+                            list_compare);
+        perform_merge_sort (ctx.file_list, ctx.nfiles,
+                            sizeof(struct grubfm_enum_file_info),
+                            list_compare);
+      }
     }
-    if (!disable_qsort || disable_qsort[0] != '1')
-      perform_quick_sort (ctx.file_list, ctx.nfiles,
-                          sizeof(struct grubfm_enum_file_info), list_compare);
-    for (ctx.f = 0; ctx.f < ctx.nfiles; ctx.f++)
+    /* A listing that was cut short is shown but not cached.  */
+    if (grubfm_enum_file_annotate (&ctx) != 0)
     {
-      char *pathname;
-      if (dirname[grub_strlen (dirname) - 1] == '/')
-        pathname = grub_xasprintf ("%s%s", dirname,
-                                   ctx.file_list[ctx.f].name);
-      else
-        pathname = grub_xasprintf ("%s/%s", dirname,
-                                   ctx.file_list[ctx.f].name);
-      if (!pathname)
-        return 1;
-      grubfm_add_menu_file (&ctx.file_list[ctx.f], pathname);
-      grub_free (pathname);
+      grub_errno = GRUB_ERR_NONE;
+      grubfm_enum_file_list_close (&ctx);
+    }
+    else if (grub_errno == GRUB_ERR_NONE
+             && (cached = grubfm_dir_cache_insert (dirname, &key, &ctx)))
+      grubfm_enum_file_render (cached, dirname);
+    else
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grubfm_enum_file_render (&ctx, dirname);
+      grubfm_enum_file_list_close (&ctx);
     }
-    grubfm_enum_file_list_close (&ctx);
   }
 
  fail:
@@ -419,7 +674,7 @@ grubfm_html_menu (char *buf, const char *prefix)
       char *src = NULL;
       src = grub_xasprintf ("grubfm_open \"%s%s\"", prefix, name);
       const char *icon = NULL;
-      struct grubfm_enum_file_info file = { NULL, NULL, 0, NULL, -1 };
+      struct grubfm_enum_file_info file = { NULL, NULL, 0, NULL, -1, NULL, NULL, NULL };
       file.name = name;
       icon = grubfm_get_file_icon (&file, &grubfm_usr_table);
       if (grub_strcmp (icon, "file") == 0)
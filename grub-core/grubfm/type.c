@@ -28,38 +28,92 @@
 
 #include "fm.h"
 
-struct grubfm_ini_enum_list grubfm_ext_table = {0, 0, NULL, NULL, NULL, NULL, NULL};
-struct grubfm_ini_enum_list grubfm_usr_table = {0, 0, NULL, NULL, NULL, NULL, NULL};
+struct grubfm_ini_enum_list grubfm_ext_table = {0, 0, NULL, NULL, NULL, NULL, NULL, 0, {NULL, 0}, NULL, 0};
+struct grubfm_ini_enum_list grubfm_usr_table = {0, 0, NULL, NULL, NULL, NULL, NULL, 0, {NULL, 0}, NULL, 0};
 
 static int
-grubfm_ini_enum_count (const char *filename __attribute__ ((unused)),
-                       const struct grub_dirhook_info *info,
-                       void *data)
+grubfm_ini_enum_iter (const char *filename,
+                      const struct grub_dirhook_info *info,
+                      void *data)
 {
   struct grubfm_ini_enum_list *ctx = data;
+  void *p = ctx->ext;
 
-  if (!info->dir)
-    ctx->n++;
+  if (info->dir)
+    return 0;
+  if (grubfm_array_reserve (&p, &ctx->max, ctx->n, sizeof (ctx->ext[0])))
+    return 1;
+  ctx->ext = p;
+  ctx->ext[ctx->n] = grubfm_arena_strdup (&ctx->arena, filename);
+  if (!ctx->ext[ctx->n])
+    return 1;
+  ctx->n++;
   return 0;
 }
 
+static grub_uint32_t
+grubfm_ext_hash (const char *ext)
+{
+  grub_uint32_t h = 2166136261U;
+  for (; *ext; ext++)
+  {
+    h ^= (grub_uint8_t) grub_tolower (*ext);
+    h *= 16777619U;
+  }
+  return h;
+}
+
+static void
+grubfm_ext_hash_build (struct grubfm_ini_enum_list *ctx)
+{
+  int size = 16;
+  int i, j;
+
+  while (size < 2 * ctx->n)
+    size <<= 1;
+  ctx->hash = grub_zalloc (size * sizeof (ctx->hash[0]));
+  if (!ctx->hash)
+  {
+    grub_errno = GRUB_ERR_NONE;
+    return;
+  }
+  ctx->hash_size = size;
+  for (i = 0; i < ctx->n; i++)
+  {
+    j = grubfm_ext_hash (ctx->ext[i]) & (size - 1);
+    while (ctx->hash[j])
+    {
+      /* keep the first of duplicate names, like the old linear scan */
+      if (grub_strcasecmp (ctx->ext[ctx->hash[j] - 1], ctx->ext[i]) == 0)
+        break;
+      j = (j + 1) & (size - 1);
+    }
+    if (!ctx->hash[j])
+      ctx->hash[j] = i + 1;
+  }
+}
+
 static int
-grubfm_ini_enum_iter (const char *filename,
-                      const struct grub_dirhook_info *info,
-                      void *data)
+grubfm_ext_lookup (struct grubfm_ini_enum_list *ctx, const char *ext)
 {
-  struct grubfm_ini_enum_list *ctx = data;
-  char *pathname;
-  pathname = grub_xasprintf ("%stypes/%s", grubfm_data_path, filename);
-  if (!pathname)
-    return 1;
-  if (! info->dir)
+  int i, j;
+
+  if (!ctx->hash)
   {
-    ctx->ext[ctx->i] = grub_strdup (filename);
-    ctx->i++;
+    for (i = 0; i < ctx->n; i++)
+      if (grub_strcasecmp (ext, ctx->ext[i]) == 0)
+        return i;
+    return -1;
   }
-  grub_free (pathname);
-  return 0;
+  j = grubfm_ext_hash (ext) & (ctx->hash_size - 1);
+  while (ctx->hash[j])
+  {
+    i = ctx->hash[j] - 1;
+    if (grub_strcasecmp (ext, ctx->ext[i]) == 0)
+      return i;
+    j = (j + 1) & (ctx->hash_size - 1);
+  }
+  return -1;
 }
 
 ini_t *
@@ -82,13 +136,13 @@ grubfm_ini_enum (const char *devname, struct grubfm_ini_enum_list *ctx)
 
   if (fs)
   {
-    (fs->fs_dir) (dev, path, grubfm_ini_enum_count, ctx);
-    ctx->ext = grub_zalloc (ctx->n * sizeof (ctx->ext[0]));
-    ctx->display = grub_zalloc (ctx->n * sizeof (ctx->display[0]));
-    ctx->icon = grub_zalloc (ctx->n * sizeof (ctx->icon[0]));
-    ctx->condition = grub_zalloc (ctx->n * sizeof (ctx->condition[0]));
-    ctx->config = grub_zalloc (ctx->n * sizeof (ctx->config[0]));
     (fs->fs_dir) (dev, path, grubfm_ini_enum_iter, ctx);
+    ctx->display = grub_zalloc (ctx->max * sizeof (ctx->display[0]));
+    ctx->icon = grub_zalloc (ctx->max * sizeof (ctx->icon[0]));
+    ctx->condition = grub_zalloc (ctx->max * sizeof (ctx->condition[0]));
+    ctx->config = grub_zalloc (ctx->max * sizeof (ctx->config[0]));
+    if (!ctx->display || !ctx->icon || !ctx->condition || !ctx->config)
+      ctx->n = 0;
     for (ctx->i = 0; ctx->i < ctx->n; ctx->i++)
     {
       char *ini_name = NULL;
@@ -110,6 +164,7 @@ grubfm_ini_enum (const char *devname, struct grubfm_ini_enum_list *ctx)
                                     devname, grubfm_data_path, condition);
       ctx->config[ctx->i] = config;
     }
+    grubfm_ext_hash_build (ctx);
   }
 
   /* generic menu */
@@ -141,16 +196,13 @@ grubfm_get_file_icon (struct grubfm_enum_file_info *info,
   if (!ext || *ext == '\0' || *(ext++) == '\0')
     goto ret;
 
-  for (ctx->i = 0; ctx->i < ctx->n; ctx->i++)
+  int i = grubfm_ext_lookup (ctx, ext);
+  if (i >= 0)
   {
-    if (grub_strcasecmp (ext, ctx->ext[ctx->i]) == 0)
-    {
-      icon = ctx->icon[ctx->i];
-      info->ext = ctx->i;
-      info->condition = ctx->condition[ctx->i];
-      info->display = ctx->display[ctx->i];
-      break;
-    }
+    icon = ctx->icon[i];
+    info->ext = i;
+    info->condition = ctx->condition[i];
+    info->display = ctx->display[i];
   }
 ret:
   return icon;
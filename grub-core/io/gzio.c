@@ -40,6 +40,8 @@
 #include <grub/misc.h>
 #include <grub/fs.h>
 #include <grub/file.h>
+#include <grub/disk.h>
+#include <grub/partition.h>
 #include <grub/dl.h>
 #include <grub/deflate.h>
 #include <grub/i18n.h>
@@ -57,6 +59,90 @@ GRUB_MOD_LICENSE ("GPLv3+");
 
 
 #define INBUFSIZ  0x2000
+#define INBUFSIZ_MAX  0x40000
+
+/*
+ *  Random access
+ *
+ *  Once a file is read out of order, the decoder state at deflate block
+ *  boundaries is recorded every SPAN bytes of output: the input position,
+ *  the bit buffer and the sliding window.  Seeks then restart from the
+ *  nearest recorded point rather than from the start of the file.  When
+ *  the index is full, every other point is dropped and SPAN doubles.
+ */
+
+#define GZIO_INDEX_POINTS	128
+#define GZIO_INDEX_SPAN		(1 << 20)
+
+/* Only look for a saved index beside compressed files at least this big.  */
+#define GZIO_INDEX_MIN_SIZE	(16 << 20)
+
+/* How many indexes of closed files to keep for the next open.  */
+#define GZIO_INDEX_CACHE	2
+
+struct grub_gzio_point
+{
+  /* Offset in uncompressed data.  */
+  grub_off_t out;
+  /* Offset of the next unread byte in the underlying file.  */
+  grub_off_t in;
+  /* The bit buffer.  */
+  grub_uint32_t bb;
+  unsigned bk;
+  /* The sliding window, WSIZE bytes.  */
+  grub_uint8_t *window;
+};
+
+/* What an index must match to be used for a file: the disk and partition
+   the file is on, its size, and the CRC32 and length from the gzip
+   trailer.  */
+struct grub_gzio_index_key
+{
+  unsigned long dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t start;
+  grub_off_t csize;
+  grub_uint32_t crc32;
+  grub_uint32_t isize;
+};
+
+struct grub_gzio_index
+{
+  struct grub_gzio_index *next;
+  /* The underlying file, to match later opens.  */
+  char *name;
+  struct grub_gzio_index_key key;
+  grub_off_t span;
+  unsigned count;
+  int refcnt;
+  struct grub_gzio_point points[GZIO_INDEX_POINTS];
+};
+
+static struct grub_gzio_index *grub_gzio_index_list;
+
+/* On-disk format of a saved index: the header, COUNT entries, then COUNT
+   windows.  All fields are little-endian.  */
+#define GZIO_INDEX_MAGIC	"GZIOIDX2"
+
+struct grub_gzio_index_header
+{
+  char magic[8];
+  grub_uint64_t csize;
+  grub_uint64_t span;
+  grub_uint32_t count;
+  grub_uint32_t wsize;
+  /* The gzip trailer of the indexed file.  */
+  grub_uint32_t crc32;
+  grub_uint32_t isize;
+} GRUB_PACKED;
+
+struct grub_gzio_index_entry
+{
+  grub_uint64_t out;
+  grub_uint64_t in;
+  grub_uint32_t bb;
+  grub_uint32_t bk;
+} GRUB_PACKED;
 
 /* The state stored in filesystem-specific data.  */
 struct grub_gzio
@@ -80,9 +166,13 @@ struct grub_gzio
   unsigned inflate_n;
   /* The index of a copy.  */
   unsigned inflate_d;
-  /* The input buffer.  */
-  grub_uint8_t inbuf[INBUFSIZ];
-  int inbuf_d;
+  /* The input buffer, sized to the file between INBUFSIZ and
+     INBUFSIZ_MAX.  */
+  grub_uint8_t *inbuf;
+  grub_size_t inbuf_size;
+  grub_size_t inbuf_d;
+  /* The offset of INBUF in the underlying file.  */
+  grub_off_t inbuf_off;
   /* The bit buffer.  */
   unsigned long bb;
   /* The bits in the bit buffer.  */
@@ -109,6 +199,12 @@ struct grub_gzio
   int bd;
   /* The original offset value.  */
   grub_off_t saved_offset;
+  /* Whether the checksum covers everything inflated so far.  */
+  int hvalid;
+  /* Continue the current window rather than starting a new one.  */
+  int resume;
+  /* Random access points, if the file has been read out of order.  */
+  struct grub_gzio_index *index;
 };
 typedef struct grub_gzio *grub_gzio_t;
 
@@ -390,10 +486,11 @@ get_byte (grub_gzio_t gzio)
 
   if (gzio->file && (grub_file_tell (gzio->file)
 		     == (grub_off_t) gzio->data_offset
-		     || gzio->inbuf_d == INBUFSIZ))
+		     || gzio->inbuf_d == gzio->inbuf_size))
     {
       gzio->inbuf_d = 0;
-      grub_file_read (gzio->file, gzio->inbuf, INBUFSIZ);
+      gzio->inbuf_off = grub_file_tell (gzio->file);
+      grub_file_read (gzio->file, gzio->inbuf, gzio->inbuf_size);
     }
 
   return gzio->inbuf[gzio->inbuf_d++];
@@ -1043,11 +1140,58 @@ get_new_block (grub_gzio_t gzio)
 }
 
 
+/* Record a random access point, if one is due.  Must be called between
+   deflate blocks.  */
+static void
+gzio_index_add (grub_gzio_t gzio)
+{
+  struct grub_gzio_index *index = gzio->index;
+  struct grub_gzio_point *point;
+  grub_off_t out = gzio->saved_offset + gzio->wp;
+  unsigned i;
+
+  if (! index || gzio->mem_input)
+    return;
+  if (out < (index->count ? index->points[index->count - 1].out : 0)
+      + index->span)
+    return;
+
+  if (index->count == GZIO_INDEX_POINTS)
+    {
+      for (i = 0; i < GZIO_INDEX_POINTS / 2; i++)
+	{
+	  grub_free (index->points[2 * i].window);
+	  index->points[i] = index->points[2 * i + 1];
+	}
+      index->count = GZIO_INDEX_POINTS / 2;
+      index->span *= 2;
+      if (out < index->points[index->count - 1].out + index->span)
+	return;
+    }
+
+  point = &index->points[index->count];
+  point->window = grub_malloc (WSIZE);
+  if (! point->window)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return;
+    }
+  grub_memcpy (point->window, gzio->slide, WSIZE);
+  point->out = out;
+  point->in = gzio->inbuf_off + gzio->inbuf_d;
+  point->bb = gzio->bb;
+  point->bk = gzio->bk;
+  index->count++;
+}
+
 static void
 inflate_window (grub_gzio_t gzio)
 {
   /* initialize window */
-  gzio->wp = 0;
+  if (gzio->resume)
+    gzio->resume = 0;
+  else
+    gzio->wp = 0;
 
   /*
    *  Main decompression loop.
@@ -1060,6 +1204,7 @@ inflate_window (grub_gzio_t gzio)
 	  if (gzio->last_block)
 	    break;
 
+	  gzio_index_add (gzio);
 	  get_new_block (gzio);
 	}
 
@@ -1107,7 +1252,7 @@ inflate_window (grub_gzio_t gzio)
 
   gzio->saved_offset += gzio->wp;
 
-  if (gzio->hcontext)
+  if (gzio->hcontext && gzio->hvalid)
     {
       gzio->hdesc->write (gzio->hcontext, gzio->slide, gzio->wp);
 
@@ -1149,6 +1294,254 @@ initialize_tables (grub_gzio_t gzio)
 
   if (gzio->hcontext)
     gzio->hdesc->init(gzio->hcontext);
+  gzio->hvalid = 1;
+  gzio->resume = 0;
+}
+
+/* Restart inflating from the last random access point at or before OFFSET.
+   Unless BACKWARD, only do so if that gets ahead of the current position.
+   Return non-zero if the decoder was moved.  */
+static int
+gzio_index_seek (grub_gzio_t gzio, grub_off_t offset, int backward)
+{
+  struct grub_gzio_index *index = gzio->index;
+  struct grub_gzio_point *point;
+  unsigned lo, hi, mid;
+
+  if (! index || ! index->count || gzio->mem_input)
+    return 0;
+
+  lo = 0;
+  hi = index->count;
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (index->points[mid].out <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo == 0)
+    return 0;
+  point = &index->points[lo - 1];
+  if (! backward && point->out <= gzio->saved_offset)
+    return 0;
+
+  gzio_seek (gzio, point->in);
+  if (grub_errno != GRUB_ERR_NONE)
+    return 0;
+  /* Refill the input buffer on the next byte.  */
+  gzio->inbuf_d = gzio->inbuf_size;
+  gzio->bb = point->bb;
+  gzio->bk = point->bk;
+
+  gzio->last_block = 0;
+  gzio->block_len = 0;
+  gzio->code_state = 0;
+  huft_free (gzio->tl);
+  huft_free (gzio->td);
+  gzio->tl = NULL;
+  gzio->td = NULL;
+
+  grub_memcpy (gzio->slide, point->window, WSIZE);
+  gzio->saved_offset = point->out & ~(grub_off_t) (WSIZE - 1);
+  gzio->wp = point->out & (WSIZE - 1);
+  gzio->resume = 1;
+
+  /* The checksum can't be verified without inflating from the start.  */
+  gzio->hvalid = 0;
+
+  return 1;
+}
+
+/* Describe the file GZIO reads, for matching it against an index.  */
+static void
+gzio_index_key (grub_gzio_t gzio, struct grub_gzio_index_key *key)
+{
+  grub_disk_t disk = gzio->file->device ? gzio->file->device->disk : NULL;
+
+  key->dev_id = disk ? disk->dev->id : 0;
+  key->disk_id = disk ? disk->id : 0;
+  key->start = disk ? grub_partition_get_start (disk->partition) : 0;
+  key->csize = grub_file_size (gzio->file);
+  key->crc32 = gzio->orig_checksum;
+  key->isize = grub_le_to_cpu32 (gzio->orig_len);
+}
+
+static int
+gzio_index_key_equal (const struct grub_gzio_index_key *a,
+		      const struct grub_gzio_index_key *b)
+{
+  return (a->dev_id == b->dev_id && a->disk_id == b->disk_id
+	  && a->start == b->start && a->csize == b->csize
+	  && a->crc32 == b->crc32 && a->isize == b->isize);
+}
+
+static struct grub_gzio_index *
+gzio_index_new (grub_gzio_t gzio)
+{
+  struct grub_gzio_index *index;
+
+  if (! gzio->file->name)
+    return NULL;
+  index = grub_zalloc (sizeof (*index));
+  if (! index)
+    return NULL;
+  index->name = grub_strdup (gzio->file->name);
+  if (! index->name)
+    {
+      grub_free (index);
+      return NULL;
+    }
+  gzio_index_key (gzio, &index->key);
+  index->span = GZIO_INDEX_SPAN;
+  index->refcnt = 1;
+  index->next = grub_gzio_index_list;
+  grub_gzio_index_list = index;
+  return index;
+}
+
+static void
+gzio_index_free (struct grub_gzio_index *index)
+{
+  unsigned i;
+
+  for (i = 0; i < index->count; i++)
+    grub_free (index->points[i].window);
+  grub_free (index->name);
+  grub_free (index);
+}
+
+/* Drop a reference to INDEX, keeping only the most recent few indexes that
+   are no longer in use.  */
+static void
+gzio_index_put (struct grub_gzio_index *index)
+{
+  struct grub_gzio_index **p, *q;
+  int idle = 0;
+
+  index->refcnt--;
+  for (p = &grub_gzio_index_list; *p; )
+    {
+      q = *p;
+      if (q->refcnt == 0 && (q->count == 0 || ++idle > GZIO_INDEX_CACHE))
+	{
+	  *p = q->next;
+	  gzio_index_free (q);
+	}
+      else
+	p = &q->next;
+    }
+}
+
+/* Read an index saved beside IO by the gzindex command.  Any problem just
+   leaves INDEX empty.  */
+static void
+gzio_index_load (struct grub_gzio_index *index, grub_file_t io,
+		 enum grub_file_type type)
+{
+  struct grub_gzio_index_header hdr;
+  struct grub_gzio_index_entry *entries = NULL;
+  grub_file_t file;
+  char *name;
+  grub_off_t last = 0;
+  grub_uint32_t count, i;
+
+  name = grub_xasprintf ("%s.gzi", io->name);
+  if (! name)
+    goto fail;
+  file = grub_file_open (name, (type & GRUB_FILE_TYPE_MASK)
+			 | GRUB_FILE_TYPE_NO_DECOMPRESS);
+  grub_free (name);
+  if (! file)
+    goto fail;
+
+  if (grub_file_read (file, &hdr, sizeof (hdr)) != sizeof (hdr)
+      || grub_memcmp (hdr.magic, GZIO_INDEX_MAGIC, sizeof (hdr.magic)) != 0
+      || grub_le_to_cpu64 (hdr.csize) != index->key.csize
+      || grub_le_to_cpu32 (hdr.crc32) != index->key.crc32
+      || grub_le_to_cpu32 (hdr.isize) != index->key.isize
+      || grub_le_to_cpu32 (hdr.wsize) != WSIZE
+      /* The span only ever grows from GZIO_INDEX_SPAN.  */
+      || grub_le_to_cpu64 (hdr.span) < GZIO_INDEX_SPAN)
+    goto close;
+  count = grub_le_to_cpu32 (hdr.count);
+  if (count == 0 || count > GZIO_INDEX_POINTS)
+    goto close;
+
+  entries = grub_malloc (count * sizeof (*entries));
+  if (! entries)
+    goto close;
+  if (grub_file_read (file, entries, count * sizeof (*entries))
+      != (grub_ssize_t) (count * sizeof (*entries)))
+    goto close;
+
+  for (i = 0; i < count; i++)
+    {
+      struct grub_gzio_point *point = &index->points[i];
+
+      point->out = grub_le_to_cpu64 (entries[i].out);
+      point->in = grub_le_to_cpu64 (entries[i].in);
+      point->bb = grub_le_to_cpu32 (entries[i].bb);
+      point->bk = grub_le_to_cpu32 (entries[i].bk);
+      if (point->out <= last || point->in >= index->key.csize
+	  || point->bk > 24)
+	break;
+      last = point->out;
+      point->window = grub_malloc (WSIZE);
+      if (! point->window)
+	break;
+      if (grub_file_read (file, point->window, WSIZE) != WSIZE)
+	{
+	  grub_free (point->window);
+	  break;
+	}
+      index->count++;
+    }
+  if (index->count)
+    index->span = grub_le_to_cpu64 (hdr.span);
+
+ close:
+  grub_free (entries);
+  grub_file_close (file);
+ fail:
+  grub_errno = GRUB_ERR_NONE;
+}
+
+/* Find the index of a file opened before, or one saved beside it.  */
+static struct grub_gzio_index *
+gzio_index_get (grub_gzio_t gzio, enum grub_file_type type)
+{
+  grub_file_t io = gzio->file;
+  struct grub_gzio_index_key key;
+  struct grub_gzio_index *index;
+
+  if (! io->name)
+    return NULL;
+  gzio_index_key (gzio, &key);
+  for (index = grub_gzio_index_list; index; index = index->next)
+    if (gzio_index_key_equal (&index->key, &key)
+	&& grub_strcmp (index->name, io->name) == 0)
+      {
+	index->refcnt++;
+	return index;
+      }
+
+  if (grub_file_size (io) < GZIO_INDEX_MIN_SIZE)
+    return NULL;
+  index = gzio_index_new (gzio);
+  if (! index)
+    {
+      grub_errno = GRUB_ERR_NONE;
+      return NULL;
+    }
+  gzio_index_load (index, io, type);
+  if (! index->count)
+    {
+      gzio_index_put (index);
+      return NULL;
+    }
+  return index;
 }
 
 
@@ -1176,6 +1569,21 @@ grub_gzio_open (grub_file_t io, enum grub_file_type type)
     }
 
   gzio->file = io;
+  gzio->inbuf_size = grub_file_filter_bufsize (io, INBUFSIZ, INBUFSIZ_MAX);
+  gzio->inbuf = grub_malloc (gzio->inbuf_size);
+  if (! gzio->inbuf)
+    {
+      /* Fall back to small reads rather than failing.  */
+      grub_errno = GRUB_ERR_NONE;
+      gzio->inbuf_size = INBUFSIZ;
+      gzio->inbuf = grub_malloc (gzio->inbuf_size);
+    }
+  if (! gzio->inbuf)
+    {
+      grub_free (gzio);
+      grub_free (file);
+      return 0;
+    }
 
   gzio->hdesc = GRUB_MD_CRC32;
   gzio->hcontext = grub_malloc(gzio->hdesc->contextsize);
@@ -1189,6 +1597,7 @@ grub_gzio_open (grub_file_t io, enum grub_file_type type)
     {
       grub_errno = GRUB_ERR_NONE;
       grub_free (gzio->hcontext);
+      grub_free (gzio->inbuf);
       grub_free (gzio);
       grub_free (file);
       grub_file_seek (io, 0);
@@ -1196,6 +1605,8 @@ grub_gzio_open (grub_file_t io, enum grub_file_type type)
       return io;
     }
 
+  gzio->index = gzio_index_get (gzio, type);
+
   return file;
 }
 
@@ -1259,7 +1670,18 @@ grub_gzio_read_real (grub_gzio_t gzio, grub_off_t offset,
 
   /* Do we reset decompression to the beginning of the file?  */
   if (gzio->saved_offset > offset + WSIZE)
-    initialize_tables (gzio);
+    {
+      /* Reading out of order: start recording random access points.  */
+      if (! gzio->index && ! gzio->mem_input)
+	{
+	  gzio->index = gzio_index_new (gzio);
+	  grub_errno = GRUB_ERR_NONE;
+	}
+      if (! gzio_index_seek (gzio, offset, 1))
+	initialize_tables (gzio);
+    }
+  else if (offset >= gzio->saved_offset + WSIZE)
+    gzio_index_seek (gzio, offset, 0);
 
   /*
    *  This loop operates upon uncompressed data only.  The only
@@ -1326,6 +1748,9 @@ grub_gzio_close (grub_file_t file)
   huft_free (gzio->tl);
   huft_free (gzio->td);
   grub_free (gzio->hcontext);
+  grub_free (gzio->inbuf);
+  if (gzio->index)
+    gzio_index_put (gzio->index);
   grub_free (gzio);
 
   /* No need to close the same device twice.  */
@@ -1386,6 +1811,79 @@ grub_deflate_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
 
 
 
+grub_err_t
+grub_gzio_index_build (grub_file_t file)
+{
+  grub_gzio_t gzio;
+  char *buf;
+  grub_ssize_t r;
+
+  if (file->fs != &grub_gzio_fs)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, N_("not a gzip file"));
+  gzio = file->data;
+  if (! gzio->index)
+    {
+      gzio->index = gzio_index_new (gzio);
+      if (! gzio->index)
+	return grub_errno;
+    }
+
+  buf = grub_malloc (WSIZE);
+  if (! buf)
+    return grub_errno;
+  /* Carry on from the last point recorded so far.  */
+  grub_file_seek (file, gzio->index->count
+		  ? gzio->index->points[gzio->index->count - 1].out : 0);
+  do
+    r = grub_file_read (file, buf, WSIZE);
+  while (r > 0);
+  grub_free (buf);
+
+  return grub_errno;
+}
+
+grub_err_t
+grub_gzio_index_export (grub_file_t file, void **data, grub_size_t *size)
+{
+  struct grub_gzio_index *index;
+  struct grub_gzio_index_header *hdr;
+  struct grub_gzio_index_entry *entries;
+  grub_uint8_t *windows;
+  unsigned i;
+
+  if (file->fs != &grub_gzio_fs)
+    return grub_error (GRUB_ERR_BAD_FILE_TYPE, N_("not a gzip file"));
+  index = ((grub_gzio_t) file->data)->index;
+  if (! index || ! index->count)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, "no index to save");
+
+  *size = sizeof (*hdr) + index->count * (sizeof (*entries) + WSIZE);
+  hdr = grub_zalloc (*size);
+  if (! hdr)
+    return grub_errno;
+  entries = (struct grub_gzio_index_entry *) (hdr + 1);
+  windows = (grub_uint8_t *) (entries + index->count);
+
+  grub_memcpy (hdr->magic, GZIO_INDEX_MAGIC, sizeof (hdr->magic));
+  hdr->csize = grub_cpu_to_le64 (index->key.csize);
+  hdr->span = grub_cpu_to_le64 (index->span);
+  hdr->count = grub_cpu_to_le32 (index->count);
+  hdr->wsize = grub_cpu_to_le32 (WSIZE);
+  hdr->crc32 = grub_cpu_to_le32 (index->key.crc32);
+  hdr->isize = grub_cpu_to_le32 (index->key.isize);
+  for (i = 0; i < index->count; i++)
+    {
+      entries[i].out = grub_cpu_to_le64 (index->points[i].out);
+      entries[i].in = grub_cpu_to_le64 (index->points[i].in);
+      entries[i].bb = grub_cpu_to_le32 (index->points[i].bb);
+      entries[i].bk = grub_cpu_to_le32 (index->points[i].bk);
+      grub_memcpy (windows + i * WSIZE, index->points[i].window, WSIZE);
+    }
+
+  *data = hdr;
+  return GRUB_ERR_NONE;
+}
+
 static struct grub_fs grub_gzio_fs =
   {
     .name = "gzio",
@@ -1404,5 +1902,13 @@ GRUB_MOD_INIT(gzio)
 
 GRUB_MOD_FINI(gzio)
 {
+  struct grub_gzio_index *index, *next;
+
   grub_file_filter_unregister (GRUB_FILE_FILTER_GZIO);
+  for (index = grub_gzio_index_list; index; index = next)
+    {
+      next = index->next;
+      gzio_index_free (index);
+    }
+  grub_gzio_index_list = NULL;
 }
@@ -30,6 +30,7 @@ GRUB_MOD_LICENSE ("GPLv3+");
 #include "xz_stream.h"
 
 #define XZBUFSIZ 0x2000
+#define XZ_INBUFSIZ_MAX 0x40000
 #define VLI_MAX_DIGITS 9
 #define XZ_STREAM_FOOTER_SIZE 12
 
@@ -38,9 +39,21 @@ struct grub_xzio
   grub_file_t file;
   struct xz_buf buf;
   struct xz_dec *dec;
-  grub_uint8_t inbuf[XZBUFSIZ];
+  /* Sized to the file between XZBUFSIZ and XZ_INBUFSIZ_MAX.  */
+  grub_uint8_t *inbuf;
+  grub_size_t inbuf_size;
+  /* Only decoded data before the wanted offset goes here, the rest is
+     decoded straight into the caller's buffer.  */
   grub_uint8_t outbuf[XZBUFSIZ];
   grub_off_t saved_offset;
+  /* Where each block starts in uncompressed and compressed data, taken from
+     the stream index, so that seeks can restart at a block boundary.
+     BLOCK_IN has one more entry, the start of the index.  */
+  grub_uint64_t *block_out;
+  grub_uint64_t *block_in;
+  grub_size_t nblocks;
+  /* Compressed data beyond this isn't fed to the decoder.  */
+  grub_off_t in_end;
 };
 
 typedef struct grub_xzio *grub_xzio_t;
@@ -122,7 +135,11 @@ test_footer (grub_file_t file)
   grub_uint8_t imarker;
   grub_uint64_t uncompressed_size_total = 0;
   grub_uint64_t uncompressed_size;
+  grub_uint64_t unpadded_size;
+  grub_uint64_t compressed_offset = STREAM_HEADER_SIZE;
   grub_uint64_t records;
+  grub_off_t index_offset;
+  grub_size_t i = 0;
 
   grub_file_seek (xzio->file, xzio->file->size - FOOTER_MAGIC_SIZE);
   if (grub_file_read (xzio->file, footer, FOOTER_MAGIC_SIZE)
@@ -139,8 +156,8 @@ test_footer (grub_file_t file)
   backsize = (grub_le_to_cpu32 (backsize) + 1) * 4;
 
   /* Set file to the beginning of stream index.  */
-  grub_file_seek (xzio->file,
-		  xzio->file->size - XZ_STREAM_FOOTER_SIZE - backsize);
+  index_offset = xzio->file->size - XZ_STREAM_FOOTER_SIZE - backsize;
+  grub_file_seek (xzio->file, index_offset);
 
   /* Test index marker.  */
   if (grub_file_read (xzio->file, &imarker, sizeof (imarker))
@@ -150,16 +167,42 @@ test_footer (grub_file_t file)
   if (read_vli (xzio->file, &records) <= 0)
     goto ERROR;
 
+  /* Each record takes at least two bytes.  */
+  if (records > 1 && records <= backsize / 2)
+    {
+      xzio->block_out = grub_malloc (records * sizeof (xzio->block_out[0]));
+      xzio->block_in = grub_malloc ((records + 1)
+				    * sizeof (xzio->block_in[0]));
+      if (!xzio->block_out || !xzio->block_in)
+	grub_errno = GRUB_ERR_NONE;
+      else
+	xzio->nblocks = records;
+    }
+
   for (; records != 0; records--)
     {
-      if (read_vli (xzio->file, &uncompressed_size) <= 0)	/* Ignore unpadded.  */
+      if (read_vli (xzio->file, &unpadded_size) <= 0)	/* Unpadded.  */
 	goto ERROR;
       if (read_vli (xzio->file, &uncompressed_size) <= 0)	/* Uncompressed.  */
 	goto ERROR;
 
+      if (i < xzio->nblocks)
+	{
+	  xzio->block_out[i] = uncompressed_size_total;
+	  xzio->block_in[i] = compressed_offset;
+	  i++;
+	}
+      compressed_offset += ALIGN_UP (unpadded_size, 4);
       uncompressed_size_total += uncompressed_size;
     }
 
+  /* Only trust the block table if it accounts for every byte up to the
+     index, as it wouldn't for concatenated streams.  */
+  if (compressed_offset != index_offset)
+    xzio->nblocks = 0;
+  else if (xzio->nblocks)
+    xzio->block_in[xzio->nblocks] = index_offset;
+
   file->size = uncompressed_size_total;
   grub_file_seek (xzio->file, STREAM_HEADER_SIZE);
   return 1;
@@ -189,6 +232,22 @@ grub_xzio_open (grub_file_t io, enum grub_file_type type)
     }
 
   xzio->file = io;
+  xzio->in_end = io->size;
+  xzio->inbuf_size = grub_file_filter_bufsize (io, XZBUFSIZ, XZ_INBUFSIZ_MAX);
+  xzio->inbuf = grub_malloc (xzio->inbuf_size);
+  if (!xzio->inbuf)
+    {
+      /* Fall back to small reads rather than failing.  */
+      grub_errno = GRUB_ERR_NONE;
+      xzio->inbuf_size = XZBUFSIZ;
+      xzio->inbuf = grub_malloc (xzio->inbuf_size);
+    }
+  if (!xzio->inbuf)
+    {
+      grub_free (xzio);
+      grub_free (file);
+      return 0;
+    }
 
   file->device = io->device;
   file->data = xzio;
@@ -205,6 +264,7 @@ grub_xzio_open (grub_file_t io, enum grub_file_type type)
   if (!xzio->dec)
     {
       grub_free (file);
+      grub_free (xzio->inbuf);
       grub_free (xzio);
       return 0;
     }
@@ -219,6 +279,9 @@ grub_xzio_open (grub_file_t io, enum grub_file_type type)
       grub_errno = GRUB_ERR_NONE;
       grub_file_seek (io, 0);
       xz_dec_end (xzio->dec);
+      grub_free (xzio->block_out);
+      grub_free (xzio->block_in);
+      grub_free (xzio->inbuf);
       grub_free (xzio);
       grub_free (file);
 
@@ -228,6 +291,70 @@ grub_xzio_open (grub_file_t io, enum grub_file_type type)
   return file;
 }
 
+/* Restart decoding from the beginning of the file.  */
+static void
+xzio_restart (grub_xzio_t xzio)
+{
+  xz_dec_reset (xzio->dec);
+  xzio->saved_offset = 0;
+  xzio->buf.out_pos = 0;
+  xzio->buf.in_pos = 0;
+  xzio->buf.in_size = 0;
+  xzio->in_end = xzio->file->size;
+  grub_file_seek (xzio->file, 0);
+}
+
+/* Restart decoding at the last block starting at or before OFFSET.  Unless
+   BACKWARD, only do so if that gets ahead of the current position.  Return
+   non-zero if the decoder was moved.  If the block can't be reached, the
+   decoder is restarted from the beginning of the file, which is also a
+   move.  */
+static int
+xzio_seek_block (grub_xzio_t xzio, grub_off_t offset, int backward)
+{
+  grub_size_t lo = 0, hi = xzio->nblocks, mid;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (xzio->block_out[mid] <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo == 0)
+    return 0;
+  lo--;
+  if (!backward && xzio->block_out[lo] <= xzio->saved_offset)
+    return 0;
+
+  /* The decoder only accepts a block after a stream header.  */
+  xz_dec_reset (xzio->dec);
+  grub_file_seek (xzio->file, 0);
+  xzio->buf.in_pos = 0;
+  xzio->buf.in_size = grub_file_read (xzio->file, xzio->inbuf,
+				      STREAM_HEADER_SIZE);
+  xzio->buf.out_pos = 0;
+  xzio->buf.out_size = 0;
+  if (xzio->buf.in_size != STREAM_HEADER_SIZE
+      || xz_dec_run (xzio->dec, &xzio->buf) != XZ_OK)
+    {
+      /* The old decoder state is gone by now.  */
+      grub_errno = GRUB_ERR_NONE;
+      xzio_restart (xzio);
+      return 1;
+    }
+
+  grub_file_seek (xzio->file, xzio->block_in[lo]);
+  xzio->buf.in_pos = 0;
+  xzio->buf.in_size = 0;
+  xzio->saved_offset = xzio->block_out[lo];
+  /* Stop before the index, which the decoder would check against the
+     blocks it has seen.  */
+  xzio->in_end = xzio->block_in[xzio->nblocks];
+  return 1;
+}
+
 static grub_ssize_t
 grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
 {
@@ -237,29 +364,41 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
   grub_xzio_t xzio = file->data;
   grub_off_t current_offset;
 
-  /* If seek backward need to reset decoder and start from beginning of file.
-     TODO Possible improvement by jumping blocks.  */
+  /* If seek backward need to restart from the nearest block, or from the
+     beginning of file.  Seeks far forward also skip whole blocks.  */
   if (file->offset < xzio->saved_offset)
     {
-      xz_dec_reset (xzio->dec);
-      xzio->saved_offset = 0;
-      xzio->buf.out_pos = 0;
-      xzio->buf.in_pos = 0;
-      xzio->buf.in_size = 0;
-      grub_file_seek (xzio->file, 0);
+      if (!xzio_seek_block (xzio, file->offset, 1))
+	xzio_restart (xzio);
     }
+  else if (file->offset > xzio->saved_offset)
+    xzio_seek_block (xzio, file->offset, 0);
 
   current_offset = xzio->saved_offset;
 
   while (len > 0)
     {
-      xzio->buf.out_size = file->offset + ret + len - current_offset;
-      if (xzio->buf.out_size > XZBUFSIZ)
-	xzio->buf.out_size = XZBUFSIZ;
+      /* Once at the wanted offset, decode into the caller's buffer.  */
+      if (current_offset == file->offset + ret)
+	{
+	  xzio->buf.out = (grub_uint8_t *) buf;
+	  xzio->buf.out_size = len;
+	}
+      else
+	{
+	  xzio->buf.out = xzio->outbuf;
+	  xzio->buf.out_size = file->offset + ret + len - current_offset;
+	  if (xzio->buf.out_size > XZBUFSIZ)
+	    xzio->buf.out_size = XZBUFSIZ;
+	}
       /* Feed input.  */
       if (xzio->buf.in_pos == xzio->buf.in_size)
 	{
-	  readret = grub_file_read (xzio->file, xzio->inbuf, XZBUFSIZ);
+	  grub_size_t insize = xzio->inbuf_size;
+
+	  if (grub_file_tell (xzio->file) + insize > xzio->in_end)
+	    insize = xzio->in_end - grub_file_tell (xzio->file);
+	  readret = grub_file_read (xzio->file, xzio->inbuf, insize);
 	  if (readret < 0)
 	    return -1;
 	  xzio->buf.in_size = readret;
@@ -288,8 +427,9 @@ grub_xzio_read (grub_file_t file, char *buf, grub_size_t len)
 	  /* Store first chunk of data in buffer.  */
 	  {
 	    grub_size_t delta = new_offset - (file->offset + ret);
-	    grub_memmove (buf, xzio->buf.out + (xzio->buf.out_pos - delta),
-			  delta);
+	    if (xzio->buf.out == xzio->outbuf)
+	      grub_memmove (buf, xzio->buf.out + (xzio->buf.out_pos - delta),
+			    delta);
 	    len -= delta;
 	    buf += delta;
 	    ret += delta;
@@ -317,6 +457,9 @@ grub_xzio_close (grub_file_t file)
   xz_dec_end (xzio->dec);
 
   grub_file_close (xzio->file);
+  grub_free (xzio->block_out);
+  grub_free (xzio->block_in);
+  grub_free (xzio->inbuf);
   grub_free (xzio);
 
   /* Device must not be closed twice.  */
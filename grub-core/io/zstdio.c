@@ -0,0 +1,490 @@
+/* zstdio.c - decompression support for zstd */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2020  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <grub/err.h>
+#include <grub/mm.h>
+#include <grub/misc.h>
+#include <grub/file.h>
+#include <grub/fs.h>
+#include <grub/dl.h>
+
+GRUB_MOD_LICENSE ("GPLv3+");
+
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+
+/* The seekable format ends with a skippable frame holding a table of
+   compressed and decompressed frame sizes, followed by this footer.  */
+#define ZSTD_SEEKABLE_MAGIC		0x8F92EAB1
+#define ZSTD_SEEKABLE_FRAME_MAGIC	(ZSTD_MAGIC_SKIPPABLE_START | 0xE)
+#define ZSTD_SEEKABLE_FOOTER_SIZE	9
+#define ZSTD_SEEKABLE_CHECKSUM_FLAG	0x80
+
+#define ZSTDIO_BUFSIZ			0x2000
+#define ZSTDIO_INBUFSIZ_MAX		0x40000
+
+#define ZSTD_BLOCK_HEADER_SIZE		3
+#define ZSTD_BLOCK_RLE			1
+#define ZSTD_BLOCK_RESERVED		3
+
+struct grub_zstdio
+{
+  grub_file_t file;
+  ZSTD_DStream *dstream;
+  ZSTD_inBuffer in;
+  grub_uint8_t *inbuf;
+  grub_size_t inbuf_size;
+  /* The offset of INBUF in the underlying file.  */
+  grub_off_t inbuf_off;
+  /* Decoded data before the wanted offset is thrown away here.  */
+  grub_uint8_t *outbuf;
+  grub_size_t outbuf_size;
+  /* How far into the uncompressed data the decoder is.  */
+  grub_off_t saved_offset;
+  /* Where each frame starts in uncompressed and compressed data, so that
+     seeks can restart at a frame boundary.  Unless COMPLETE, the table
+     only covers the frames up to the furthest point decoded so far, and
+     is extended as the decoder passes further frames.  */
+  grub_uint64_t *frame_out;
+  grub_uint64_t *frame_in;
+  grub_size_t nframes;
+  grub_size_t max_frames;
+  int complete;
+  /* The decoder is between frames.  */
+  int frame_end;
+};
+typedef struct grub_zstdio *grub_zstdio_t;
+
+static struct grub_fs grub_zstdio_fs;
+
+static int
+zstdio_pread (grub_zstdio_t zstdio, grub_off_t pos, void *buf, grub_size_t len)
+{
+  grub_file_seek (zstdio->file, pos);
+  return grub_file_read (zstdio->file, buf, len) == (grub_ssize_t) len;
+}
+
+static int
+zstdio_add_frame (grub_zstdio_t zstdio, grub_uint64_t out, grub_uint64_t in)
+{
+  if (zstdio->nframes == zstdio->max_frames)
+    {
+      grub_size_t max = zstdio->max_frames ? 2 * zstdio->max_frames : 16;
+      grub_uint64_t *p;
+
+      p = grub_realloc (zstdio->frame_out, max * sizeof (*p));
+      if (!p)
+	return 0;
+      zstdio->frame_out = p;
+      p = grub_realloc (zstdio->frame_in, max * sizeof (*p));
+      if (!p)
+	return 0;
+      zstdio->frame_in = p;
+      zstdio->max_frames = max;
+    }
+  zstdio->frame_out[zstdio->nframes] = out;
+  zstdio->frame_in[zstdio->nframes] = in;
+  zstdio->nframes++;
+  return 1;
+}
+
+/* Restart decoding at the last frame starting at or before OFFSET.  Unless
+   BACKWARD, only do so if that gets ahead of the current position.  */
+static void
+zstdio_seek_frame (grub_zstdio_t zstdio, grub_off_t offset, int backward)
+{
+  grub_size_t lo = 0, hi = zstdio->nframes, mid;
+
+  while (lo < hi)
+    {
+      mid = (lo + hi) / 2;
+      if (zstdio->frame_out[mid] <= offset)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo == 0)
+    return;
+  lo--;
+  if (!backward && zstdio->frame_out[lo] <= zstdio->saved_offset)
+    return;
+
+  ZSTD_initDStream (zstdio->dstream);
+  grub_file_seek (zstdio->file, zstdio->frame_in[lo]);
+  zstdio->in.pos = 0;
+  zstdio->in.size = 0;
+  zstdio->saved_offset = zstdio->frame_out[lo];
+  zstdio->frame_end = 1;
+}
+
+/* Run the decoder until it produces some output, refilling the input as
+   it's used up.  Return the number of bytes decoded into OUT, 0 at the end
+   of the data, or -1 on error.  */
+static grub_ssize_t
+zstdio_decode (grub_zstdio_t zstdio, void *out, grub_size_t size)
+{
+  ZSTD_outBuffer output = { out, size, 0 };
+  grub_ssize_t readret;
+  grub_size_t ret;
+
+  while (output.pos == 0)
+    {
+      readret = -1;
+      if (zstdio->in.pos == zstdio->in.size)
+	{
+	  zstdio->inbuf_off = grub_file_tell (zstdio->file);
+	  readret = grub_file_read (zstdio->file, zstdio->inbuf,
+				    zstdio->inbuf_size);
+	  if (readret < 0)
+	    return -1;
+	  zstdio->in.size = readret;
+	  zstdio->in.pos = 0;
+	}
+
+      ret = ZSTD_decompressStream (zstdio->dstream, &output, &zstdio->in);
+      if (ZSTD_isError (ret))
+	{
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA, "zstd: %s",
+		      ZSTD_getErrorName (ret));
+	  return -1;
+	}
+      /* Out of input, and nothing more was buffered.  */
+      if (readret == 0 && output.pos == 0)
+	{
+	  if (zstdio->frame_end)
+	    return 0;
+	  grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		      N_("premature end of compressed"));
+	  return -1;
+	}
+
+      zstdio->saved_offset += output.pos;
+      zstdio->frame_end = (ret == 0);
+
+      /* Remember where the next frame starts, for later seeks.  */
+      if (zstdio->frame_end && !zstdio->complete
+	  && zstdio->saved_offset > zstdio->frame_out[zstdio->nframes - 1]
+	  && zstdio->inbuf_off + zstdio->in.pos < zstdio->file->size
+	  && !zstdio_add_frame (zstdio, zstdio->saved_offset,
+				zstdio->inbuf_off + zstdio->in.pos))
+	grub_errno = GRUB_ERR_NONE;
+    }
+
+  return output.pos;
+}
+
+/* Build the frame table by walking the frame and block headers.  This
+   stops at the first frame which doesn't record its decompressed size,
+   leaving the total size unknown; the rest of the table is filled in as
+   the data is decoded.  */
+static int
+zstdio_walk_frames (grub_zstdio_t zstdio, grub_off_t *total)
+{
+  grub_uint8_t hdr[ZSTD_FRAMEHEADERSIZE_MAX];
+  ZSTD_frameHeader fh;
+  grub_off_t pos = 0, size = zstdio->file->size;
+  grub_uint64_t out = 0;
+
+  while (pos < size)
+    {
+      grub_size_t n = ZSTD_FRAMEHEADERSIZE_MAX;
+
+      if (n > size - pos)
+	n = size - pos;
+      if (!zstdio_pread (zstdio, pos, hdr, n)
+	  || ZSTD_getFrameHeader (&fh, hdr, n) != 0)
+	return 0;
+
+      if (fh.frameType == ZSTD_skippableFrame)
+	{
+	  pos += ZSTD_skippableHeaderSize + fh.frameContentSize;
+	  continue;
+	}
+      if (!zstdio_add_frame (zstdio, out, pos))
+	return 0;
+
+      if (fh.frameContentSize == ZSTD_CONTENTSIZE_UNKNOWN)
+	{
+	  *total = GRUB_FILE_SIZE_UNKNOWN;
+	  return 1;
+	}
+
+      pos += fh.headerSize;
+      for (;;)
+	{
+	  grub_uint8_t bh[ZSTD_BLOCK_HEADER_SIZE];
+	  grub_uint32_t block;
+	  unsigned type;
+
+	  if (!zstdio_pread (zstdio, pos, bh, sizeof (bh)))
+	    return 0;
+	  block = bh[0] | (bh[1] << 8) | (bh[2] << 16);
+	  type = (block >> 1) & 3;
+	  if (type == ZSTD_BLOCK_RESERVED)
+	    return 0;
+	  pos += ZSTD_BLOCK_HEADER_SIZE
+	    + (type == ZSTD_BLOCK_RLE ? 1 : (block >> 3));
+	  if (block & 1)
+	    break;
+	}
+      if (fh.checksumFlag)
+	pos += 4;
+      out += fh.frameContentSize;
+    }
+
+  *total = out;
+  zstdio->complete = 1;
+  return pos == size;
+}
+
+/* Build the frame table from the seek table of the seekable format.  */
+static int
+zstdio_read_seek_table (grub_zstdio_t zstdio, grub_off_t *total)
+{
+  grub_uint8_t footer[ZSTD_SEEKABLE_FOOTER_SIZE];
+  grub_uint32_t hdr[2];
+  grub_uint32_t nframes, entry_size, i;
+  grub_uint64_t table_size, in = 0, out = 0;
+  grub_off_t size = zstdio->file->size;
+  grub_uint32_t *entries = NULL;
+  int ret = 0;
+
+  if (size < ZSTD_SEEKABLE_FOOTER_SIZE + sizeof (hdr)
+      || !zstdio_pread (zstdio, size - sizeof (footer), footer,
+			sizeof (footer))
+      || grub_get_unaligned32 (footer + 5)
+	 != grub_cpu_to_le32_compile_time (ZSTD_SEEKABLE_MAGIC)
+      || (footer[4] & ~ZSTD_SEEKABLE_CHECKSUM_FLAG))
+    return 0;
+
+  nframes = grub_le_to_cpu32 (grub_get_unaligned32 (footer));
+  entry_size = (footer[4] & ZSTD_SEEKABLE_CHECKSUM_FLAG) ? 12 : 8;
+  table_size = (grub_uint64_t) nframes * entry_size;
+  if (nframes == 0
+      || table_size + sizeof (hdr) + sizeof (footer) > size
+      || !zstdio_pread (zstdio, size - sizeof (footer) - table_size
+			- sizeof (hdr), hdr, sizeof (hdr))
+      || hdr[0] != grub_cpu_to_le32_compile_time (ZSTD_SEEKABLE_FRAME_MAGIC)
+      || grub_le_to_cpu32 (hdr[1]) != table_size + sizeof (footer))
+    return 0;
+
+  entries = grub_malloc (table_size);
+  if (!entries)
+    return 0;
+  if (!zstdio_pread (zstdio, size - sizeof (footer) - table_size,
+		     entries, table_size))
+    goto out;
+
+  for (i = 0; i < nframes; i++)
+    {
+      grub_uint32_t *e = entries + i * (entry_size / 4);
+
+      if (!zstdio_add_frame (zstdio, out, in))
+	goto out;
+      in += grub_le_to_cpu32 (e[0]);
+      out += grub_le_to_cpu32 (e[1]);
+    }
+
+  /* The frames must account for everything up to the seek table.  */
+  if (in == size - sizeof (footer) - table_size - sizeof (hdr))
+    {
+      *total = out;
+      zstdio->complete = 1;
+      ret = 1;
+    }
+
+ out:
+  grub_free (entries);
+  if (!ret)
+    zstdio->nframes = 0;
+  return ret;
+}
+
+static grub_file_t
+grub_zstdio_open (grub_file_t io, enum grub_file_type type)
+{
+  grub_file_t file;
+  grub_zstdio_t zstdio;
+  grub_uint32_t magic;
+  grub_off_t size;
+
+  if (type & GRUB_FILE_TYPE_NO_DECOMPRESS)
+    return io;
+
+  if (grub_file_tell (io) != 0)
+    grub_file_seek (io, 0);
+  if (grub_file_read (io, &magic, sizeof (magic)) != sizeof (magic)
+      || (magic != grub_cpu_to_le32_compile_time (ZSTD_MAGICNUMBER)
+	  && (grub_le_to_cpu32 (magic) & ~0xf) != ZSTD_MAGIC_SKIPPABLE_START))
+    {
+      grub_errno = GRUB_ERR_NONE;
+      grub_file_seek (io, 0);
+      return io;
+    }
+
+  file = (grub_file_t) grub_zalloc (sizeof (*file));
+  if (!file)
+    return 0;
+
+  zstdio = grub_zalloc (sizeof (*zstdio));
+  if (!zstdio)
+    {
+      grub_free (file);
+      return 0;
+    }
+
+  zstdio->file = io;
+  zstdio->inbuf_size = grub_file_filter_bufsize (io, ZSTDIO_BUFSIZ,
+					       ZSTDIO_INBUFSIZ_MAX);
+  zstdio->outbuf_size = ZSTD_DStreamOutSize ();
+  zstdio->inbuf = grub_malloc (zstdio->inbuf_size);
+  zstdio->outbuf = grub_malloc (zstdio->outbuf_size);
+  zstdio->dstream = ZSTD_createDStream ();
+  zstdio->in.src = zstdio->inbuf;
+
+  file->device = io->device;
+  file->data = zstdio;
+  file->fs = &grub_zstdio_fs;
+  file->not_easily_seekable = 1;
+
+  if (!zstdio->inbuf || !zstdio->outbuf || !zstdio->dstream)
+    goto fail;
+
+  /* Looking for the seek table or walking the headers means many small
+     reads all over the file, so on a not easily seekable file the table
+     is only built while decoding.  */
+  if (io->not_easily_seekable)
+    {
+      if (!zstdio_add_frame (zstdio, 0, 0))
+	goto fail;
+      size = GRUB_FILE_SIZE_UNKNOWN;
+    }
+  else if (!zstdio_read_seek_table (zstdio, &size)
+	   && !zstdio_walk_frames (zstdio, &size))
+    {
+      grub_error (GRUB_ERR_BAD_COMPRESSED_DATA,
+		  N_("zstd file corrupted or unsupported"));
+      goto fail;
+    }
+  file->size = size;
+
+  zstdio_seek_frame (zstdio, 0, 1);
+  return file;
+
+ fail:
+  ZSTD_freeDStream (zstdio->dstream);
+  grub_free (zstdio->inbuf);
+  grub_free (zstdio->outbuf);
+  grub_free (zstdio->frame_out);
+  grub_free (zstdio->frame_in);
+  grub_free (zstdio);
+  grub_free (file);
+  return 0;
+}
+
+static grub_ssize_t
+grub_zstdio_read (grub_file_t file, char *buf, grub_size_t len)
+{
+  grub_zstdio_t zstdio = file->data;
+  grub_off_t offset = file->offset;
+  grub_ssize_t ret = 0;
+  grub_ssize_t n;
+
+  /* Seeking backwards, or past the current frame, restarts at the frame
+     holding OFFSET.  */
+  if (offset < zstdio->saved_offset)
+    zstdio_seek_frame (zstdio, offset, 1);
+  else if (offset > zstdio->saved_offset)
+    zstdio_seek_frame (zstdio, offset, 0);
+
+  while (len > 0)
+    {
+      /* Once at OFFSET, decode straight into the caller's buffer.  */
+      if (zstdio->saved_offset == offset)
+	{
+	  n = zstdio_decode (zstdio, buf, len);
+	  if (n < 0)
+	    return -1;
+	  if (n == 0)
+	    break;
+	  buf += n;
+	  len -= n;
+	  ret += n;
+	  offset += n;
+	}
+      else
+	{
+	  grub_size_t skip = zstdio->outbuf_size;
+
+	  if (skip > offset - zstdio->saved_offset)
+	    skip = offset - zstdio->saved_offset;
+	  n = zstdio_decode (zstdio, zstdio->outbuf, skip);
+	  if (n < 0)
+	    return -1;
+	  if (n == 0)
+	    break;
+	}
+    }
+
+  /* Once the end has been seen, the size is known.  */
+  if (len > 0 && file->size == GRUB_FILE_SIZE_UNKNOWN)
+    file->size = zstdio->saved_offset;
+
+  return ret;
+}
+
+/* Release everything, including the underlying file object.  */
+static grub_err_t
+grub_zstdio_close (grub_file_t file)
+{
+  grub_zstdio_t zstdio = file->data;
+
+  ZSTD_freeDStream (zstdio->dstream);
+  grub_file_close (zstdio->file);
+  grub_free (zstdio->inbuf);
+  grub_free (zstdio->outbuf);
+  grub_free (zstdio->frame_out);
+  grub_free (zstdio->frame_in);
+  grub_free (zstdio);
+
+  /* Device must not be closed twice.  */
+  file->device = 0;
+  file->name = 0;
+  return grub_errno;
+}
+
+static struct grub_fs grub_zstdio_fs = {
+  .name = "zstdio",
+  .fs_dir = 0,
+  .fs_open = 0,
+  .fs_read = grub_zstdio_read,
+  .fs_close = grub_zstdio_close,
+  .fs_label = 0,
+  .next = 0
+};
+
+GRUB_MOD_INIT (zstdio)
+{
+  grub_file_filter_register (GRUB_FILE_FILTER_ZSTDIO, grub_zstdio_open);
+}
+
+GRUB_MOD_FINI (zstdio)
+{
+  grub_file_filter_unregister (GRUB_FILE_FILTER_ZSTDIO);
+}
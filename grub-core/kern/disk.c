@@ -24,6 +24,7 @@
 #include <grub/misc.h>
 #include <grub/time.h>
 #include <grub/file.h>
+#include <grub/fs.h>
 #include <grub/i18n.h>
 
 #define	GRUB_CACHE_TIMEOUT	2
@@ -31,28 +32,53 @@
 /* The last time the disk was used.  */
 static grub_uint64_t grub_last_time = 0;
 
-struct grub_disk_cache grub_disk_cache_table[GRUB_DISK_CACHE_NUM];
+static struct grub_disk_cache
+grub_disk_cache_default_table[GRUB_DISK_CACHE_SETS * GRUB_DISK_CACHE_WAYS];
+
+struct grub_disk_cache *grub_disk_cache_table = grub_disk_cache_default_table;
+unsigned grub_disk_cache_sets = GRUB_DISK_CACHE_SETS;
+
+/* Incremented on every cache access, used to find the least recently
+   used entry of a set.  */
+static grub_uint32_t grub_disk_cache_clock;
 
 void (*grub_disk_firmware_fini) (void);
 int grub_disk_firmware_is_tainted;
 
-#if DISK_CACHE_STATS
 static unsigned long grub_disk_cache_hits;
 static unsigned long grub_disk_cache_misses;
+static unsigned long grub_disk_cache_evictions;
+
+void
+grub_disk_cache_get_stats (struct grub_disk_cache_stats *stats)
+{
+  unsigned i;
+
+  stats->hits = grub_disk_cache_hits;
+  stats->misses = grub_disk_cache_misses;
+  stats->evictions = grub_disk_cache_evictions;
+  stats->sets = grub_disk_cache_sets;
+  stats->used = 0;
+  for (i = 0; i < grub_disk_cache_sets * GRUB_DISK_CACHE_WAYS; i++)
+    if (grub_disk_cache_table[i].data)
+      stats->used++;
+}
 
 void
-grub_disk_cache_get_performance (unsigned long *hits, unsigned long *misses)
+grub_disk_cache_reset_stats (void)
 {
-  *hits = grub_disk_cache_hits;
-  *misses = grub_disk_cache_misses;
+  grub_disk_cache_hits = 0;
+  grub_disk_cache_misses = 0;
+  grub_disk_cache_evictions = 0;
 }
-#endif
 
 grub_err_t (*grub_disk_write_weak) (grub_disk_t disk,
 				    grub_disk_addr_t sector,
 				    grub_off_t offset,
 				    grub_size_t size,
 				    const void *buf);
+unsigned long grub_disk_write_count;
+unsigned long grub_disk_change_count;
 #include "disk_common.c"
 
 void
@@ -60,7 +86,7 @@ grub_disk_cache_invalidate_all (void)
 {
   unsigned i;
 
-  for (i = 0; i < GRUB_DISK_CACHE_NUM; i++)
+  for (i = 0; i < grub_disk_cache_sets * GRUB_DISK_CACHE_WAYS; i++)
     {
       struct grub_disk_cache *cache = grub_disk_cache_table + i;
 
@@ -72,29 +98,79 @@ grub_disk_cache_invalidate_all (void)
     }
 }
 
+void
+grub_disk_changed (void)
+{
+  grub_disk_change_count++;
+  grub_disk_cache_invalidate_all ();
+  grub_fs_probe_cache_invalidate_all ();
+}
+
+grub_err_t
+grub_disk_cache_resize (unsigned sets)
+{
+  struct grub_disk_cache *table;
+
+  if (sets == 0)
+    return grub_error (GRUB_ERR_BAD_ARGUMENT, N_("invalid disk cache size"));
+
+  if (sets == grub_disk_cache_sets)
+    return GRUB_ERR_NONE;
+
+  if (sets == GRUB_DISK_CACHE_SETS)
+    table = grub_disk_cache_default_table;
+  else
+    {
+      table = grub_zalloc (sets * GRUB_DISK_CACHE_WAYS * sizeof (*table));
+      if (! table)
+	return grub_errno;
+    }
+
+  grub_disk_cache_invalidate_all ();
+  if (grub_disk_cache_table != grub_disk_cache_default_table)
+    grub_free (grub_disk_cache_table);
+  else
+    grub_memset (grub_disk_cache_default_table, 0,
+		 sizeof (grub_disk_cache_default_table));
+
+  grub_disk_cache_table = table;
+  grub_disk_cache_sets = sets;
+
+  return GRUB_ERR_NONE;
+}
+
+static struct grub_disk_cache *
+grub_disk_cache_find (unsigned long dev_id, unsigned long disk_id,
+		      grub_disk_addr_t sector)
+{
+  struct grub_disk_cache *cache;
+  unsigned i;
+
+  cache = grub_disk_cache_get_set (dev_id, disk_id, sector);
+  for (i = 0; i < GRUB_DISK_CACHE_WAYS; i++, cache++)
+    if (cache->data && cache->dev_id == dev_id && cache->disk_id == disk_id
+	&& cache->sector == sector)
+      return cache;
+
+  return 0;
+}
+
 static char *
 grub_disk_cache_fetch (unsigned long dev_id, unsigned long disk_id,
 		       grub_disk_addr_t sector)
 {
   struct grub_disk_cache *cache;
-  unsigned cache_index;
-
-  cache_index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + cache_index;
 
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector)
+  cache = grub_disk_cache_find (dev_id, disk_id, sector);
+  if (cache)
     {
       cache->lock = 1;
-#if DISK_CACHE_STATS
+      cache->last_used = ++grub_disk_cache_clock;
       grub_disk_cache_hits++;
-#endif
       return cache->data;
     }
 
-#if DISK_CACHE_STATS
   grub_disk_cache_misses++;
-#endif
 
   return 0;
 }
@@ -104,13 +180,9 @@ grub_disk_cache_unlock (unsigned long dev_id, unsigned long disk_id,
 			grub_disk_addr_t sector)
 {
   struct grub_disk_cache *cache;
-  unsigned cache_index;
 
-  cache_index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + cache_index;
-
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector)
+  cache = grub_disk_cache_find (dev_id, disk_id, sector);
+  if (cache)
     cache->lock = 0;
 }
 
@@ -118,31 +190,59 @@ static grub_err_t
 grub_disk_cache_store (unsigned long dev_id, unsigned long disk_id,
 		       grub_disk_addr_t sector, const char *data)
 {
-  unsigned cache_index;
-  struct grub_disk_cache *cache;
+  struct grub_disk_cache *cache, *victim = 0;
+  unsigned i;
+
+  /* Reuse the entry already holding this sector, so that the set never
+     has two copies of it.  Leave that entry alone if it is in use.  */
+  victim = grub_disk_cache_find (dev_id, disk_id, sector);
+  if (victim && victim->lock)
+    return GRUB_ERR_NONE;
 
-  cache_index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + cache_index;
+  /* Otherwise take a free entry, then the least recently used one.  */
+  if (! victim)
+    {
+      cache = grub_disk_cache_get_set (dev_id, disk_id, sector);
+      for (i = 0; i < GRUB_DISK_CACHE_WAYS; i++, cache++)
+	{
+	  if (cache->lock)
+	    continue;
+	  if (! victim || (victim->data && (! cache->data
+		|| (grub_uint32_t) (grub_disk_cache_clock - cache->last_used)
+		> (grub_uint32_t) (grub_disk_cache_clock - victim->last_used))))
+	    victim = cache;
+	}
+    }
 
-  cache->lock = 1;
-  grub_free (cache->data);
-  cache->data = 0;
-  cache->lock = 0;
+  if (! victim)
+    return GRUB_ERR_NONE;
 
-  cache->data = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
-  if (! cache->data)
+  if (victim->data)
+    {
+      if (victim->dev_id != dev_id || victim->disk_id != disk_id
+	  || victim->sector != sector)
+	grub_disk_cache_evictions++;
+      victim->lock = 1;
+      grub_free (victim->data);
+      victim->data = 0;
+      victim->lock = 0;
+    }
+
+  victim->data = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
+  if (! victim->data)
     return grub_errno;
 
-  grub_memcpy (cache->data, data,
+  grub_memcpy (victim->data, data,
 	       GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
-  cache->dev_id = dev_id;
-  cache->disk_id = disk_id;
-  cache->sector = sector;
+  victim->dev_id = dev_id;
+  victim->disk_id = disk_id;
+  victim->sector = sector;
+  victim->last_used = ++grub_disk_cache_clock;
 
   return GRUB_ERR_NONE;
 }
 
-
+
 
 grub_disk_dev_t grub_disk_dev_list;
 
@@ -318,7 +418,8 @@ grub_disk_read_small_real (grub_disk_t disk, grub_disk_addr_t sector,
 			   grub_off_t offset, grub_size_t size, void *buf)
 {
   char *data;
-  char *tmp_buf;
+  char *tmp_buf = 0;
+  unsigned blocks, i;
 
   /* Fetch the cache.  */
   data = grub_disk_cache_fetch (disk->dev->id, disk->id, sector);
@@ -331,8 +432,37 @@ grub_disk_read_small_real (grub_disk_t disk, grub_disk_addr_t sector,
       return GRUB_ERR_NONE;
     }
 
+  /* Read ahead the uncached blocks following this one when the access
+     pattern is sequential, all in one request.  */
+  blocks = 1;
+  while (blocks < disk->ra_window && blocks < disk->max_agglomerate
+	 && ! grub_disk_cache_find (disk->dev->id, disk->id,
+				    sector + (blocks << GRUB_DISK_CACHE_BITS)))
+    blocks++;
+  if (disk->total_sectors != GRUB_DISK_SIZE_UNKNOWN)
+    {
+      grub_disk_addr_t total;
+
+      total = disk->total_sectors << (disk->log_sector_size
+				      - GRUB_DISK_SECTOR_BITS);
+      while (blocks > 1
+	     && sector + (blocks << GRUB_DISK_CACHE_BITS) > total)
+	blocks--;
+    }
+
   /* Allocate a temporary buffer.  */
-  tmp_buf = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
+  if (blocks > 1)
+    {
+      tmp_buf = grub_malloc (blocks << (GRUB_DISK_SECTOR_BITS
+					+ GRUB_DISK_CACHE_BITS));
+      if (! tmp_buf)
+	{
+	  grub_errno = GRUB_ERR_NONE;
+	  blocks = 1;
+	}
+    }
+  if (! tmp_buf)
+    tmp_buf = grub_malloc (GRUB_DISK_SECTOR_SIZE << GRUB_DISK_CACHE_BITS);
   if (! tmp_buf)
     return grub_errno;
 
@@ -343,16 +473,19 @@ grub_disk_read_small_real (grub_disk_t disk, grub_disk_addr_t sector,
     {
       grub_err_t err;
       err = (disk->dev->disk_read) (disk, transform_sector (disk, sector),
-				    1U << (GRUB_DISK_CACHE_BITS
-					   + GRUB_DISK_SECTOR_BITS
-					   - disk->log_sector_size), tmp_buf);
+				    blocks << (GRUB_DISK_CACHE_BITS
+					       + GRUB_DISK_SECTOR_BITS
+					       - disk->log_sector_size), tmp_buf);
       if (!err)
 	{
 	  /* Copy it and store it in the disk cache.  */
       if (buf)
         grub_memcpy (buf, tmp_buf + offset, size);
-	  grub_disk_cache_store (disk->dev->id, disk->id,
-				 sector, tmp_buf);
+	  for (i = 0; i < blocks; i++)
+	    grub_disk_cache_store (disk->dev->id, disk->id,
+				   sector + (i << GRUB_DISK_CACHE_BITS),
+				   tmp_buf + (i << (GRUB_DISK_CACHE_BITS
+						    + GRUB_DISK_SECTOR_BITS)));
 	  grub_free (tmp_buf);
 	  return GRUB_ERR_NONE;
 	}
@@ -411,11 +544,34 @@ grub_disk_read_small (grub_disk_t disk, grub_disk_addr_t sector,
   return GRUB_ERR_NONE;
 }
 
+/* Grow the read-ahead window of DISK while reads continue where the
+   previous one ended, and drop it on any other access.  */
+static void
+grub_disk_update_readahead (grub_disk_t disk, grub_disk_addr_t sector,
+			    grub_off_t offset, grub_size_t size, void *buf)
+{
+  grub_uint64_t pos = (sector << GRUB_DISK_SECTOR_BITS) + offset;
+
+  if (buf && pos == disk->ra_next)
+    {
+      if (disk->ra_window == 0)
+	disk->ra_window = 2;
+      else if (disk->ra_window < GRUB_DISK_READAHEAD_MAX)
+	disk->ra_window <<= 1;
+    }
+  else
+    disk->ra_window = 0;
+
+  disk->ra_next = pos + size;
+}
+
 /* Read data from the disk.  */
 grub_err_t
 grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 		grub_off_t offset, grub_size_t size, void *buf)
 {
+  int streaming;
+
   /* First of all, check if the region is within the disk.  */
   if (grub_disk_adjust_range (disk, &sector, &offset, size) != GRUB_ERR_NONE)
     {
@@ -426,6 +582,12 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
       return grub_errno;
     }
 
+  grub_disk_update_readahead (disk, sector, offset, size, buf);
+
+  /* Long sequential streams are not worth caching: they would only
+     evict blocks that are going to be used again.  */
+  streaming = (disk->ra_window >= GRUB_DISK_READAHEAD_MAX);
+
   /* First read until first cache boundary.   */
   if (offset || (sector & (GRUB_DISK_CACHE_SIZE - 1)))
     {
@@ -495,7 +657,7 @@ grub_disk_read (grub_disk_t disk, grub_disk_addr_t sector,
 					buf);
 	  if (err)
 	    return err;
-	  if (buf)
+	  if (buf && ! streaming)
     {
 	  for (i = 0; i < agglomerate; i ++)
 	    grub_disk_cache_store (disk->dev->id, disk->id,
@@ -55,11 +55,15 @@ transform_sector (grub_disk_t disk, grub_disk_addr_t sector)
   return sector >> (disk->log_sector_size - GRUB_DISK_SECTOR_BITS);
 }
 
-static unsigned
-grub_disk_cache_get_index (unsigned long dev_id, unsigned long disk_id,
-			   grub_disk_addr_t sector)
+/* Return the first entry of the cache set holding SECTOR.  */
+static struct grub_disk_cache *
+grub_disk_cache_get_set (unsigned long dev_id, unsigned long disk_id,
+			 grub_disk_addr_t sector)
 {
-  return ((dev_id * 524287UL + disk_id * 2606459UL
-	   + ((unsigned) (sector >> GRUB_DISK_CACHE_BITS)))
-	  % GRUB_DISK_CACHE_NUM);
+  unsigned set;
+
+  set = ((dev_id * 524287UL + disk_id * 2606459UL
+	  + ((unsigned) (sector >> GRUB_DISK_CACHE_BITS)))
+	 % grub_disk_cache_sets);
+  return grub_disk_cache_table + set * GRUB_DISK_CACHE_WAYS;
 }
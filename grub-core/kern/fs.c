@@ -33,6 +33,111 @@ grub_fs_t grub_fs_list = 0;
 
 grub_fs_autoload_hook_t grub_fs_autoload_hook = 0;
 
+#ifndef GRUB_UTIL
+/* Results of grub_fs_probe, keyed like the disk cache by device, disk and
+   partition offset.  A cached result stays valid until something is written
+   through GRUB or the list of filesystems changes, so that repeated device
+   listings, search and probe don't re-run every driver on every partition.
+   A NULL FS records that no driver recognised the partition.  */
+#define GRUB_FS_PROBE_CACHE_SIZE	32
+
+struct grub_fs_probe_cache
+{
+  unsigned long dev_id;
+  unsigned long disk_id;
+  grub_disk_addr_t start;
+  grub_disk_addr_t total_sectors;
+  unsigned long write_count;
+  grub_fs_t fs;
+  int valid;
+};
+
+static struct grub_fs_probe_cache
+grub_fs_probe_cache_table[GRUB_FS_PROBE_CACHE_SIZE];
+static unsigned grub_fs_probe_cache_next;
+
+static struct grub_fs_probe_cache *
+grub_fs_probe_cache_find (grub_disk_t disk)
+{
+  grub_disk_addr_t start = grub_partition_get_start (disk->partition);
+  unsigned i;
+
+  for (i = 0; i < GRUB_FS_PROBE_CACHE_SIZE; i++)
+    {
+      struct grub_fs_probe_cache *cache = grub_fs_probe_cache_table + i;
+
+      if (cache->valid
+	  && cache->dev_id == disk->dev->id
+	  && cache->disk_id == disk->id
+	  && cache->start == start)
+	{
+	  if (cache->write_count != grub_disk_write_count
+	      || cache->total_sectors != disk->total_sectors)
+	    {
+	      cache->valid = 0;
+	      return 0;
+	    }
+	  return cache;
+	}
+    }
+  return 0;
+}
+
+static void
+grub_fs_probe_cache_store (grub_disk_t disk, grub_fs_t fs)
+{
+  struct grub_fs_probe_cache *cache;
+
+  cache = grub_fs_probe_cache_find (disk);
+  if (! cache)
+    {
+      cache = grub_fs_probe_cache_table + grub_fs_probe_cache_next;
+      grub_fs_probe_cache_next = ((grub_fs_probe_cache_next + 1)
+				  % GRUB_FS_PROBE_CACHE_SIZE);
+    }
+  cache->dev_id = disk->dev->id;
+  cache->disk_id = disk->id;
+  cache->start = grub_partition_get_start (disk->partition);
+  cache->total_sectors = disk->total_sectors;
+  cache->write_count = grub_disk_write_count;
+  cache->fs = fs;
+  cache->valid = 1;
+}
+#endif
+
+void
+grub_fs_probe_cache_invalidate_all (void)
+{
+#ifndef GRUB_UTIL
+  unsigned i;
+
+  for (i = 0; i < GRUB_FS_PROBE_CACHE_SIZE; i++)
+    grub_fs_probe_cache_table[i].valid = 0;
+#endif
+}
+
+int
+grub_fs_probe_cached (grub_device_t device, grub_fs_t *fs)
+{
+#ifndef GRUB_UTIL
+  struct grub_fs_probe_cache *cache;
+
+  if (device->disk)
+    {
+      cache = grub_fs_probe_cache_find (device->disk);
+      if (cache)
+	{
+	  *fs = cache->fs;
+	  return 1;
+	}
+    }
+#else
+  (void) device;
+  (void) fs;
+#endif
+  return 0;
+}
+
 /* Helper for grub_fs_probe.  */
 static int
 probe_dummy_iter (const char *filename __attribute__ ((unused)),
@@ -52,6 +157,14 @@ grub_fs_probe (grub_device_t device)
       /* Make it sure not to have an infinite recursive calls.  */
       static int count = 0;
 
+      if (grub_fs_probe_cached (device, &p))
+	{
+	  if (p)
+	    return p;
+	  grub_error (GRUB_ERR_UNKNOWN_FS, N_("unknown filesystem"));
+	  return 0;
+	}
+
       for (p = grub_fs_list; p; p = p->next)
 	{
 	  grub_dprintf ("fs", "Detecting %s...\n", p->name);
@@ -73,7 +186,12 @@ grub_fs_probe (grub_device_t device)
 #endif
 	    (p->fs_dir) (device, "/", probe_dummy_iter, NULL);
 	  if (grub_errno == GRUB_ERR_NONE)
-	    return p;
+	    {
+#ifndef GRUB_UTIL
+	      grub_fs_probe_cache_store (device->disk, p);
+#endif
+	      return p;
+	    }
 
 	  grub_error_push ();
 	  grub_dprintf ("fs", "%s detection failed.\n", p->name);
@@ -99,6 +217,9 @@ grub_fs_probe (grub_device_t device)
 	      if (grub_errno == GRUB_ERR_NONE)
 		{
 		  count--;
+#ifndef GRUB_UTIL
+		  grub_fs_probe_cache_store (device->disk, p);
+#endif
 		  return p;
 		}
 
@@ -114,6 +235,12 @@ grub_fs_probe (grub_device_t device)
 
 	  count--;
 	}
+
+#ifndef GRUB_UTIL
+      /* Every driver, including any autoloaded ones, has rejected it.  */
+      if (count == 0)
+	grub_fs_probe_cache_store (device->disk, 0);
+#endif
     }
   else if (device->net && device->net->fs)
     return device->net->fs;
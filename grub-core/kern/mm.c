@@ -28,6 +28,9 @@
   - multiple regions may be used as free space. They may not be
   contiguous.
 
+  - the heap can grow: when no region has room for a block, the platform
+  may be asked for more memory through grub_mm_add_region_fn.
+
   Regions are managed by a singly linked list, and the meta information is
   stored in the beginning of each region. Space after the meta information
   is used to allocate memory.
@@ -56,6 +59,16 @@
   For safety, both allocated blocks and free ones are marked by magic
   numbers. Whenever anything unexpected is detected, GRUB aborts the
   operation.
+
+  Allocations of up to 2 KiB without special alignment are not taken from
+  the rings directly. They are rounded up to a power of two and served from
+  slabs, blocks allocated from the rings which are cut into objects of one
+  size class. Each object has a header cell like any allocated block, so
+  grub_realloc and friends work the same on it, but allocating and freeing
+  an object only pops and pushes the free list of its slab. Slabs with free
+  objects are kept on a list per size class, and a slab that becomes empty
+  is returned to the ring unless it is the last one with free objects in
+  its class.
  */
 
 #include <config.h>
@@ -79,6 +92,44 @@
 
 
 grub_mm_region_t grub_mm_base;
+grub_mm_add_region_func_t grub_mm_add_region_fn;
+
+/* Usage counters, see grub_mm_get_stats.  */
+static grub_size_t mm_in_use, mm_peak;
+static grub_size_t mm_allocs[GRUB_MM_STAT_BUCKETS];
+
+#ifdef MM_DEBUG
+/* Call sites of grub_debug_* by file and line, hashed.  Slot 0 collects
+   allocations made without a call site and those which didn't fit.  */
+#define MM_SITES	256
+
+static struct grub_mm_site_info mm_sites[MM_SITES];
+#endif
+
+static void grub_real_free (grub_mm_header_t p, grub_mm_region_t r);
+
+/* Space taken in a new region besides the block itself: the region
+   descriptor, its alignment and the block header.  */
+#define GRUB_MM_MGMT_OVERHEAD \
+  (sizeof (struct grub_mm_region) + 2 * GRUB_MM_ALIGN)
+
+/* Slab size classes.  PARTIAL lists the slabs which have free objects, full
+   slabs are only reachable from their objects.  */
+static struct
+{
+  grub_mm_slab_t partial;
+  grub_size_t slabs;
+  grub_size_t objects;
+  grub_size_t inuse;
+} slab_classes[GRUB_MM_SLAB_CLASSES];
+
+/* Cells taken by the slab descriptor.  */
+#define SLAB_HEADER_CELLS \
+  ((sizeof (struct grub_mm_slab) + GRUB_MM_ALIGN - 1) >> GRUB_MM_ALIGN_LOG2)
+
+/* A slab spans at least SLAB_MIN_SIZE bytes and SLAB_MIN_OBJECTS objects.  */
+#define SLAB_MIN_SIZE		0x1000
+#define SLAB_MIN_OBJECTS	8
 
 /* Get a header from the pointer PTR, and set *P and *R to a pointer
    to the header and a pointer to its region, respectively. PTR must
@@ -98,9 +149,11 @@ get_header_from_pointer (void *ptr, grub_mm_header_t *p, grub_mm_region_t *r)
     grub_fatal ("out of range pointer %p", ptr);
 
   *p = (grub_mm_header_t) ptr - 1;
-  if ((*p)->magic == GRUB_MM_FREE_MAGIC)
+  if ((*p)->magic == GRUB_MM_FREE_MAGIC
+      || (*p)->magic == GRUB_MM_SLAB_FREE_MAGIC)
     grub_fatal ("double free at %p", *p);
-  if ((*p)->magic != GRUB_MM_ALLOC_MAGIC)
+  if ((*p)->magic != GRUB_MM_ALLOC_MAGIC
+      && (*p)->magic != GRUB_MM_SLAB_ALLOC_MAGIC)
     grub_fatal ("alloc magic is broken at %p: %lx", *p,
 		(unsigned long) (*p)->magic);
 }
@@ -141,7 +194,7 @@ grub_mm_init_region (void *addr, grub_size_t size)
 	    r->size += h->size << GRUB_MM_ALIGN_LOG2;
 	    r->pre_size &= (GRUB_MM_ALIGN - 1);
 	    *p = r;
-	    grub_free (h + 1);
+	    grub_real_free (h, r);
 	  }
 	*p = r;
 	return;
@@ -314,12 +367,14 @@ grub_real_malloc (grub_mm_header_t *first, grub_size_t n, grub_size_t align)
   return 0;
 }
 
-/* Allocate SIZE bytes with the alignment ALIGN and return the pointer.  */
-void *
-grub_memalign (grub_size_t align, grub_size_t size)
+/* Allocate SIZE bytes with the alignment ALIGN from the rings and return the
+   pointer.  */
+static void *
+grub_real_memalign (grub_size_t align, grub_size_t size)
 {
   grub_mm_region_t r;
   grub_size_t n = ((size + GRUB_MM_ALIGN - 1) >> GRUB_MM_ALIGN_LOG2) + 1;
+  grub_size_t grow;
   int count = 0;
 
   if (!grub_mm_base)
@@ -334,6 +389,9 @@ grub_memalign (grub_size_t align, grub_size_t size)
   if ((size + align) > ~(grub_size_t) 0x100000)
     goto fail;
 
+  /* What a new region needs to hold this block wherever it lands.  */
+  grow = size + align + GRUB_MM_MGMT_OVERHEAD;
+
   align = (align >> GRUB_MM_ALIGN_LOG2);
   if (align == 0)
     align = 1;
@@ -358,8 +416,29 @@ grub_memalign (grub_size_t align, grub_size_t size)
       count++;
       goto again;
 
-#if 0
     case 1:
+      /* Ask the platform for a region large enough for the block.  */
+      count++;
+      if (grub_mm_add_region_fn
+	  && grub_mm_add_region_fn (grow, GRUB_MM_ADD_REGION_CONSECUTIVE)
+	     == GRUB_ERR_NONE)
+	goto again;
+      grub_errno = GRUB_ERR_NONE;
+      /* Fallthrough.  */
+
+    case 2:
+      /* Take whatever it can give.  Memory right below an existing
+	 region is merged into it, so the block may fit after all.  */
+      count++;
+      if (grub_mm_add_region_fn
+	  && grub_mm_add_region_fn (grow, GRUB_MM_ADD_REGION_NONE)
+	     == GRUB_ERR_NONE)
+	goto again;
+      grub_errno = GRUB_ERR_NONE;
+      break;
+
+#if 0
+    case 3:
       /* Unload unneeded modules.  */
       grub_dl_unload_unneeded ();
       count++;
@@ -375,6 +454,282 @@ grub_memalign (grub_size_t align, grub_size_t size)
   return 0;
 }
 
+static void
+slab_link (grub_mm_slab_t s)
+{
+  s->prev = 0;
+  s->next = slab_classes[s->cls].partial;
+  if (s->next)
+    s->next->prev = s;
+  slab_classes[s->cls].partial = s;
+}
+
+static void
+slab_unlink (grub_mm_slab_t s)
+{
+  if (s->prev)
+    s->prev->next = s->next;
+  else
+    slab_classes[s->cls].partial = s->next;
+  if (s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+/* Allocate a new slab for the size class CLS and put it on the partial
+   list.  */
+static grub_mm_slab_t
+slab_new (grub_size_t cls)
+{
+  grub_size_t cells = ((grub_size_t) 1 << cls) + 1;
+  grub_size_t total, i;
+  grub_mm_slab_t s;
+  grub_mm_header_t p;
+
+  /* The slab block has a header cell of its own.  */
+  total = ((SLAB_MIN_SIZE >> GRUB_MM_ALIGN_LOG2) - SLAB_HEADER_CELLS - 1)
+    / cells;
+  if (total < SLAB_MIN_OBJECTS)
+    total = SLAB_MIN_OBJECTS;
+
+  s = grub_real_memalign (0, (SLAB_HEADER_CELLS + total * cells)
+			  << GRUB_MM_ALIGN_LOG2);
+  if (! s)
+    return 0;
+
+  s->cls = cls;
+  s->inuse = 0;
+  s->total = total;
+  s->free = 0;
+
+  /* Chain the objects so that they are handed out in address order.  */
+  p = (grub_mm_header_t) s + SLAB_HEADER_CELLS + (total - 1) * cells;
+  for (i = 0; i < total; i++, p -= cells)
+    {
+      p->size = cells;
+      p->magic = GRUB_MM_SLAB_FREE_MAGIC;
+      p->next = s->free;
+      s->free = p;
+    }
+
+  slab_link (s);
+  slab_classes[cls].slabs++;
+  slab_classes[cls].objects += total;
+  return s;
+}
+
+/* Allocate SIZE bytes, which is at most GRUB_MM_SLAB_MAX, from a slab.  */
+static void *
+slab_alloc (grub_size_t size)
+{
+  grub_size_t cls = 0;
+  grub_mm_slab_t s;
+  grub_mm_header_t p;
+
+  while ((grub_size_t) GRUB_MM_ALIGN << cls < size)
+    cls++;
+
+  s = slab_classes[cls].partial;
+  if (! s)
+    {
+      s = slab_new (cls);
+      if (! s)
+	return 0;
+    }
+
+  p = s->free;
+  if (p->magic != GRUB_MM_SLAB_FREE_MAGIC)
+    grub_fatal ("slab free magic is broken at %p: 0x%x", p, p->magic);
+
+  s->free = p->next;
+  p->next = (grub_mm_header_t) s;
+  p->magic = GRUB_MM_SLAB_ALLOC_MAGIC;
+  slab_classes[cls].inuse++;
+  if (++s->inuse == s->total)
+    slab_unlink (s);
+
+  return p + 1;
+}
+
+/* Return the slab object whose header is P to its slab.  */
+static void
+slab_free (grub_mm_header_t p)
+{
+  grub_mm_slab_t s = (grub_mm_slab_t) p->next;
+  grub_mm_region_t r;
+
+  if (((grub_mm_header_t) s - 1)->magic != GRUB_MM_ALLOC_MAGIC
+      || s->cls >= GRUB_MM_SLAB_CLASSES || ! s->inuse)
+    grub_fatal ("slab is broken at %p", s);
+
+  if (s->inuse == s->total)
+    slab_link (s);
+
+  p->magic = GRUB_MM_SLAB_FREE_MAGIC;
+  p->next = s->free;
+  s->free = p;
+  s->inuse--;
+  slab_classes[s->cls].inuse--;
+
+  /* Keep one slab per class around so that a single allocation and free
+     in a loop doesn't carve and release a slab each time.  */
+  if (s->inuse == 0 && (s->prev || s->next))
+    {
+      slab_unlink (s);
+      slab_classes[s->cls].slabs--;
+      slab_classes[s->cls].objects -= s->total;
+      get_header_from_pointer (s, &p, &r);
+      grub_real_free (p, r);
+    }
+}
+
+#ifdef MM_DEBUG
+static unsigned
+mm_site_get (grub_mm_header_t p)
+{
+  grub_uint32_t site;
+
+  grub_memcpy (&site, p->padding, sizeof (site));
+  return site < MM_SITES ? site : 0;
+}
+
+static void
+mm_site_set (grub_mm_header_t p, grub_uint32_t site)
+{
+  grub_memcpy (p->padding, &site, sizeof (site));
+}
+
+/* Find or add the slot of FILE:LINE.  */
+static unsigned
+mm_site_lookup (const char *file, int line)
+{
+  unsigned hash = line, i, site;
+  const char *c;
+
+  for (c = file; *c; c++)
+    hash = hash * 31 + *c;
+
+  for (i = 0; i < MM_SITES - 1; i++)
+    {
+      site = 1 + (hash + i) % (MM_SITES - 1);
+      if (! mm_sites[site].file)
+	{
+	  mm_sites[site].file = file;
+	  mm_sites[site].line = line;
+	  return site;
+	}
+      if (mm_sites[site].line == line
+	  && grub_strcmp (mm_sites[site].file, file) == 0)
+	return site;
+    }
+  return 0;
+}
+
+/* Charge the block at PTR, fresh from grub_memalign or grub_realloc, to
+   FILE:LINE instead of the site it was charged to.  */
+static void
+mm_site_attribute (void *ptr, const char *file, int line)
+{
+  grub_mm_header_t p = (grub_mm_header_t) ptr - 1;
+  grub_size_t bytes = p->size << GRUB_MM_ALIGN_LOG2;
+  unsigned old = mm_site_get (p), site;
+
+  site = mm_site_lookup (file, line);
+  if (site == old)
+    return;
+
+  mm_sites[old].in_use -= grub_min (mm_sites[old].in_use, bytes);
+  if (old == 0 && mm_sites[0].allocs)
+    mm_sites[0].allocs--;
+
+  mm_sites[site].allocs++;
+  mm_sites[site].in_use += bytes;
+  if (mm_sites[site].in_use > mm_sites[site].peak)
+    mm_sites[site].peak = mm_sites[site].in_use;
+  mm_site_set (p, site);
+}
+#endif
+
+/* Account the block at PTR, allocated for SIZE bytes.  */
+static void
+mm_account_alloc (void *ptr, grub_size_t size)
+{
+  grub_mm_header_t p = (grub_mm_header_t) ptr - 1;
+  grub_size_t bytes = p->size << GRUB_MM_ALIGN_LOG2;
+  unsigned bucket = 0;
+
+  while (bucket < GRUB_MM_STAT_BUCKETS - 1
+	 && ((grub_size_t) GRUB_MM_STAT_BUCKET_MIN << bucket) < size)
+    bucket++;
+  mm_allocs[bucket]++;
+
+  mm_in_use += bytes;
+  if (mm_in_use > mm_peak)
+    mm_peak = mm_in_use;
+
+#ifdef MM_DEBUG
+  mm_site_set (p, 0);
+  mm_sites[0].allocs++;
+  mm_sites[0].in_use += bytes;
+  if (mm_sites[0].in_use > mm_sites[0].peak)
+    mm_sites[0].peak = mm_sites[0].in_use;
+#endif
+}
+
+/* Account the release of the block with header P.  Blocks the relocator
+   hands back were never accounted, hence the clamping.  */
+static void
+mm_account_free (grub_mm_header_t p)
+{
+  grub_size_t bytes = p->size << GRUB_MM_ALIGN_LOG2;
+
+  mm_in_use -= grub_min (mm_in_use, bytes);
+
+#ifdef MM_DEBUG
+  {
+    unsigned site = mm_site_get (p);
+    mm_sites[site].in_use -= grub_min (mm_sites[site].in_use, bytes);
+  }
+#endif
+}
+
+/* Allocate SIZE bytes with the alignment ALIGN and return the pointer.  */
+void *
+grub_memalign (grub_size_t align, grub_size_t size)
+{
+  void *p = 0;
+
+  if (size && size <= GRUB_MM_SLAB_MAX && align <= GRUB_MM_ALIGN
+      && grub_mm_base)
+    {
+      p = slab_alloc (size);
+
+      /* There may still be room for the object alone.  */
+      if (! p)
+	grub_errno = GRUB_ERR_NONE;
+    }
+
+  if (! p)
+    p = grub_real_memalign (align, size);
+
+  if (p)
+    mm_account_alloc (p, size);
+  return p;
+}
+
+int
+grub_mm_slab_info (unsigned cls, struct grub_mm_slab_info *info)
+{
+  if (cls >= GRUB_MM_SLAB_CLASSES)
+    return 0;
+
+  info->size = (grub_size_t) GRUB_MM_ALIGN << cls;
+  info->slabs = slab_classes[cls].slabs;
+  info->objects = slab_classes[cls].objects;
+  info->inuse = slab_classes[cls].inuse;
+  return 1;
+}
+
 /* Allocate SIZE bytes and return the pointer.  */
 void *
 grub_malloc (grub_size_t size)
@@ -395,18 +750,10 @@ grub_zalloc (grub_size_t size)
   return ret;
 }
 
-/* Deallocate the pointer PTR.  */
-void
-grub_free (void *ptr)
+/* Return the allocated block with header P to the ring of its region R.  */
+static void
+grub_real_free (grub_mm_header_t p, grub_mm_region_t r)
 {
-  grub_mm_header_t p;
-  grub_mm_region_t r;
-
-  if (! ptr)
-    return;
-
-  get_header_from_pointer (ptr, &p, &r);
-
   if (r->first->magic == GRUB_MM_ALLOC_MAGIC)
     {
       p->magic = GRUB_MM_FREE_MAGIC;
@@ -465,6 +812,78 @@ grub_free (void *ptr)
     }
 }
 
+/* Deallocate the pointer PTR.  */
+void
+grub_free (void *ptr)
+{
+  grub_mm_header_t p;
+  grub_mm_region_t r;
+
+  if (! ptr)
+    return;
+
+  get_header_from_pointer (ptr, &p, &r);
+  mm_account_free (p);
+
+  if (p->magic == GRUB_MM_SLAB_ALLOC_MAGIC)
+    slab_free (p);
+  else
+    grub_real_free (p, r);
+}
+
+void
+grub_mm_get_stats (struct grub_mm_stats *stats)
+{
+  grub_mm_region_t r;
+  unsigned i;
+
+  grub_memset (stats, 0, sizeof (*stats));
+  stats->in_use = mm_in_use;
+  stats->peak = mm_peak;
+  for (i = 0; i < GRUB_MM_STAT_BUCKETS; i++)
+    stats->allocs[i] = mm_allocs[i];
+
+  for (r = grub_mm_base; r; r = r->next)
+    {
+      grub_mm_header_t p;
+
+      stats->heap_size += r->size;
+
+      /* A full region has no ring.  */
+      if (r->first->magic != GRUB_MM_FREE_MAGIC)
+	continue;
+
+      p = r->first;
+      do
+	{
+	  grub_size_t bytes = p->size << GRUB_MM_ALIGN_LOG2;
+
+	  stats->free += bytes;
+	  if (bytes > stats->largest_free)
+	    stats->largest_free = bytes;
+	  p = p->next;
+	}
+      while (p != r->first);
+    }
+}
+
+void
+grub_mm_reset_stats (void)
+{
+  unsigned i;
+
+  mm_peak = mm_in_use;
+  for (i = 0; i < GRUB_MM_STAT_BUCKETS; i++)
+    mm_allocs[i] = 0;
+#ifdef MM_DEBUG
+  for (i = 0; i < MM_SITES; i++)
+    {
+      mm_sites[i].allocs = 0;
+      mm_sites[i].peak = mm_sites[i].in_use;
+    }
+#endif
+}
+
 /* Reallocate SIZE bytes and return the pointer. The contents will be
    the same as that of PTR.  */
 void *
@@ -504,6 +923,18 @@ grub_realloc (void *ptr, grub_size_t size)
 #ifdef MM_DEBUG
 int grub_mm_debug = 0;
 
+int
+grub_mm_site_info (unsigned i, struct grub_mm_site_info *info)
+{
+  if (i >= MM_SITES)
+    return 0;
+
+  *info = mm_sites[i];
+  if (i == 0)
+    info->file = "(unknown)";
+  return 1;
+}
+
 void
 grub_mm_dump_free (void)
 {
@@ -530,6 +961,24 @@ grub_mm_dump_free (void)
   grub_printf ("\n");
 }
 
+/* Return the slab held by the allocated block P, or NULL if P is not a
+   slab.  */
+static grub_mm_slab_t
+mm_dump_slab (grub_mm_header_t p)
+{
+  grub_mm_slab_t s = (grub_mm_slab_t) (p + 1);
+  grub_mm_header_t first = (grub_mm_header_t) s + SLAB_HEADER_CELLS;
+
+  if (s->cls >= GRUB_MM_SLAB_CLASSES
+      || p->size != 1 + SLAB_HEADER_CELLS
+		    + s->total * (((grub_size_t) 1 << s->cls) + 1))
+    return 0;
+  if (first->magic != GRUB_MM_SLAB_ALLOC_MAGIC
+      && first->magic != GRUB_MM_SLAB_FREE_MAGIC)
+    return 0;
+  return s;
+}
+
 void
 grub_mm_dump (unsigned lineno)
 {
@@ -538,7 +987,9 @@ grub_mm_dump (unsigned lineno)
   grub_printf ("called at line %u\n", lineno);
   for (r = grub_mm_base; r; r = r->next)
     {
-      grub_mm_header_t p;
+      grub_mm_header_t p, q;
+      grub_mm_slab_t s;
+      grub_size_t i, cells;
 
       for (p = (grub_mm_header_t) ALIGN_UP ((grub_addr_t) (r + 1),
 					    GRUB_MM_ALIGN);
@@ -553,6 +1004,17 @@ grub_mm_dump (unsigned lineno)
 	      break;
 	    case GRUB_MM_ALLOC_MAGIC:
 	      grub_printf ("A:%p:%u\n", p, (unsigned int) p->size << GRUB_MM_ALIGN_LOG2);
+	      s = mm_dump_slab (p);
+	      if (! s)
+		break;
+	      /* List the objects in use in the slab, then skip it.  */
+	      q = (grub_mm_header_t) s + SLAB_HEADER_CELLS;
+	      cells = ((grub_size_t) 1 << s->cls) + 1;
+	      for (i = 0; i < s->total; i++, q += cells)
+		if (q->magic == GRUB_MM_SLAB_ALLOC_MAGIC)
+		  grub_printf ("S:%p:%u\n", q,
+			       (unsigned int) q->size << GRUB_MM_ALIGN_LOG2);
+	      p += p->size - 1;
 	      break;
 	    }
 	}
@@ -571,6 +1033,8 @@ grub_debug_malloc (const char *file, int line, grub_size_t size)
   ptr = grub_malloc (size);
   if (grub_mm_debug)
     grub_printf ("%p\n", ptr);
+  if (ptr)
+    mm_site_attribute (ptr, file, line);
   return ptr;
 }
 
@@ -584,6 +1048,8 @@ grub_debug_zalloc (const char *file, int line, grub_size_t size)
   ptr = grub_zalloc (size);
   if (grub_mm_debug)
     grub_printf ("%p\n", ptr);
+  if (ptr)
+    mm_site_attribute (ptr, file, line);
   return ptr;
 }
 
@@ -598,11 +1064,16 @@ grub_debug_free (const char *file, int line, void *ptr)
 void *
 grub_debug_realloc (const char *file, int line, void *ptr, grub_size_t size)
 {
+  void *old = ptr;
+
   if (grub_mm_debug)
     grub_printf ("%s:%d: realloc (%p, 0x%" PRIxGRUB_SIZE ") = ", file, line, ptr, size);
   ptr = grub_realloc (ptr, size);
   if (grub_mm_debug)
     grub_printf ("%p\n", ptr);
+  /* A block kept in place stays with the site which allocated it.  */
+  if (ptr && ptr != old)
+    mm_site_attribute (ptr, file, line);
   return ptr;
 }
 
@@ -618,6 +1089,8 @@ grub_debug_memalign (const char *file, int line, grub_size_t align,
   ptr = grub_memalign (align, size);
   if (grub_mm_debug)
     grub_printf ("%p\n", ptr);
+  if (ptr)
+    mm_site_attribute (ptr, file, line);
   return ptr;
 }
 
@@ -20,7 +20,14 @@
 #include <grub/types.h>
 #include <grub/lib/crc.h>
 
-static grub_uint32_t crc32c_table [256];
+#if defined (__i386__) || defined (__x86_64__)
+#include <grub/i386/cpuid.h>
+#define CRC32C_SSE42 1
+#endif
+
+/* Slicing-by-8 tables: crc32c_table[0] is the usual byte-at-a-time table,
+   crc32c_table[k] advances a byte through k more zero bytes.  */
+static grub_uint32_t crc32c_table [8][256];
 
 /* Helper for init_crc32c_table.  */
 static grub_uint32_t
@@ -47,30 +54,126 @@ init_crc32c_table (void)
 
   for(i = 0; i < 256; i++)
     {
-      crc32c_table[i] = reflect(i, 8) << 24;
+      crc32c_table[0][i] = reflect(i, 8) << 24;
       for (j = 0; j < 8; j++)
-        crc32c_table[i] = (crc32c_table[i] << 1) ^
-            (crc32c_table[i] & (1 << 31) ? polynomial : 0);
-      crc32c_table[i] = reflect(crc32c_table[i], 32);
+        crc32c_table[0][i] = (crc32c_table[0][i] << 1) ^
+            (crc32c_table[0][i] & (1 << 31) ? polynomial : 0);
+      crc32c_table[0][i] = reflect(crc32c_table[0][i], 32);
+    }
+
+  for (j = 1; j < 8; j++)
+    for (i = 0; i < 256; i++)
+      crc32c_table[j][i] = (crc32c_table[j - 1][i] >> 8)
+	^ crc32c_table[0][crc32c_table[j - 1][i] & 0xff];
+}
+
+/* Portable version, eight bytes per step.  Bytes are loaded one by one so
+   that it works regardless of endianness and alignment.  */
+static grub_uint32_t
+crc32c_slice8 (grub_uint32_t crc, const grub_uint8_t *data, grub_size_t size)
+{
+  if (! crc32c_table[0][1])
+    init_crc32c_table ();
+
+  for (; size >= 8; size -= 8, data += 8)
+    {
+      crc ^= data[0] | (data[1] << 8) | (data[2] << 16)
+	| ((grub_uint32_t) data[3] << 24);
+      crc = crc32c_table[7][crc & 0xff]
+	^ crc32c_table[6][(crc >> 8) & 0xff]
+	^ crc32c_table[5][(crc >> 16) & 0xff]
+	^ crc32c_table[4][crc >> 24]
+	^ crc32c_table[3][data[4]]
+	^ crc32c_table[2][data[5]]
+	^ crc32c_table[1][data[6]]
+	^ crc32c_table[0][data[7]];
     }
+
+  for (; size; size--)
+    crc = (crc >> 8) ^ crc32c_table[0][(crc & 0xff) ^ *data++];
+
+  return crc;
+}
+
+#ifdef CRC32C_SSE42
+/* -1 until the CPU has been checked.  */
+static int crc32c_have_sse42 = -1;
+
+static int
+check_sse42 (void)
+{
+  grub_uint32_t a, b, c, d;
+
+  if (! grub_cpu_is_cpuid_supported ())
+    return 0;
+  grub_cpuid (0, a, b, c, d);
+  if (a < 1)
+    return 0;
+  grub_cpuid (1, a, b, c, d);
+  /* SSE4.2, which brings the crc32 instruction.  */
+  return !! (c & (1 << 20));
+}
+
+/* The crc32 instruction only uses general purpose registers, so this is
+   safe even where the firmware hasn't enabled SSE.  */
+static grub_uint32_t
+crc32c_sse42 (grub_uint32_t crc, const grub_uint8_t *data, grub_size_t size)
+{
+  for (; size && ((grub_addr_t) data & 7); size--, data++)
+    asm ("crc32b %1, %0" : "+r" (crc) : "rm" (*data));
+
+#ifdef __x86_64__
+  {
+    grub_uint64_t crc64 = crc;
+
+    for (; size >= 8; size -= 8, data += 8)
+      asm ("crc32q %1, %0" : "+r" (crc64)
+	   : "rm" (*(const grub_uint64_t *) data));
+    crc = crc64;
+  }
+#else
+  for (; size >= 4; size -= 4, data += 4)
+    asm ("crc32l %1, %0" : "+r" (crc)
+	 : "rm" (*(const grub_uint32_t *) data));
+#endif
+
+  for (; size; size--, data++)
+    asm ("crc32b %1, %0" : "+r" (crc) : "rm" (*data));
+
+  return crc;
+}
+#endif
+
+#ifdef GRUB_UTIL
+void
+grub_crc32c_force_portable (int force)
+{
+#ifdef CRC32C_SSE42
+  crc32c_have_sse42 = force ? 0 : -1;
+#else
+  (void) force;
+#endif
 }
+#endif
 
 grub_uint32_t
 grub_getcrc32c (grub_uint32_t crc, const void *buf, int size)
 {
-  int i;
   const grub_uint8_t *data = buf;
 
-  if (! crc32c_table[1])
-    init_crc32c_table ();
+  if (size <= 0)
+    return crc;
 
   crc^= 0xffffffff;
 
-  for (i = 0; i < size; i++)
-    {
-      crc = (crc >> 8) ^ crc32c_table[(crc & 0xFF) ^ *data];
-      data++;
-    }
+#ifdef CRC32C_SSE42
+  if (crc32c_have_sse42 < 0)
+    crc32c_have_sse42 = check_sse42 ();
+  if (crc32c_have_sse42)
+    crc = crc32c_sse42 (crc, data, size);
+  else
+#endif
+    crc = crc32c_slice8 (crc, data, size);
 
   return crc ^ 0xffffffff;
 }
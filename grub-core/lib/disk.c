@@ -34,21 +34,21 @@ static void
 grub_disk_cache_invalidate (unsigned long dev_id, unsigned long disk_id,
 			    grub_disk_addr_t sector)
 {
-  unsigned cache_index;
   struct grub_disk_cache *cache;
+  unsigned i;
 
   sector &= ~((grub_disk_addr_t) GRUB_DISK_CACHE_SIZE - 1);
-  cache_index = grub_disk_cache_get_index (dev_id, disk_id, sector);
-  cache = grub_disk_cache_table + cache_index;
-
-  if (cache->dev_id == dev_id && cache->disk_id == disk_id
-      && cache->sector == sector && cache->data)
-    {
-      cache->lock = 1;
-      grub_free (cache->data);
-      cache->data = 0;
-      cache->lock = 0;
-    }
+  cache = grub_disk_cache_get_set (dev_id, disk_id, sector);
+
+  for (i = 0; i < GRUB_DISK_CACHE_WAYS; i++, cache++)
+    if (cache->dev_id == dev_id && cache->disk_id == disk_id
+	&& cache->sector == sector && cache->data)
+      {
+	cache->lock = 1;
+	grub_free (cache->data);
+	cache->data = 0;
+	cache->lock = 0;
+      }
 }
 
 grub_err_t
@@ -60,6 +60,8 @@ grub_disk_write (grub_disk_t disk, grub_disk_addr_t sector,
 
   grub_dprintf ("disk", "Writing `%s'...\n", disk->name);
 
+  grub_disk_write_count++;
+
   if (grub_disk_adjust_range (disk, &sector, &offset, size) != GRUB_ERR_NONE)
     return grub_errno;
 
@@ -170,6 +170,167 @@ perform_quick_sort (void *buf_to_sort, const grub_size_t count,
   return;
 }
 
+/**
+  Worker function for merge sorting.  Sorts buf_to_sort using tmp, which
+  has room for count elements, as scratch space.
+
+  @param[in, out] buf_to_sort   on call a buf of (possibly sorted) elements
+                                 on return a buffer of sorted elements
+  @param[in] count               the number of elements in the buffer to sort
+  @param[in] element_size         Size of an element in bytes
+  @param[in] compare_function     The function to call to perform the comparison
+                                 of any 2 elements
+  @param[in] tmp                 scratch buffer of count elements
+**/
+static void
+merge_sort_worker (grub_uint8_t *buf_to_sort, const grub_size_t count,
+                   const grub_size_t element_size,
+                   sort_compare compare_function, grub_uint8_t *tmp)
+{
+  grub_size_t half;
+  grub_size_t left;
+  grub_size_t right;
+  grub_size_t out;
+
+  if (count < 2)
+    return;
+
+  half = count / 2;
+  merge_sort_worker (buf_to_sort, half, element_size, compare_function, tmp);
+  merge_sort_worker (buf_to_sort + half * element_size, count - half,
+                     element_size, compare_function, tmp);
+
+  //
+  // Nothing to do if the two halves are already in order
+  //
+  if (compare_function (buf_to_sort + (half - 1) * element_size,
+                        buf_to_sort + half * element_size) <= 0)
+    return;
+
+  //
+  // Merge into tmp, taking from the left half on ties to stay stable
+  //
+  left = 0;
+  right = half;
+  for (out = 0; out < count; out++)
+  {
+    if (right >= count ||
+        (left < half &&
+         compare_function (buf_to_sort + left * element_size,
+                           buf_to_sort + right * element_size) <= 0))
+    {
+      grub_memcpy (tmp + out * element_size,
+                   buf_to_sort + left * element_size, element_size);
+      left++;
+    }
+    else
+    {
+      grub_memcpy (tmp + out * element_size,
+                   buf_to_sort + right * element_size, element_size);
+      right++;
+    }
+  }
+  grub_memcpy (buf_to_sort, tmp, count * element_size);
+}
+
+/**
+  Function to perform a stable Merge Sort on a buffer of comparable elements.
+
+  Each element must be equal sized.  Takes O(n log n) comparisons in the
+  worst case, and n - 1 for an already sorted buffer.  Falls back to
+  perform_quick_sort if the scratch buffer cannot be allocated.
+
+  if buf_to_sort is NULL, then assert.
+  if compare_function is NULL, then assert.
+
+  if count is < 2 then perform no action.
+  if Size is < 1 then perform no action.
+
+  @param[in, out] buf_to_sort   on call a buf of (possibly sorted) elements
+                                 on return a buffer of sorted elements
+  @param[in] count               the number of elements in the buffer to sort
+  @param[in] element_size         Size of an element in bytes
+  @param[in] compare_function     The function to call to perform the comparison
+                                 of any 2 elements
+**/
+void
+perform_merge_sort (void *buf_to_sort, const grub_size_t count,
+                    const grub_size_t element_size,
+                    sort_compare compare_function)
+{
+  void *tmp;
+
+  if (count < 2 || element_size < 1)
+    return;
+  assert (buf_to_sort != NULL);
+  assert (compare_function != NULL);
+  if (count > GRUB_SIZE_MAX / element_size)
+    tmp = NULL;
+  else
+    tmp = grub_malloc (count * element_size);
+  if (!tmp)
+  {
+    grub_errno = GRUB_ERR_NONE;
+    perform_quick_sort (buf_to_sort, count, element_size, compare_function);
+    return;
+  }
+  merge_sort_worker (buf_to_sort, count, element_size, compare_function, tmp);
+  grub_free (tmp);
+}
+
+/**
+  Function to compare 2 strings in natural order, so that "file2" sorts
+  before "file10".  Runs of decimal digits compare by numeric value, and
+  everything else compares bytewise.
+
+  @param[in] s1                 First string to compare.
+  @param[in] s2                 Second string to compare.
+
+  @retval 0                     s1 equal to s2.
+  @retval <0                    s1 is less than s2.
+  @retval >0                    s1 is greater than s2.
+**/
+int
+natural_compare (const char *s1, const char *s2)
+{
+  const grub_uint8_t *p1 = (const grub_uint8_t *) s1;
+  const grub_uint8_t *p2 = (const grub_uint8_t *) s2;
+
+  while (*p1 && *p2)
+  {
+    if (grub_isdigit (*p1) && grub_isdigit (*p2))
+    {
+      const grub_uint8_t *d1, *d2;
+      grub_size_t n1, n2;
+
+      //
+      // Skip leading zeros, then a longer run of digits is larger
+      //
+      while (*p1 == '0')
+        p1++;
+      while (*p2 == '0')
+        p2++;
+      for (d1 = p1; grub_isdigit (*d1); d1++)
+        ;
+      for (d2 = p2; grub_isdigit (*d2); d2++)
+        ;
+      n1 = d1 - p1;
+      n2 = d2 - p2;
+      if (n1 != n2)
+        return n1 < n2 ? -1 : 1;
+      for (; p1 < d1; p1++, p2++)
+        if (*p1 != *p2)
+          return *p1 < *p2 ? -1 : 1;
+      continue;
+    }
+    if (*p1 != *p2)
+      return *p1 < *p2 ? -1 : 1;
+    p1++;
+    p2++;
+  }
+  return (int) *p1 - (int) *p2;
+}
+
 /**
   Function to compare 2 strings.
 
@@ -45,6 +45,20 @@
 #define PRIMARY_PART_HEADER_LBA 1
 #define VDISK_MEDIA_ID 0x1
 
+/* --mem images are loaded in chunks of this size */
+#define VDISK_PRELOAD_CHUNK (4 << 20)
+/* minimum interval between progress updates, in ms */
+#define VDISK_PRELOAD_INTERVAL 500
+
+#define VCACHE_BLOCK_SHIFT 16
+#define VCACHE_BLOCK_SIZE (1 << VCACHE_BLOCK_SHIFT)
+#define VCACHE_WAYS 4
+/* maximum read-ahead, in blocks */
+#define VCACHE_READAHEAD 8
+
+#define VOVERLAY_CHUNK_SHIFT 12
+#define VOVERLAY_CHUNK_SIZE (1 << VOVERLAY_CHUNK_SHIFT)
+
 extern grub_packed_guid_t VDISK_GUID;
 
 enum disk_type
@@ -60,6 +74,7 @@ enum disk_type
 struct map_private_data
 {
   grub_efi_boolean_t mem;
+  grub_efi_uintn_t cache; /* block cache size in bytes */
   grub_efi_boolean_t pause;
   enum disk_type type;
   grub_efi_boolean_t disk;
@@ -87,14 +102,26 @@ typedef struct
 extern struct map_private_data *cmd;
 extern vdisk_t vdisk;
 extern vdisk_t vpart;
-void file_read (grub_efi_boolean_t disk, void *file,
-                void *buf, grub_efi_uintn_t len, grub_efi_uint64_t offset);
+grub_efi_uintn_t file_read (grub_efi_boolean_t disk, void *file, void *buf,
+                            grub_efi_uintn_t len, grub_efi_uint64_t offset);
 grub_efi_uint64_t get_size (grub_efi_boolean_t disk, void *file);
 /* vblock */
 extern block_io_protocol_t blockio_template;
 /* vboot */
 grub_efi_handle_t vpart_boot (grub_efi_handle_t *part_handle);
 grub_efi_handle_t vdisk_boot (void);
+/* vcache */
+grub_efi_status_t vcache_init (grub_efi_boolean_t disk, void *file,
+                               grub_efi_uint64_t size,
+                               grub_efi_uintn_t cache_size);
+void vcache_read (grub_efi_boolean_t disk, void *file, void *buf,
+                  grub_efi_uintn_t len, grub_efi_uint64_t offset);
+/* voverlay */
+void voverlay_reset (void);
+void voverlay_read (void *buf, grub_efi_uintn_t len, grub_efi_uint64_t offset);
+grub_efi_status_t voverlay_write (grub_efi_boolean_t disk, void *file,
+                                  const void *buf, grub_efi_uintn_t len,
+                                  grub_efi_uint64_t offset);
 /* vdisk */
 grub_efi_status_t vdisk_install (grub_file_t file, grub_efi_boolean_t ro);
 /* vpart */
@@ -46,12 +46,18 @@
 /** Number of clusters */
 #define VDISK_CLUSTERS 0x03ffc000ULL /* Fill 2TB disk */
 
-/** Maximum number of virtual files
+/** Number of virtual files listed within each directory cluster
  *
- * The total number of files must be strictly less than the number of
- * sectors per cluster.
+ * This must be strictly less than the number of sectors per cluster.
  */
-#define VDISK_MAX_FILES (VDISK_CLUSTER_COUNT - 1)
+#define VDISK_DIR_FILES (VDISK_CLUSTER_COUNT - 1)
+
+/** Number of additional directory clusters listing further files */
+#define VDISK_EXTRA_CLUSTERS 6
+
+/** Maximum number of virtual files */
+#define VDISK_MAX_FILES \
+  (VDISK_DIR_FILES + (VDISK_EXTRA_CLUSTERS * VDISK_CLUSTER_COUNT))
 
 /** Maximum file size (in sectors) */
 #define VDISK_FILE_COUNT 0x800000UL /* max for 32-bit address space */
@@ -568,6 +574,26 @@ struct vfat_directory
 /** Microsoft directory LBA */
 #define VDISK_MICROSOFT_LBA (VDISK_VBR_LBA + VDISK_MICROSOFT_SECTOR)
 
+/*****************************************************************************
+ *
+ * Additional file directory entries
+ *
+ * These clusters follow the last directory cluster within every
+ * directory's cluster chain, and list files beyond the first
+ * VDISK_DIR_FILES with one file per sector.
+ *
+ *****************************************************************************
+ */
+
+/** First additional directory cluster */
+#define VDISK_EXTRA_CLUSTER 9
+
+/** First additional directory sector */
+#define VDISK_EXTRA_SECTOR VDISK_CLUSTER_SECTOR (VDISK_EXTRA_CLUSTER)
+
+/** First additional directory LBA */
+#define VDISK_EXTRA_LBA (VDISK_VBR_LBA + VDISK_EXTRA_SECTOR)
+
 /*****************************************************************************
  *
  * Files
@@ -609,7 +635,11 @@ struct vfat_file
          size_t len);
 };
 
-extern struct vfat_file vfat_files[VDISK_MAX_FILES];
+/** Virtual files, indexed by position on the virtual disk */
+extern struct vfat_file **vfat_files;
+
+/** Number of virtual files */
+extern unsigned int vfat_file_count;
 
 extern void vfat_read (uint64_t lba, unsigned int count, void *data);
 extern struct vfat_file *
@@ -72,8 +72,9 @@ blockio_read (block_io_protocol_t *this, grub_efi_uint32_t media_id,
   }
   else
   {
-    file_read (data->disk, data->file, buf, len,
-               data->addr + lba * data->media.block_size);
+    vcache_read (data->disk, data->file, buf, len,
+                 data->addr + lba * data->media.block_size);
+    voverlay_read (buf, len, data->addr + lba * data->media.block_size);
   }
   return GRUB_EFI_SUCCESS;
 }
@@ -117,7 +118,8 @@ blockio_write (block_io_protocol_t *this,
     grub_memcpy ((void *)(grub_efi_uintn_t)
                  (data->addr + lba * data->media.block_size), buf, len);
   else
-    return GRUB_EFI_WRITE_PROTECTED;
+    return voverlay_write (data->disk, data->file, buf, len,
+                           data->addr + lba * data->media.block_size);
 
   return GRUB_EFI_SUCCESS;
 }
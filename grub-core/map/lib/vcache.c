@@ -0,0 +1,250 @@
+ /*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2019  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <grub/efi/efi.h>
+#include <grub/efi/api.h>
+
+#include <private.h>
+#include <maplib.h>
+
+/*
+ * Bounded block cache in front of a file-backed vdisk.
+ *
+ * The image is split into VCACHE_BLOCK_SIZE blocks held in a
+ * VCACHE_WAYS-way set-associative table with LRU replacement.  Misses
+ * during sequential access read several blocks ahead in one request,
+ * and large requests bypass the cache entirely.
+ */
+
+struct vcache_entry
+{
+  grub_efi_uint64_t block;
+  grub_efi_uint32_t last_used;
+  grub_efi_uint8_t *data;
+};
+
+struct vcache
+{
+  grub_efi_boolean_t disk;
+  void *file;
+  grub_efi_uint64_t size;
+  grub_efi_uintn_t sets;
+  grub_efi_uint32_t clock;
+  /* block following the last miss, and current read-ahead window */
+  grub_efi_uint64_t next_block;
+  grub_efi_uintn_t window;
+  struct vcache_entry *entries;
+  /* staging buffer for read-ahead */
+  grub_efi_uint8_t *stage;
+  /* block data, allocated from firmware */
+  void *pool;
+};
+
+static struct vcache *vcache;
+
+#define VCACHE_INVALID ((grub_efi_uint64_t) -1)
+
+static void
+vcache_free (void)
+{
+  if (!vcache)
+    return;
+  if (vcache->pool)
+    grub_efi_free_pool (vcache->pool);
+  grub_free (vcache->entries);
+  grub_free (vcache);
+  vcache = NULL;
+}
+
+grub_efi_status_t
+vcache_init (grub_efi_boolean_t disk, void *file, grub_efi_uint64_t size,
+             grub_efi_uintn_t cache_size)
+{
+  grub_efi_status_t status;
+  grub_efi_uintn_t sets, i;
+
+  vcache_free ();
+
+  sets = cache_size / (VCACHE_BLOCK_SIZE * VCACHE_WAYS);
+  if (!sets)
+    return GRUB_EFI_SUCCESS;
+
+  vcache = grub_zalloc (sizeof (*vcache));
+  if (!vcache)
+    return GRUB_EFI_OUT_OF_RESOURCES;
+  vcache->entries = grub_zalloc (sets * VCACHE_WAYS
+                                 * sizeof (struct vcache_entry));
+  if (!vcache->entries)
+  {
+    vcache_free ();
+    return GRUB_EFI_OUT_OF_RESOURCES;
+  }
+
+  status = grub_efi_allocate_pool (GRUB_EFI_BOOT_SERVICES_DATA,
+                                   (sets * VCACHE_WAYS + VCACHE_READAHEAD)
+                                   * VCACHE_BLOCK_SIZE, &vcache->pool);
+  if (status != GRUB_EFI_SUCCESS)
+  {
+    vcache->pool = NULL;
+    vcache_free ();
+    return status;
+  }
+
+  vcache->disk = disk;
+  vcache->file = file;
+  vcache->size = size;
+  vcache->sets = sets;
+  vcache->next_block = VCACHE_INVALID;
+  vcache->stage = vcache->pool;
+  for (i = 0; i < sets * VCACHE_WAYS; i++)
+  {
+    vcache->entries[i].block = VCACHE_INVALID;
+    vcache->entries[i].data = (grub_efi_uint8_t *) vcache->pool
+                              + (VCACHE_READAHEAD + i) * VCACHE_BLOCK_SIZE;
+  }
+
+  grub_dprintf ("map", "VCACHE size=%lluKB\n", (unsigned long long)
+                ((sets * VCACHE_WAYS * VCACHE_BLOCK_SIZE) >> 10));
+  return GRUB_EFI_SUCCESS;
+}
+
+static struct vcache_entry *
+vcache_set (grub_efi_uint64_t block)
+{
+  grub_efi_uint64_t set;
+  grub_divmod64 (block, vcache->sets, &set);
+  return vcache->entries + set * VCACHE_WAYS;
+}
+
+static struct vcache_entry *
+vcache_find (grub_efi_uint64_t block)
+{
+  struct vcache_entry *entry = vcache_set (block);
+  grub_efi_uintn_t i;
+  for (i = 0; i < VCACHE_WAYS; i++, entry++)
+  {
+    if (entry->block == block)
+      return entry;
+  }
+  return NULL;
+}
+
+static struct vcache_entry *
+vcache_victim (grub_efi_uint64_t block)
+{
+  struct vcache_entry *entry = vcache_set (block);
+  struct vcache_entry *victim = entry;
+  grub_efi_uintn_t i;
+  for (i = 0; i < VCACHE_WAYS; i++, entry++)
+  {
+    if (entry->block == VCACHE_INVALID)
+      return entry;
+    if ((grub_efi_uint32_t) (vcache->clock - entry->last_used) >
+        (grub_efi_uint32_t) (vcache->clock - victim->last_used))
+      victim = entry;
+  }
+  return victim;
+}
+
+/* Read BLOCK and the blocks of the read-ahead window following it into
+   the staging buffer and the cache.  */
+static void
+vcache_fill (grub_efi_uint64_t block)
+{
+  struct vcache_entry *entry;
+  grub_efi_uint64_t offset = block << VCACHE_BLOCK_SHIFT;
+  grub_efi_uint64_t len;
+  grub_efi_uintn_t count, i;
+
+  if (block == vcache->next_block)
+  {
+    if (vcache->window < VCACHE_READAHEAD)
+      vcache->window++;
+  }
+  else
+    vcache->window = 1;
+
+  /* stop at the end of the image or at the first cached block */
+  for (count = 1; count < vcache->window; count++)
+  {
+    if (((block + count) << VCACHE_BLOCK_SHIFT) >= vcache->size ||
+        vcache_find (block + count))
+      break;
+  }
+  vcache->next_block = block + count;
+
+  len = count * VCACHE_BLOCK_SIZE;
+  if (offset + len > vcache->size)
+  {
+    len = vcache->size - offset;
+    grub_memset (vcache->stage + len, 0, count * VCACHE_BLOCK_SIZE - len);
+  }
+  file_read (vcache->disk, vcache->file, vcache->stage, len, offset);
+
+  for (i = 0; i < count; i++)
+  {
+    entry = vcache_victim (block + i);
+    grub_memcpy (entry->data, vcache->stage + i * VCACHE_BLOCK_SIZE,
+                 VCACHE_BLOCK_SIZE);
+    entry->block = block + i;
+    entry->last_used = ++vcache->clock;
+  }
+}
+
+void
+vcache_read (grub_efi_boolean_t disk, void *file, void *buf,
+             grub_efi_uintn_t len, grub_efi_uint64_t offset)
+{
+  struct vcache_entry *entry;
+  grub_efi_uint64_t block;
+  grub_efi_uintn_t skip, frag;
+
+  /* no cache, or a large streaming request that would only evict it */
+  if (!vcache || vcache->file != file ||
+      len >= VCACHE_READAHEAD * VCACHE_BLOCK_SIZE)
+  {
+    file_read (disk, file, buf, len, offset);
+    return;
+  }
+
+  while (len)
+  {
+    block = offset >> VCACHE_BLOCK_SHIFT;
+    skip = offset & (VCACHE_BLOCK_SIZE - 1);
+    frag = VCACHE_BLOCK_SIZE - skip;
+    if (frag > len)
+      frag = len;
+
+    entry = vcache_find (block);
+    if (entry)
+    {
+      entry->last_used = ++vcache->clock;
+      grub_memcpy (buf, entry->data + skip, frag);
+    }
+    else
+    {
+      vcache_fill (block);
+      grub_memcpy (buf, vcache->stage + skip, frag);
+    }
+
+    buf = (grub_efi_uint8_t *) buf + frag;
+    offset += frag;
+    len -= frag;
+  }
+}
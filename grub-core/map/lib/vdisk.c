@@ -19,6 +19,7 @@
 #include <grub/efi/efi.h>
 #include <grub/efi/api.h>
 #include <grub/msdos_partition.h>
+#include <grub/time.h>
 
 #include <private.h>
 #include <maplib.h>
@@ -48,6 +49,53 @@ check_image (void)
   }
 }
 
+/* Load the image into memory in aligned chunks, reporting throughput.
+   Compressed images are decompressed by the file filters as they are
+   streamed, so no full-size temporary read is needed.  */
+static grub_efi_boolean_t
+vdisk_preload (void)
+{
+  grub_efi_uint64_t offset, start, now, last = 0, rate, eta;
+  grub_efi_uintn_t len;
+
+  grub_errno = GRUB_ERR_NONE;
+  start = grub_get_time_ms ();
+  for (offset = 0; offset < vdisk.size; offset += len)
+  {
+    len = VDISK_PRELOAD_CHUNK;
+    if (len > vdisk.size - offset)
+      len = vdisk.size - offset;
+    if (file_read (cmd->disk, vdisk.file,
+                   (void *)(vdisk.addr + offset), len, offset) != len
+        || grub_errno)
+    {
+      grub_printf ("\nread error at offset %lld\n", (unsigned long long) offset);
+      return FALSE;
+    }
+
+    now = grub_get_time_ms ();
+    if (now - last < VDISK_PRELOAD_INTERVAL && offset + len < vdisk.size)
+      continue;
+    last = now;
+    if (now == start)
+      continue;
+    /* KiB per second */
+    rate = grub_divmod64 (((offset + len) >> 10) * 1000, now - start, 0);
+    if (!rate)
+      rate = 1;
+    eta = grub_divmod64 ((vdisk.size - offset - len) >> 10, rate, 0);
+    grub_printf ("\rLoading %lluMB / %lluMB  %llu.%02lluMB/s  ETA %llus   ",
+                 (unsigned long long) ((offset + len) >> 20),
+                 (unsigned long long) (vdisk.size >> 20),
+                 (unsigned long long) (rate >> 10),
+                 (unsigned long long) (((rate & 1023) * 100) >> 10),
+                 (unsigned long long) eta);
+    grub_refresh ();
+  }
+  grub_printf ("\n");
+  return TRUE;
+}
+
 grub_efi_status_t
 vdisk_install (grub_file_t file, grub_efi_boolean_t ro)
 {
@@ -84,11 +132,23 @@ vdisk_install (grub_file_t file, grub_efi_boolean_t ro)
       grub_printf ("out of memory\n");
       return GRUB_EFI_OUT_OF_RESOURCES;
     }
-    file_read (cmd->disk, vdisk.file,
-          (void *)vdisk.addr, (grub_efi_uintn_t)vdisk.size, 0);
+    if (!vdisk_preload ())
+    {
+      grub_efi_free_pool ((void *)vdisk.addr);
+      return GRUB_EFI_DEVICE_ERROR;
+    }
   }
   else
+  {
     vdisk.addr = 0;
+    voverlay_reset ();
+    if (cmd->cache)
+    {
+      status = vcache_init (cmd->disk, vdisk.file, vdisk.size, cmd->cache);
+      if (status != GRUB_EFI_SUCCESS)
+        grub_printf ("failed to allocate block cache\n");
+    }
+  }
 
   tmp_dp = grub_efi_create_device_node (HARDWARE_DEVICE_PATH, HW_VENDOR_DP,
                                         sizeof(grub_efi_vendor_device_path_t));
@@ -18,6 +18,7 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
@@ -31,7 +32,13 @@
 #endif
 
 /** Virtual files */
-struct vfat_file vfat_files[VDISK_MAX_FILES];
+struct vfat_file **vfat_files;
+
+/** Number of virtual files */
+unsigned int vfat_file_count;
+
+/** Number of allocated virtual file slots */
+static unsigned int vfat_file_alloc;
 
 /**
  * Read from virtual Master Boot Record
@@ -121,6 +128,7 @@ static void vfat_fat (uint64_t lba, unsigned int count, void *data)
   uint32_t start;
   uint32_t end;
   uint32_t file_end_marker;
+  unsigned int first;
   unsigned int i;
   /* Calculate window within FAT */
   start = ((lba - VDISK_FAT_LBA) * (VDISK_SECTOR_SIZE / sizeof (*next)));
@@ -138,21 +146,39 @@ static void vfat_fat (uint64_t lba, unsigned int count, void *data)
           VDISK_VBR_MEDIA);
     for (i = 1; i < (VDISK_SECTOR_SIZE / sizeof (*next)); i++)
       next[i] = VDISK_FAT_END_MARKER;
+
+    /* Chain every directory into the additional directory clusters,
+     * for as many of them as are needed to list all files.
+     */
+    if (vfat_file_count > VDISK_DIR_FILES)
+    {
+      for (i = VDISK_ROOT_CLUSTER; i < VDISK_EXTRA_CLUSTER; i++)
+        next[i] = VDISK_EXTRA_CLUSTER;
+      for (i = VDISK_EXTRA_CLUSTER; ((i - VDISK_EXTRA_CLUSTER + 1) *
+           VDISK_CLUSTER_COUNT) < (vfat_file_count - VDISK_DIR_FILES); i++)
+        next[i] = (i + 1);
+    }
   }
 
-  /* Add end-of-file markers, if applicable */
-  for (i = 0; i < VDISK_MAX_FILES; i++)
+  /* Add end-of-file markers, if applicable.  Each file's end marker
+   * lies within its own fixed cluster range, so only files whose
+   * range overlaps this window need to be considered.
+   */
+  if (end <= VDISK_FILE_CLUSTER (0))
+    return;
+  first = ((start > VDISK_FILE_CLUSTER (0)) ?
+           ((start - VDISK_FILE_CLUSTER (0)) / VDISK_FILE_CLUSTERS) : 0);
+  for (i = first; i < vfat_file_count; i++)
   {
-    if (vfat_files[i].read)
+    if (VDISK_FILE_CLUSTER (i) >= end)
+      break;
+    file_end_marker = (VDISK_FILE_CLUSTER (i) +
+            ((vfat_files[i]->xlen - 1) /
+              VDISK_CLUSTER_SIZE));
+    if ((file_end_marker >= start) &&
+         (file_end_marker < end))
     {
-      file_end_marker = (VDISK_FILE_CLUSTER (i) +
-              ((vfat_files[i].xlen - 1) /
-                VDISK_CLUSTER_SIZE));
-      if ((file_end_marker >= start) &&
-           (file_end_marker < end))
-      {
-        next[file_end_marker] = VDISK_FAT_END_MARKER;
-      }
+      next[file_end_marker] = VDISK_FAT_END_MARKER;
     }
   }
 }
@@ -419,11 +445,10 @@ vfat_dir_files (uint64_t lba, unsigned int count, void *data)
 
     /* Identify file */
     idx = VDISK_FILE_DIRENT_IDX (lba);
-    assert (idx < (sizeof (vfat_files) /
-         sizeof (vfat_files[0])));
-    file = &vfat_files[idx];
-    if (! file->read)
+    assert (idx < VDISK_DIR_FILES);
+    if (idx >= vfat_file_count)
       continue;
+    file = vfat_files[idx];
 
     /* Populate directory entry */
     vfat_directory_entry (dirent, file->name, file->xlen,
@@ -432,6 +457,42 @@ vfat_dir_files (uint64_t lba, unsigned int count, void *data)
   }
 }
 
+/**
+ * Read additional files from virtual directory
+ *
+ * @v lba    Starting LBA
+ * @v count    Number of blocks to read
+ * @v data    Data buffer
+ *
+ * Sectors beyond the last file are left empty, which terminates the
+ * directory.
+ */
+static void
+vfat_extra_files (uint64_t lba, unsigned int count, void *data)
+{
+  struct vfat_directory *dir;
+  struct vfat_file *file;
+  unsigned int idx;
+
+  for (; count; lba++, count--, data = (char *)data + VDISK_SECTOR_SIZE)
+  {
+    idx = (VDISK_DIR_FILES + (lba - VDISK_EXTRA_LBA));
+    if (idx >= vfat_file_count)
+    {
+      memset (data, 0, VDISK_SECTOR_SIZE);
+      continue;
+    }
+    file = vfat_files[idx];
+
+    /* Populate directory entry */
+    dir = data;
+    vfat_empty_dir (dir);
+    vfat_directory_entry (&dir->entry[VDISK_DIRENT_PER_SECTOR - 1],
+          file->name, file->xlen, VDISK_READ_ONLY,
+          VDISK_FILE_CLUSTER (idx));
+  }
+}
+
 /**
  * Read from virtual file (or empty space)
  *
@@ -449,7 +510,7 @@ static void vfat_file (uint64_t lba, unsigned int count, void *data)
   size_t patch_len;
 
   /* Construct file portion */
-  file = &vfat_files[VDISK_FILE_IDX (lba)];
+  file = vfat_files[VDISK_FILE_IDX (lba)];
   offset = VDISK_FILE_OFFSET (lba);
   len = (count * VDISK_SECTOR_SIZE);
 
@@ -512,7 +573,11 @@ struct vfat_region
     .build = vfat_dir_files,      \
   }
 
-/** Virtual disk regions */
+/** Virtual disk regions
+ *
+ * Must be sorted by starting LBA and must not overlap, since regions
+ * are located by binary search.
+ */
 static struct vfat_region vfat_regions[] =
 {
   VDISK_REGION ("MBR", vfat_mbr,
@@ -534,8 +599,37 @@ static struct vfat_region vfat_regions[] =
   VDISK_DIRECTORY_REGION ("EFI", vfat_efi, VDISK_EFI_LBA),
   VDISK_DIRECTORY_REGION ("Microsoft", vfat_microsoft,
          VDISK_MICROSOFT_LBA),
+  VDISK_REGION ("Extra files", vfat_extra_files,
+           VDISK_EXTRA_LBA, (VDISK_EXTRA_CLUSTERS * VDISK_CLUSTER_COUNT)),
 };
 
+/** Number of virtual disk regions */
+#define VDISK_REGIONS (sizeof (vfat_regions) / sizeof (vfat_regions[0]))
+
+/**
+ * Find virtual disk region
+ *
+ * @v lba    LBA
+ * @ret idx    Index of first region ending after this LBA
+ */
+static unsigned int
+vfat_find_region (uint64_t lba)
+{
+  unsigned int low = 0;
+  unsigned int high = VDISK_REGIONS;
+  unsigned int mid;
+
+  while (low < high)
+  {
+    mid = ((low + high) / 2);
+    if ((vfat_regions[mid].lba + vfat_regions[mid].count) <= lba)
+      low = (mid + 1);
+    else
+      high = mid;
+  }
+  return low;
+}
+
 /**
  * Read from virtual disk
  *
@@ -576,7 +670,7 @@ void vfat_read (uint64_t lba, unsigned int count, void *data)
         frag_end = file_end;
 
       /* Generate data from file */
-      if (file_idx < VDISK_MAX_FILES)
+      if ((unsigned int) file_idx < vfat_file_count)
       {
         //name = vfat_files[file_idx].name;
         build = vfat_file;
@@ -585,31 +679,27 @@ void vfat_read (uint64_t lba, unsigned int count, void *data)
     else
     {
       /* Truncate fragment to region boundaries */
-      for (i = 0; i < (sizeof (vfat_regions) /
-              sizeof (vfat_regions[0])); i++)
+      i = vfat_find_region (frag_start);
+      if (i < VDISK_REGIONS)
       {
         region = &vfat_regions[i];
         region_start = region->lba;
         region_end = (region_start + region->count);
-        /* Avoid crossing start of any region */
-        if ((frag_start < region_start) &&
-             (frag_end > region_start))
+        if (frag_start < region_start)
         {
-          frag_end = region_start;
+          /* Avoid crossing start of next region */
+          if (frag_end > region_start)
+            frag_end = region_start;
         }
-        /* Ignore unless we overlap with this region */
-        if ((frag_start >= region_end) ||
-             (frag_end <= region_start))
+        else
         {
-          continue;
+          /* Avoid crossing end of region */
+          if (frag_end > region_end)
+            frag_end = region_end;
+          /* Found a suitable region */
+          //name = region->name;
+          build = region->build;
         }
-        /* Avoid crossing end of region */
-        if (frag_end > region_end)
-          frag_end = region_end;
-        /* Found a suitable region */
-        //name = region->name;
-        build = region->build;
-        break;
       }
     }
     /* Generate data from this region */
@@ -643,13 +733,25 @@ vfat_add_file (const char *name, void *opaque, size_t len,
                 void (* read) (struct vfat_file *file,
                                void *data, size_t offset, size_t len))
 {
-  static unsigned int index = 0;
+  struct vfat_file **files;
   struct vfat_file *file;
   /* Sanity check */
-  if (index >= VDISK_MAX_FILES)
+  if (vfat_file_count >= VDISK_MAX_FILES)
     die ("Too many files\n");
+  /* Grow file table, if required */
+  if (vfat_file_count >= vfat_file_alloc)
+  {
+    vfat_file_alloc = (vfat_file_alloc ? (vfat_file_alloc * 2) : 16);
+    files = realloc (vfat_files, vfat_file_alloc * sizeof (*files));
+    if (! files)
+      die ("Out of memory\n");
+    vfat_files = files;
+  }
   /* Store file */
-  file = &vfat_files[index++];
+  file = calloc (1, sizeof (*file));
+  if (! file)
+    die ("Out of memory\n");
+  vfat_files[vfat_file_count++] = file;
   snprintf (file->name, sizeof (file->name), "%s", name);
   file->opaque = opaque;
   file->len = len;
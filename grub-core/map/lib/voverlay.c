@@ -0,0 +1,195 @@
+ /*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2019  Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <grub/efi/efi.h>
+#include <grub/efi/api.h>
+
+#include <private.h>
+#include <maplib.h>
+
+/*
+ * Sparse copy-on-write overlay for file-backed vdisks.
+ *
+ * Written data is kept in VOVERLAY_CHUNK_SIZE chunks indexed by a hash
+ * of their offset in the image; the backing file is never modified.
+ * Chunks are carved from firmware pool slabs allocated as needed, so
+ * memory use follows the amount of data written, not the image size.
+ */
+
+struct voverlay_chunk
+{
+  struct voverlay_chunk *next;
+  grub_efi_uint64_t index;
+  grub_efi_uint8_t data[VOVERLAY_CHUNK_SIZE];
+};
+
+struct voverlay_slab
+{
+  struct voverlay_slab *next;
+  grub_efi_uintn_t used;
+};
+
+#define VOVERLAY_SLAB_SIZE (1 << 20)
+#define VOVERLAY_HASH_SIZE 16384
+
+static struct voverlay_chunk **voverlay_hash;
+static struct voverlay_slab *voverlay_slabs;
+static grub_efi_uint64_t voverlay_chunks;
+
+void
+voverlay_reset (void)
+{
+  struct voverlay_slab *slab, *next;
+
+  for (slab = voverlay_slabs; slab; slab = next)
+  {
+    next = slab->next;
+    grub_efi_free_pool (slab);
+  }
+  voverlay_slabs = NULL;
+  voverlay_chunks = 0;
+  grub_free (voverlay_hash);
+  voverlay_hash = NULL;
+}
+
+static struct voverlay_chunk **
+voverlay_bucket (grub_efi_uint64_t index)
+{
+  return &voverlay_hash[(index * 2654435761U) % VOVERLAY_HASH_SIZE];
+}
+
+static struct voverlay_chunk *
+voverlay_find (grub_efi_uint64_t index)
+{
+  struct voverlay_chunk *chunk;
+
+  if (!voverlay_hash)
+    return NULL;
+  for (chunk = *voverlay_bucket (index); chunk; chunk = chunk->next)
+  {
+    if (chunk->index == index)
+      return chunk;
+  }
+  return NULL;
+}
+
+static struct voverlay_chunk *
+voverlay_alloc (grub_efi_uint64_t index)
+{
+  struct voverlay_chunk *chunk, **bucket;
+  struct voverlay_slab *slab = voverlay_slabs;
+
+  if (!voverlay_hash)
+  {
+    voverlay_hash = grub_zalloc (VOVERLAY_HASH_SIZE * sizeof (*voverlay_hash));
+    if (!voverlay_hash)
+      return NULL;
+  }
+
+  if (!slab ||
+      slab->used + sizeof (*chunk) > VOVERLAY_SLAB_SIZE)
+  {
+    if (grub_efi_allocate_pool (GRUB_EFI_BOOT_SERVICES_DATA,
+                                VOVERLAY_SLAB_SIZE, (void **) &slab)
+        != GRUB_EFI_SUCCESS)
+      return NULL;
+    slab->next = voverlay_slabs;
+    slab->used = ALIGN_UP (sizeof (*slab), 16);
+    voverlay_slabs = slab;
+  }
+
+  chunk = (struct voverlay_chunk *) ((grub_efi_uint8_t *) slab + slab->used);
+  slab->used += ALIGN_UP (sizeof (*chunk), 16);
+  bucket = voverlay_bucket (index);
+  chunk->index = index;
+  chunk->next = *bucket;
+  *bucket = chunk;
+  voverlay_chunks++;
+  return chunk;
+}
+
+/* Replace data read from the backing file with any overlaid chunks.  */
+void
+voverlay_read (void *buf, grub_efi_uintn_t len, grub_efi_uint64_t offset)
+{
+  struct voverlay_chunk *chunk;
+  grub_efi_uintn_t skip, frag;
+
+  if (!voverlay_chunks)
+    return;
+
+  while (len)
+  {
+    skip = offset & (VOVERLAY_CHUNK_SIZE - 1);
+    frag = VOVERLAY_CHUNK_SIZE - skip;
+    if (frag > len)
+      frag = len;
+    chunk = voverlay_find (offset >> VOVERLAY_CHUNK_SHIFT);
+    if (chunk)
+      grub_memcpy (buf, chunk->data + skip, frag);
+    buf = (grub_efi_uint8_t *) buf + frag;
+    offset += frag;
+    len -= frag;
+  }
+}
+
+grub_efi_status_t
+voverlay_write (grub_efi_boolean_t disk, void *file, const void *buf,
+                grub_efi_uintn_t len, grub_efi_uint64_t offset)
+{
+  struct voverlay_chunk *chunk;
+  grub_efi_uint64_t index, start, size;
+  grub_efi_uintn_t skip, frag, fill;
+
+  size = get_size (disk, file);
+  while (len)
+  {
+    index = offset >> VOVERLAY_CHUNK_SHIFT;
+    skip = offset & (VOVERLAY_CHUNK_SIZE - 1);
+    frag = VOVERLAY_CHUNK_SIZE - skip;
+    if (frag > len)
+      frag = len;
+    chunk = voverlay_find (index);
+    if (!chunk)
+    {
+      chunk = voverlay_alloc (index);
+      if (!chunk)
+        return GRUB_EFI_DEVICE_ERROR;
+      /* partial chunk: fetch the rest from the backing file,
+         zero-filling past the end of the image */
+      if (frag != VOVERLAY_CHUNK_SIZE)
+      {
+        start = index << VOVERLAY_CHUNK_SHIFT;
+        fill = VOVERLAY_CHUNK_SIZE;
+        if (start >= size)
+          fill = 0;
+        else if (size - start < fill)
+          fill = size - start;
+        if (fill)
+          vcache_read (disk, file, chunk->data, fill, start);
+        grub_memset (chunk->data + fill, 0, VOVERLAY_CHUNK_SIZE - fill);
+      }
+    }
+    grub_memcpy (chunk->data + skip, buf, frag);
+    buf = (const grub_efi_uint8_t *) buf + frag;
+    offset += frag;
+    len -= frag;
+  }
+  return GRUB_EFI_SUCCESS;
+}
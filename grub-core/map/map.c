@@ -43,10 +43,12 @@ GRUB_MOD_LICENSE ("GPLv3+");
 static const struct grub_arg_option options_map[] =
 {
   {"mem", 'm', 0, N_("Copy to RAM."), 0, 0},
+  {"cache", 'c', 0, N_("Cache recently used blocks in RAM."),
+    N_("SIZE_MB"), ARG_TYPE_INT},
   {"pause", 'p', 0, N_("Show info and wait for keypress."), 0, 0},
   {"type", 't', 0, N_("Specify the disk type."), N_("CD/HD/FD"), ARG_TYPE_STRING},
   {"disk", 'd', 0, N_("Map the entire disk."), 0, 0},
-  {"rw", 'w', 0, N_("Add write support for RAM disk."), 0, 0},
+  {"rw", 'w', 0, N_("Add write support for virtual disk."), 0, 0},
   {"nb", 'n', 0, N_("Don't boot virtual disk."), 0, 0},
   {"update", 'u', 0, N_("Update efidisk device mapping."), 0, 0},
   {0, 0, 0, 0, 0, 0}
@@ -55,6 +57,7 @@ static const struct grub_arg_option options_map[] =
 enum options_map
 {
   MAP_MEM,
+  MAP_CACHE,
   MAP_PAUSE,
   MAP_TYPE,
   MAP_DISK,
@@ -73,17 +76,21 @@ grub_packed_guid_t VDISK_GUID =
   { 0xaa, 0xed, 0x0b, 0x91, 0x9a, 0x46, 0xbf, 0x4b }
 };
 
-void
+grub_efi_uintn_t
 file_read (grub_efi_boolean_t disk, void *file, void *buf, grub_efi_uintn_t len, grub_efi_uint64_t offset)
 {
+  grub_ssize_t ret;
   if (!disk)
   {
     grub_file_seek (file, offset);
-    grub_file_read (file, buf, len);
+    ret = grub_file_read (file, buf, len);
+    return ret < 0 ? 0 : ret;
   }
   else
   {
-    grub_disk_read (file, 0, offset, len, buf);
+    if (grub_disk_read (file, 0, offset, len, buf))
+      return 0;
+    return len;
   }
 }
 
@@ -123,6 +130,7 @@ grub_cmd_map (grub_extcmd_context_t ctxt, int argc, char **args)
     grub_efidisk_fini ();
     grub_printf ("enumerate efidisk devices\n");
     grub_efidisk_init ();
+    grub_disk_changed ();
     return GRUB_ERR_NONE;
   }
 
@@ -133,6 +141,19 @@ grub_cmd_map (grub_extcmd_context_t ctxt, int argc, char **args)
   else
     map.mem = FALSE;
 
+  if (state[MAP_CACHE].set)
+  {
+    unsigned long size_mb = grub_strtoul (state[MAP_CACHE].arg, NULL, 0);
+    /* the size in bytes must fit in a UINTN */
+    if (grub_errno || !size_mb
+        || size_mb > ((grub_efi_uintn_t) -1 >> 20))
+      return grub_error (GRUB_ERR_BAD_ARGUMENT,
+                         N_("invalid cache size %s"), state[MAP_CACHE].arg);
+    map.cache = (grub_efi_uintn_t) size_mb << 20;
+  }
+  else
+    map.cache = 0;
+
   if (state[MAP_PAUSE].set)
     map.pause = TRUE;
   else
@@ -175,7 +196,8 @@ grub_cmd_map (grub_extcmd_context_t ctxt, int argc, char **args)
       map.type = FD;
   }
 
-  if (state[MAP_RW].set && state[MAP_MEM].set && map.type != CD)
+  /* without --mem, writes go to a copy-on-write overlay in RAM */
+  if (state[MAP_RW].set && map.type != CD)
     ro = FALSE;
 
   grub_efi_status_t status;
@@ -30,6 +30,97 @@
 #include <assert.h>
 #include <huffman.h>
 
+/**
+ * Calculate Huffman subtable index length
+ *
+ * @v alphabet    Huffman alphabet
+ * @v prefix    Lookup table index
+ * @ret bits    Subtable index length (in bits)
+ *
+ * The subtable must be large enough to index the longest symbol
+ * sharing this prefix.
+ */
+static unsigned int huffman_subtable_bits ( struct huffman_alphabet *alphabet,
+                                            unsigned int prefix ) {
+  struct huffman_symbols *sym;
+  unsigned int first;
+  unsigned int last;
+  unsigned int bits;
+
+  for ( bits = HUFFMAN_BITS ; bits > HUFFMAN_TABLE_BITS ; bits-- ) {
+    sym = &alphabet->huf[ bits - 1 ];
+    if ( ! sym->freq )
+      continue;
+    first = ( sym->start >> HUFFMAN_SUBTABLE_BITS );
+    last = ( ( sym->start + ( ( sym->freq - 1 ) << sym->shift ) ) >>
+             HUFFMAN_SUBTABLE_BITS );
+    if ( ( prefix >= first ) && ( prefix <= last ) )
+      return ( bits - HUFFMAN_TABLE_BITS );
+  }
+  return 0;
+}
+
+/**
+ * Construct Huffman lookup table
+ *
+ * @v alphabet    Huffman alphabet
+ * @v count    Number of symbols
+ *
+ * The alphabet must be complete.  Symbols are visited in order of
+ * increasing Huffman-coded value, so all symbols sharing a lookup
+ * table prefix are visited consecutively.
+ */
+static void huffman_table ( struct huffman_alphabet *alphabet,
+                            unsigned int count ) {
+  struct huffman_symbols *sym;
+  huffman_entry_t *table = alphabet->table;
+  huffman_entry_t *fill;
+  huffman_entry_t entry;
+  unsigned int next = ( 1 << HUFFMAN_TABLE_BITS );
+  unsigned int prefix = -1U;
+  unsigned int subbits = 0;
+  unsigned int first;
+  unsigned int code;
+  unsigned int bits;
+  unsigned int span;
+  unsigned int i;
+
+  for ( bits = 1 ; bits <= HUFFMAN_BITS ; bits++ ) {
+    sym = &alphabet->huf[ bits - 1 ];
+    first = ( sym->start >> sym->shift );
+    for ( code = first ; code < ( first + sym->freq ) ; code++ ) {
+      entry = ( ( sym->raw[code] << 8 ) | bits );
+
+      if ( bits <= HUFFMAN_TABLE_BITS ) {
+
+        /* Replicate across all matching lookup table entries */
+        span = ( HUFFMAN_TABLE_BITS - bits );
+        fill = &table[ code << span ];
+
+      } else {
+
+        /* Start a new subtable, if required */
+        if ( ( code >> ( bits - HUFFMAN_TABLE_BITS ) ) != prefix ) {
+          prefix = ( code >> ( bits - HUFFMAN_TABLE_BITS ) );
+          subbits = huffman_subtable_bits ( alphabet, prefix );
+          table[prefix] = ( ( next << 8 ) | HUFFMAN_LINK | subbits );
+          next += ( 1 << subbits );
+          assert ( next <= HUFFMAN_TABLE_SIZE ( count ) );
+        }
+
+        /* Replicate across all matching subtable entries */
+        span = ( subbits - ( bits - HUFFMAN_TABLE_BITS ) );
+        fill = &table[ ( table[prefix] >> 8 ) +
+                       ( ( code & ( ( 1 << ( bits - HUFFMAN_TABLE_BITS ) )
+                                    - 1 ) ) << span ) ];
+      }
+
+      for ( i = 0 ; i < ( 1U << span ) ; i++ )
+        fill[i] = entry;
+    }
+  }
+}
+
 /**
  * Construct Huffman alphabet
  *
@@ -46,7 +137,6 @@ int huffman_alphabet ( struct huffman_alphabet *alphabet,
   unsigned int bits;
   unsigned int raw;
   unsigned int adjustment;
-  unsigned int prefix;
   int empty;
   int complete;
 
@@ -101,9 +191,7 @@ int huffman_alphabet ( struct huffman_alphabet *alphabet,
     }
   }
 
-  /* Adjust Huffman-coded symbol table raw pointers and populate
-   * quick lookup table.
-   */
+  /* Adjust Huffman-coded symbol table raw pointers */
   for ( bits = 1 ; bits <= ( sizeof ( alphabet->huf ) /
            sizeof ( alphabet->huf[0] ) ) ; bits++ ) {
     sym = &alphabet->huf[ bits - 1 ];
@@ -112,12 +200,6 @@ int huffman_alphabet ( struct huffman_alphabet *alphabet,
     sym->raw -= sym->freq; /* Reset to first symbol */
     adjustment = ( sym->start >> sym->shift );
     sym->raw -= adjustment; /* Adjust for quick indexing */
-
-    /* Populate quick lookup table */
-    for ( prefix = ( sym->start >> HUFFMAN_QL_SHIFT ) ;
-          prefix < ( 1 << HUFFMAN_QL_BITS ) ; prefix++ ) {
-      alphabet->lookup[prefix] = ( bits - 1 );
-    }
   }
 
   /* Check that there are no invalid codes */
@@ -126,25 +208,8 @@ int huffman_alphabet ( struct huffman_alphabet *alphabet,
     return -1;
   }
 
-  return 0;
-}
+  /* Populate lookup table */
+  huffman_table ( alphabet, count );
 
-/**
- * Get Huffman symbol set
- *
- * @v alphabet    Huffman alphabet
- * @v huf    Raw input value (normalised to HUFFMAN_BITS bits)
- * @ret sym    Huffman symbol set
- */
-struct huffman_symbols * huffman_sym ( struct huffman_alphabet *alphabet,
-               unsigned int huf ) {
-  struct huffman_symbols *sym;
-  unsigned int lookup_index;
-
-  /* Find symbol set for this length */
-  lookup_index = ( huf >> HUFFMAN_QL_SHIFT );
-  sym = &alphabet->huf[ alphabet->lookup[ lookup_index ] ];
-  while ( huf < sym->start )
-    sym--;
-  return sym;
+  return 0;
 }
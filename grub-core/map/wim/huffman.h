@@ -35,14 +35,42 @@
 /** Raw huffman symbol */
 typedef uint16_t huffman_raw_symbol_t;
 
-/** Quick lookup length for a Huffman symbol (in bits)
+/** Lookup table index length (in bits)
  *
- * This is a policy decision.
+ * This is a policy decision.  Symbols no longer than this are decoded
+ * with a single table lookup; longer symbols require a second lookup
+ * within a subtable.
  */
-#define HUFFMAN_QL_BITS 7
+#define HUFFMAN_TABLE_BITS 10
 
-/** Quick lookup shift */
-#define HUFFMAN_QL_SHIFT ( HUFFMAN_BITS - HUFFMAN_QL_BITS )
+/** Subtable index length for the longest possible symbols (in bits) */
+#define HUFFMAN_SUBTABLE_BITS ( HUFFMAN_BITS - HUFFMAN_TABLE_BITS )
+
+/** A Huffman lookup table entry
+ *
+ * For a symbol, bits 31:8 hold the raw symbol value and bits 4:0 hold
+ * the Huffman-coded symbol length.  For a link to a subtable, bits
+ * 31:8 hold the subtable offset, HUFFMAN_LINK is set, and bits 4:0
+ * hold the subtable index length.
+ */
+typedef uint32_t huffman_entry_t;
+
+/** Lookup table entry is a link to a subtable */
+#define HUFFMAN_LINK 0x80
+
+/** Maximum size of lookup table for an alphabet
+ *
+ * @v count		Number of symbols
+ * @ret size		Number of lookup table entries
+ *
+ * A subtable with a k-bit index covers at least (k+1) symbols, and
+ * the ratio of entries to symbols is greatest for the largest
+ * possible subtables.
+ */
+#define HUFFMAN_TABLE_SIZE( count )					\
+	( ( 1 << HUFFMAN_TABLE_BITS ) +					\
+	  ( ( ( ( count ) / ( HUFFMAN_SUBTABLE_BITS + 1 ) ) + 1 ) <<	\
+	    HUFFMAN_SUBTABLE_BITS ) )
 
 /** A Huffman-coded set of symbols of a given length */
 struct huffman_symbols {
@@ -67,8 +95,12 @@ struct huffman_symbols {
 struct huffman_alphabet {
 	/** Huffman-coded symbol set for each length */
 	struct huffman_symbols huf[HUFFMAN_BITS];
-	/** Quick lookup table */
-	uint8_t lookup[ 1 << HUFFMAN_QL_BITS ];
+	/** Lookup table
+	 *
+	 * Must be provided by the owner of the alphabet, with space
+	 * for HUFFMAN_TABLE_SIZE(count) entries.
+	 */
+	huffman_entry_t *table;
 	/** Raw symbols
 	 *
 	 * Ordered by Huffman-coded symbol length, then by symbol
@@ -77,34 +109,52 @@ struct huffman_alphabet {
 	huffman_raw_symbol_t raw[0];
 };
 
+/**
+ * Look up Huffman symbol
+ *
+ * @v alphabet		Huffman alphabet
+ * @v huf		Raw input value (normalised to HUFFMAN_BITS bits)
+ * @ret entry		Lookup table entry
+ */
+static inline __attribute__ (( always_inline )) huffman_entry_t
+huffman_lookup ( struct huffman_alphabet *alphabet, unsigned int huf ) {
+	huffman_entry_t entry;
+	unsigned int index;
+
+	entry = alphabet->table[ huf >> HUFFMAN_SUBTABLE_BITS ];
+	if ( entry & HUFFMAN_LINK ) {
+		index = ( ( huf & ( ( 1 << HUFFMAN_SUBTABLE_BITS ) - 1 ) ) >>
+			  ( HUFFMAN_SUBTABLE_BITS - ( entry & 0x1f ) ) );
+		entry = alphabet->table[ ( entry >> 8 ) + index ];
+	}
+	return entry;
+}
+
 /**
  * Get Huffman symbol length
  *
- * @v sym		Huffman symbol set
+ * @v entry		Lookup table entry
  * @ret len		Length (in bits)
  */
 static inline __attribute__ (( always_inline )) unsigned int
-huffman_len ( struct huffman_symbols *sym ) {
+huffman_len ( huffman_entry_t entry ) {
 
-	return sym->bits;
+	return ( entry & 0x1f );
 }
 
 /**
  * Get Huffman symbol value
  *
- * @v sym		Huffman symbol set
- * @v huf		Raw input value (normalised to HUFFMAN_BITS bits)
+ * @v entry		Lookup table entry
  * @ret raw		Raw symbol value
  */
 static inline __attribute__ (( always_inline )) huffman_raw_symbol_t
-huffman_raw ( struct huffman_symbols *sym, unsigned int huf ) {
+huffman_raw ( huffman_entry_t entry ) {
 
-	return sym->raw[ huf >> sym->shift ];
+	return ( entry >> 8 );
 }
 
 extern int huffman_alphabet ( struct huffman_alphabet *alphabet,
 			      uint8_t *lengths, unsigned int count );
-extern struct huffman_symbols *
-huffman_sym ( struct huffman_alphabet *alphabet, unsigned int huf );
 
 #endif /* _HUFFMAN_H */
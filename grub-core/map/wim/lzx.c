@@ -35,6 +35,7 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <huffman.h>
 #include <lzx.h>
 
@@ -42,71 +43,105 @@
 static unsigned int lzx_position_base[LZX_POSITION_SLOTS];
 
 /**
- * Attempt to accumulate bits from LZX bitstream
+ * LZX decompressor
+ *
+ * Allocated on first use, since its lookup tables are too large to
+ * carry on the stack or in the module image.
+ */
+static struct lzx *lzx_decompressor;
+
+/**
+ * Refill LZX bitstream accumulator
  *
  * @v lzx    Decompressor
- * @v bits    Number of bits to accumulate
- * @v norm_value  Accumulated value (normalised to 16 bits)
  *
- * Note that there may not be sufficient accumulated bits in the
- * bitstream; callers must check that sufficient bits are available
- * before using the value.
+ * Whole 16-bit words are added until the accumulator cannot hold
+ * another word or the input stream is exhausted.
  */
-static int lzx_accumulate ( struct lzx *lzx, unsigned int bits ) {
-  const uint16_t *src16;
-
-  /* Accumulate more bits if required */
-  if ( ( lzx->bits < bits ) &&
-       ( lzx->input.offset < lzx->input.len ) ) {
-    src16 = (void *)( ( char * ) lzx->input.data + lzx->input.offset );
-    lzx->input.offset += sizeof ( *src16 );
-    lzx->accumulator |= ( *src16 << ( 16 - lzx->bits ) );
+static inline __attribute__ (( always_inline )) void
+lzx_refill ( struct lzx *lzx ) {
+  const uint8_t *src;
+
+  while ( ( lzx->bits <= ( 64 - 16 ) ) &&
+          ( lzx->input.offset < lzx->input.len ) ) {
+    src = ( lzx->input.data + lzx->input.offset );
+    lzx->accumulator |= ( ( ( uint64_t ) ( src[0] | ( src[1] << 8 ) ) )
+                          << ( 48 - lzx->bits ) );
+    lzx->input.offset += 2;
     lzx->bits += 16;
   }
+}
+
+/**
+ * Get current bit position within LZX bitstream
+ *
+ * @v lzx    Decompressor
+ * @ret position  Bit position
+ */
+static inline __attribute__ (( always_inline )) size_t
+lzx_position ( struct lzx *lzx ) {
 
-  return ( lzx->accumulator >> 16 );
+  return ( ( lzx->input.offset * 8 ) - lzx->bits );
 }
 
 /**
- * Consume accumulated bits from LZX bitstream
+ * Get bits from LZX bitstream
  *
  * @v lzx    Decompressor
- * @v bits    Number of bits to consume
- * @ret rc    Return status code
+ * @v bits    Number of bits to fetch
+ * @ret value    Value, or negative error
  */
-static int lzx_consume ( struct lzx *lzx, unsigned int bits ) {
+static int lzx_getbits ( struct lzx *lzx, unsigned int bits ) {
+  size_t peek;
+  int value;
+
+  /* Accumulate more bits if required */
+  if ( lzx->bits < bits )
+    lzx_refill ( lzx );
+
+  /* Record furthest bit position examined */
+  peek = ( lzx_position ( lzx ) + bits );
+  if ( lzx->peek < peek )
+    lzx->peek = peek;
 
   /* Fail if insufficient bits are available */
-  if ( lzx->bits < bits ) {
+  if ( lzx->bits < bits )
     return -1;
-  }
 
   /* Consume bits */
+  if ( ! bits )
+    return 0;
+  value = ( lzx->accumulator >> ( 64 - bits ) );
   lzx->accumulator <<= bits;
   lzx->bits -= bits;
 
-  return 0;
+  return value;
 }
 
 /**
- * Get bits from LZX bitstream
+ * Get end of input examined by LZX bitstream
  *
  * @v lzx    Decompressor
- * @v bits    Number of bits to fetch
- * @ret value    Value, or negative error
+ * @ret offset    Offset of end of last 16-bit word examined
+ *
+ * The bitstream is traditionally consumed through a 16-bit
+ * accumulator, which is refilled only when a request cannot be
+ * satisfied.  This is the input offset which such an accumulator
+ * would have reached, regardless of how far ahead our own
+ * accumulator has been refilled.
  */
-static int lzx_getbits ( struct lzx *lzx, unsigned int bits ) {
-  int norm_value;
-  int rc;
-
-  /* Accumulate more bits if required */
-  norm_value = lzx_accumulate ( lzx, bits );
+static size_t lzx_examined ( struct lzx *lzx ) {
+  size_t peek;
+  size_t offset;
 
-  /* Consume bits */
-  if ( ( rc = lzx_consume ( lzx, bits ) ) != 0 )
-    return rc;
+  peek = lzx_position ( lzx );
+  if ( peek < lzx->peek )
+    peek = lzx->peek;
+  offset = ( ( ( peek + 15 ) / 16 ) * 2 );
+  if ( offset > lzx->input.len )
+    offset = lzx->input.len;
 
-  return ( norm_value >> ( 16 - bits ) );
+  return offset;
 }
 
 /**
@@ -115,6 +150,10 @@ static int lzx_getbits ( struct lzx *lzx, unsigned int bits ) {
  * @v lzx    Decompressor
  * @v bits    Minimum number of padding bits
  * @ret rc    Return status code
+ *
+ * Any 16-bit word already examined is discarded along with the
+ * padding, and any words beyond it which have already been loaded
+ * into the accumulator are returned to the input stream.
  */
 static int lzx_align ( struct lzx *lzx, unsigned int bits ) {
   int pad;
@@ -124,8 +163,10 @@ static int lzx_align ( struct lzx *lzx, unsigned int bits ) {
   if ( pad < 0 )
     return pad;
 
-  /* Consume all accumulated bits */
-  lzx_consume ( lzx, lzx->bits );
+  /* Discard all bits up to the end of the last word examined */
+  lzx->input.offset = lzx_examined ( lzx );
+  lzx->accumulator = 0;
+  lzx->bits = 0;
 
   return 0;
 }
@@ -160,24 +201,28 @@ static int lzx_getbytes ( struct lzx *lzx, void *data, size_t len ) {
  * @v alphabet    Huffman alphabet
  * @ret raw    Raw symbol, or negative error
  */
-static int lzx_decode ( struct lzx *lzx, struct huffman_alphabet *alphabet ) {
-  struct huffman_symbols *sym;
-  int huf;
-  int rc;
+static inline __attribute__ (( always_inline )) int
+lzx_decode ( struct lzx *lzx, struct huffman_alphabet *alphabet ) {
+  huffman_entry_t entry;
+  unsigned int len;
 
   /* Accumulate sufficient bits */
-  huf = lzx_accumulate ( lzx, HUFFMAN_BITS );
-  if ( huf < 0 )
-    return huf;
+  if ( lzx->bits < HUFFMAN_BITS )
+    lzx_refill ( lzx );
+  lzx->peek = ( lzx_position ( lzx ) + HUFFMAN_BITS );
 
   /* Decode symbol */
-  sym = huffman_sym ( alphabet, huf );
+  entry = huffman_lookup ( alphabet,
+                           ( lzx->accumulator >> ( 64 - HUFFMAN_BITS ) ) );
 
   /* Consume bits */
-  if ( ( rc = lzx_consume ( lzx, huffman_len ( sym ) ) ) != 0 )
-    return rc;
+  len = huffman_len ( entry );
+  if ( lzx->bits < len )
+    return -1;
+  lzx->accumulator <<= len;
+  lzx->bits -= len;
 
-  return huffman_raw ( sym, huf );
+  return huffman_raw ( entry );
 }
 
 /**
@@ -407,6 +452,12 @@ static int lzx_block_header ( struct lzx *lzx ) {
   }
   lzx->output.threshold = ( lzx->output.offset + block_len );
 
+  /* Sanity check */
+  if ( lzx->output.threshold > lzx->output.len ) {
+    printf ( "LZX block overruns output buffer\n" );
+    return -1;
+  }
+
   /* Handle block type */
   switch ( block_type ) {
   case LZX_BLOCK_ALIGNOFFSET :
@@ -451,11 +502,11 @@ static int lzx_uncompressed ( struct lzx *lzx ) {
   int rc;
 
   /* Copy bytes */
-  data = ( lzx->output.data ?
-     ( lzx->output.data + lzx->output.offset ) : NULL );
+  data = ( lzx->output.data + lzx->output.offset );
   len = ( lzx->output.threshold - lzx->output.offset );
   if ( ( rc = lzx_getbytes ( lzx, data, len ) ) != 0 )
     return rc;
+  lzx->output.offset += len;
 
   /* Align input stream */
   if ( len % 2 )
@@ -493,9 +544,7 @@ static int lzx_token ( struct lzx *lzx ) {
 
   /* Check for literals */
   if ( lzx_main < LZX_MAIN_LIT_CODES ) {
-    if ( lzx->output.data )
-      lzx->output.data[lzx->output.offset] = lzx_main;
-    lzx->output.offset++;
+    lzx->output.data[lzx->output.offset++] = lzx_main;
     return 0;
   }
   lzx_main -= LZX_MAIN_LIT_CODES;
@@ -552,11 +601,13 @@ static int lzx_token ( struct lzx *lzx ) {
   if ( match_offset > lzx->output.offset ) {
     return -1;
   }
-  if ( lzx->output.data ) {
-    copy = &lzx->output.data[lzx->output.offset];
-    for ( i = 0 ; i < match_length ; i++ )
-      copy[i] = copy[ i - match_offset ];
+  if ( match_length > ( lzx->output.threshold - lzx->output.offset ) ) {
+    printf ( "LZX match overruns block\n" );
+    return -1;
   }
+  copy = &lzx->output.data[lzx->output.offset];
+  for ( i = 0 ; i < match_length ; i++ )
+    copy[i] = copy[ i - match_offset ];
   lzx->output.offset += match_length;
 
   return 0;
@@ -600,11 +651,16 @@ static void lzx_translate_jumps ( struct lzx *lzx ) {
  *
  * @v data    Compressed data
  * @v len    Length of compressed data
- * @v buf    Decompression buffer, or NULL
+ * @v buf    Decompression buffer
+ * @v buf_len    Length of decompression buffer
  * @ret out_len    Length of decompressed data, or negative error
+ *
+ * The output length is checked as each block is decoded, so the data
+ * need only be decompressed once.
  */
-ssize_t lzx_decompress ( const void *data, size_t len, void *buf ) {
-  struct lzx lzx;
+ssize_t lzx_decompress ( const void *data, size_t len, void *buf,
+                         size_t buf_len ) {
+  struct lzx *lzx = lzx_decompressor;
   unsigned int i;
   int rc;
 
@@ -623,41 +679,62 @@ ssize_t lzx_decompress ( const void *data, size_t len, void *buf ) {
     }
   }
 
+  /* Allocate decompressor, if required */
+  if ( ! lzx ) {
+    lzx = malloc ( sizeof ( *lzx ) );
+    if ( ! lzx ) {
+      printf ( "Could not allocate LZX decompressor\n" );
+      return -1;
+    }
+    lzx->alignoffset.table = lzx->alignoffset_table;
+    lzx->pretree.table = lzx->pretree_table;
+    lzx->main.table = lzx->main_table;
+    lzx->length.table = lzx->length_table;
+    lzx_decompressor = lzx;
+  }
+
   /* Initialise decompressor */
-  memset ( &lzx, 0, sizeof ( lzx ) );
-  lzx.input.data = data;
-  lzx.input.len = len;
-  lzx.output.data = buf;
+  memset ( &lzx->input, 0, sizeof ( lzx->input ) );
+  memset ( &lzx->output, 0, sizeof ( lzx->output ) );
+  lzx->input.data = data;
+  lzx->input.len = len;
+  lzx->output.data = buf;
+  lzx->output.len = buf_len;
+  lzx->accumulator = 0;
+  lzx->bits = 0;
+  lzx->peek = 0;
+  lzx->block_type = 0;
+  memset ( &lzx->main_lengths, 0, sizeof ( lzx->main_lengths ) );
+  memset ( lzx->length_lengths, 0, sizeof ( lzx->length_lengths ) );
   for ( i = 0 ; i < LZX_REPEATED_OFFSETS ; i++ )
-    lzx.repeated_offset[i] = 1;
+    lzx->repeated_offset[i] = 1;
 
   /* Process blocks */
-  while ( lzx.input.offset < lzx.input.len ) {
+  while ( lzx_examined ( lzx ) < lzx->input.len ) {
 
     /* Process block header */
-    if ( ( rc = lzx_block_header ( &lzx ) ) != 0 )
+    if ( ( rc = lzx_block_header ( lzx ) ) != 0 )
       return rc;
 
     /* Process block contents */
-    if ( lzx.block_type == LZX_BLOCK_UNCOMPRESSED ) {
+    if ( lzx->block_type == LZX_BLOCK_UNCOMPRESSED ) {
 
       /* Copy uncompressed data */
-      if ( ( rc = lzx_uncompressed ( &lzx ) ) != 0 )
+      if ( ( rc = lzx_uncompressed ( lzx ) ) != 0 )
         return rc;
 
     } else {
 
       /* Process token stream */
-      while ( lzx.output.offset < lzx.output.threshold ) {
-        if ( ( rc = lzx_token ( &lzx ) ) != 0 )
+      while ( lzx->output.offset < lzx->output.threshold ) {
+        if ( ( rc = lzx_token ( lzx ) ) != 0 )
           return rc;
       }
     }
   }
 
   /* Postprocess to undo E8 jump compression */
-  if ( lzx.output.data )
-    lzx_translate_jumps ( &lzx );
+  lzx_translate_jumps ( lzx );
 
-  return lzx.output.offset;
+  return lzx->output.offset;
 }
@@ -88,8 +88,10 @@ struct lzx_input_stream {
 
 /** An LZX output stream */
 struct lzx_output_stream {
-	/** Data, or NULL */
+	/** Data */
 	uint8_t *data;
+	/** Length of data buffer */
+	size_t len;
 	/** Offset within stream */
 	size_t offset;
 	/** End of current block within stream */
@@ -102,10 +104,20 @@ struct lzx {
 	struct lzx_input_stream input;
 	/** Output stream */
 	struct lzx_output_stream output;
-	/** Accumulator */
-	uint32_t accumulator;
+	/** Accumulator
+	 *
+	 * The next bit of the bitstream is held in the most
+	 * significant bit.
+	 */
+	uint64_t accumulator;
 	/** Number of bits in accumulator */
 	unsigned int bits;
+	/** Furthest bit position examined within input stream
+	 *
+	 * Used to reproduce the 16-bit word boundary at which the
+	 * bitstream is realigned for uncompressed blocks.
+	 */
+	size_t peek;
 	/** Block type */
 	enum lzx_block_type block_type;
 	/** Repeated offsets */
@@ -121,6 +133,9 @@ struct lzx {
 	huffman_raw_symbol_t alignoffset_raw[LZX_ALIGNOFFSET_CODES];
 	/** Aligned offset code lengths */
 	uint8_t alignoffset_lengths[LZX_ALIGNOFFSET_CODES];
+	/** Aligned offset lookup table */
+	huffman_entry_t
+		alignoffset_table[ HUFFMAN_TABLE_SIZE ( LZX_ALIGNOFFSET_CODES ) ];
 
 	/** Pretree Huffman alphabet */
 	struct huffman_alphabet pretree;
@@ -131,6 +146,8 @@ struct lzx {
 	huffman_raw_symbol_t pretree_raw[LZX_PRETREE_CODES];
 	/** Preetree code lengths */
 	uint8_t pretree_lengths[LZX_PRETREE_CODES];
+	/** Pretree lookup table */
+	huffman_entry_t pretree_table[ HUFFMAN_TABLE_SIZE ( LZX_PRETREE_CODES ) ];
 
 	/** Main Huffman alphabet */
 	struct huffman_alphabet main;
@@ -146,6 +163,8 @@ struct lzx {
 		/** Remaining symbols */
 		uint8_t remainder[ LZX_MAIN_CODES - LZX_MAIN_LIT_CODES ];
 	} __attribute__ (( packed )) main_lengths;
+	/** Main lookup table */
+	huffman_entry_t main_table[ HUFFMAN_TABLE_SIZE ( LZX_MAIN_CODES ) ];
 
 	/** Length Huffman alphabet */
 	struct huffman_alphabet length;
@@ -156,6 +175,8 @@ struct lzx {
 	huffman_raw_symbol_t length_raw[LZX_LENGTH_CODES];
 	/** Length code lengths */
 	uint8_t length_lengths[LZX_LENGTH_CODES];
+	/** Length lookup table */
+	huffman_entry_t length_table[ HUFFMAN_TABLE_SIZE ( LZX_LENGTH_CODES ) ];
 };
 
 /**
@@ -175,6 +196,7 @@ static inline unsigned int lzx_footer_bits ( unsigned int position_slot ) {
 	}
 }
 
-extern ssize_t lzx_decompress ( const void *data, size_t len, void *buf );
+extern ssize_t lzx_decompress ( const void *data, size_t len, void *buf,
+				size_t buf_len );
 
 #endif /* _LZX_H */
@@ -0,0 +1,344 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * @file
+ *
+ * LZX decompression benchmark
+ *
+ * This is a host program, not part of the map module.  It decompresses
+ * every LZX chunk of every resource within a WIM file (such as
+ * boot.wim), checks each resource against its SHA-1 hash, and reports
+ * the decompression throughput.  Build it with
+ *
+ *   cc -O2 -I. -o lzxbench lzxbench.c lzx.c huffman.c sha1.c
+ *
+ * and run it as
+ *
+ *   ./lzxbench boot.wim [passes]
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+struct vfat_file;
+
+#include <lzx.h>
+#include <sha1.h>
+#include <wim.h>
+
+/** An LZX-compressed chunk */
+struct lzxbench_chunk {
+  /** Compressed data */
+  const uint8_t *data;
+  /** Compressed length */
+  size_t len;
+  /** Uncompressed length */
+  size_t out_len;
+};
+
+/** Chunks to decompress */
+static struct lzxbench_chunk *chunks;
+
+/** Number of chunks */
+static size_t chunk_count;
+
+/** Number of allocated chunk slots */
+static size_t chunk_alloc;
+
+/**
+ * Read whole file
+ *
+ * @v name    File name
+ * @v len    Length to fill in
+ * @ret data    File contents, or NULL on error
+ */
+static uint8_t * lzxbench_load ( const char *name, size_t *len ) {
+  uint8_t *data;
+  FILE *file;
+  long size;
+
+  file = fopen ( name, "rb" );
+  if ( ! file ) {
+    perror ( name );
+    return NULL;
+  }
+  if ( ( fseek ( file, 0, SEEK_END ) != 0 ) ||
+       ( ( size = ftell ( file ) ) < 0 ) ||
+       ( fseek ( file, 0, SEEK_SET ) != 0 ) ) {
+    perror ( name );
+    fclose ( file );
+    return NULL;
+  }
+  data = malloc ( size ? size : 1 );
+  if ( ! data ) {
+    fprintf ( stderr, "Could not allocate %ld bytes\n", size );
+    fclose ( file );
+    return NULL;
+  }
+  if ( fread ( data, 1, size, file ) != ( size_t ) size ) {
+    perror ( name );
+    free ( data );
+    fclose ( file );
+    return NULL;
+  }
+  fclose ( file );
+  *len = size;
+  return data;
+}
+
+/**
+ * Add chunk
+ *
+ * @v data    Compressed data
+ * @v len    Compressed length
+ * @v out_len    Uncompressed length
+ * @ret rc    Return status code
+ */
+static int lzxbench_add ( const uint8_t *data, size_t len, size_t out_len ) {
+  struct lzxbench_chunk *new_chunks;
+
+  if ( chunk_count == chunk_alloc ) {
+    chunk_alloc = ( chunk_alloc ? ( chunk_alloc * 2 ) : 1024 );
+    new_chunks = realloc ( chunks, ( chunk_alloc * sizeof ( *chunks ) ) );
+    if ( ! new_chunks ) {
+      fprintf ( stderr, "Could not allocate chunk list\n" );
+      return -1;
+    }
+    chunks = new_chunks;
+  }
+  chunks[chunk_count].data = data;
+  chunks[chunk_count].len = len;
+  chunks[chunk_count].out_len = out_len;
+  chunk_count++;
+  return 0;
+}
+
+/**
+ * Collect and verify chunks of a compressed resource
+ *
+ * @v wim    WIM file contents
+ * @v wim_len    Length of WIM file
+ * @v entry    Lookup table entry
+ * @ret rc    Return status code
+ */
+static int lzxbench_resource ( const uint8_t *wim, size_t wim_len,
+                               struct wim_lookup_entry *entry ) {
+  struct wim_resource_header *resource = &entry->resource;
+  size_t zlen = ( resource->zlen__flags & WIM_RESHDR_ZLEN_MASK );
+  uint8_t ctx[SHA1_CTX_SIZE];
+  uint8_t buf[WIM_CHUNK_LEN];
+  uint8_t digest[SHA1_DIGEST_SIZE];
+  const uint8_t *base;
+  const uint8_t *table;
+  size_t offset_len;
+  size_t chunks_len;
+  size_t offset;
+  size_t next_offset;
+  size_t out_len;
+  size_t count;
+  size_t i;
+  ssize_t rc;
+
+  /* Sanity checks */
+  if ( ( resource->offset > wim_len ) ||
+       ( zlen > ( wim_len - resource->offset ) ) ) {
+    fprintf ( stderr, "Resource at 0x%llx lies outside file\n",
+              ( unsigned long long ) resource->offset );
+    return -1;
+  }
+  if ( ! resource->len )
+    return 0;
+
+  /* Locate chunk table */
+  base = ( wim + resource->offset );
+  table = base;
+  count = ( ( resource->len + WIM_CHUNK_LEN - 1 ) / WIM_CHUNK_LEN );
+  offset_len = ( ( resource->len > 0xffffffffULL ) ?
+                 sizeof ( uint64_t ) : sizeof ( uint32_t ) );
+  chunks_len = ( ( count - 1 ) * offset_len );
+  if ( chunks_len > zlen ) {
+    fprintf ( stderr, "Resource too short for %zd chunks\n", count );
+    return -1;
+  }
+
+  /* Collect chunks, verifying resource contents as we go */
+  sha1_init ( ctx );
+  for ( i = 0 ; i < count ; i++ ) {
+    if ( i == 0 ) {
+      offset = chunks_len;
+    } else if ( offset_len == sizeof ( uint64_t ) ) {
+      offset = ( chunks_len +
+                 ( ( const uint64_t * ) table )[ i - 1 ] );
+    } else {
+      offset = ( chunks_len +
+                 ( ( const uint32_t * ) table )[ i - 1 ] );
+    }
+    if ( ( i + 1 ) == count ) {
+      next_offset = zlen;
+    } else if ( offset_len == sizeof ( uint64_t ) ) {
+      next_offset = ( chunks_len + ( ( const uint64_t * ) table )[i] );
+    } else {
+      next_offset = ( chunks_len + ( ( const uint32_t * ) table )[i] );
+    }
+    if ( ( offset > next_offset ) || ( next_offset > zlen ) ) {
+      fprintf ( stderr, "Chunk %zd offset lies outside resource\n", i );
+      return -1;
+    }
+    out_len = ( ( ( i + 1 ) == count ) ?
+                ( resource->len - ( i * WIM_CHUNK_LEN ) ) : WIM_CHUNK_LEN );
+
+    /* Uncompressed chunks are stored raw */
+    if ( ( next_offset - offset ) == out_len ) {
+      sha1_update ( ctx, ( base + offset ), out_len );
+      continue;
+    }
+
+    /* Decompress chunk */
+    rc = lzx_decompress ( ( base + offset ), ( next_offset - offset ),
+                          buf, out_len );
+    if ( rc != ( ssize_t ) out_len ) {
+      fprintf ( stderr, "Chunk %zd of resource at 0x%llx failed (%zd)\n",
+                i, ( unsigned long long ) resource->offset, rc );
+      return -1;
+    }
+    sha1_update ( ctx, buf, out_len );
+    if ( lzxbench_add ( ( base + offset ), ( next_offset - offset ),
+                        out_len ) != 0 )
+      return -1;
+  }
+  sha1_final ( ctx, digest );
+
+  /* Check hash */
+  if ( memcmp ( digest, &entry->hash, sizeof ( digest ) ) != 0 ) {
+    fprintf ( stderr, "Resource at 0x%llx has incorrect SHA-1 hash\n",
+              ( unsigned long long ) resource->offset );
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Get elapsed time
+ *
+ * @v start    Start time
+ * @ret secs    Seconds elapsed since start time
+ */
+static double lzxbench_elapsed ( struct timespec *start ) {
+  struct timespec now;
+
+  clock_gettime ( CLOCK_MONOTONIC, &now );
+  return ( ( now.tv_sec - start->tv_sec ) +
+           ( ( now.tv_nsec - start->tv_nsec ) / 1e9 ) );
+}
+
+int main ( int argc, char **argv ) {
+  static uint8_t buf[WIM_CHUNK_LEN];
+  struct wim_header *header;
+  struct wim_lookup_entry *entry;
+  struct wim_resource_header *lookup;
+  struct timespec start;
+  uint64_t in_total = 0;
+  uint64_t out_total = 0;
+  unsigned int passes = 1;
+  unsigned int pass;
+  uint8_t *wim;
+  size_t wim_len;
+  size_t count;
+  size_t i;
+  double secs;
+
+  /* Parse command line */
+  if ( ( argc < 2 ) || ( argc > 3 ) ) {
+    fprintf ( stderr, "Usage: %s <file.wim> [passes]\n", argv[0] );
+    return 1;
+  }
+  if ( argc > 2 )
+    passes = strtoul ( argv[2], NULL, 0 );
+  if ( ! passes )
+    passes = 1;
+
+  /* Load WIM file */
+  wim = lzxbench_load ( argv[1], &wim_len );
+  if ( ! wim )
+    return 1;
+  if ( wim_len < sizeof ( *header ) ) {
+    fprintf ( stderr, "%s: file too short\n", argv[1] );
+    return 1;
+  }
+  header = ( struct wim_header * ) wim;
+  if ( ! ( header->flags & WIM_HDR_LZX ) ) {
+    fprintf ( stderr, "%s: not LZX-compressed\n", argv[1] );
+    return 1;
+  }
+
+  /* Collect chunks from all compressed resources */
+  lookup = &header->lookup;
+  if ( ( lookup->zlen__flags & WIM_RESHDR_COMPRESSED ) ||
+       ( lookup->offset > wim_len ) ||
+       ( lookup->len > ( wim_len - lookup->offset ) ) ) {
+    fprintf ( stderr, "%s: unsupported lookup table\n", argv[1] );
+    return 1;
+  }
+  entry = ( struct wim_lookup_entry * ) ( wim + lookup->offset );
+  count = ( lookup->len / sizeof ( *entry ) );
+  for ( i = 0 ; i < count ; i++, entry++ ) {
+    if ( ! ( entry->resource.zlen__flags & WIM_RESHDR_COMPRESSED ) )
+      continue;
+    if ( entry->resource.zlen__flags & WIM_RESHDR_PACKED_STREAMS )
+      continue;
+    if ( lzxbench_resource ( wim, wim_len, entry ) != 0 )
+      return 1;
+  }
+  if ( ! chunk_count ) {
+    fprintf ( stderr, "%s: no LZX chunks found\n", argv[1] );
+    return 1;
+  }
+  for ( i = 0 ; i < chunk_count ; i++ ) {
+    in_total += chunks[i].len;
+    out_total += chunks[i].out_len;
+  }
+  printf ( "%zd chunks, %llu bytes compressed, %llu bytes uncompressed\n",
+           chunk_count, ( unsigned long long ) in_total,
+           ( unsigned long long ) out_total );
+
+  /* Time decompression */
+  clock_gettime ( CLOCK_MONOTONIC, &start );
+  for ( pass = 0 ; pass < passes ; pass++ ) {
+    for ( i = 0 ; i < chunk_count ; i++ ) {
+      if ( lzx_decompress ( chunks[i].data, chunks[i].len, buf,
+                            chunks[i].out_len ) < 0 ) {
+        fprintf ( stderr, "Chunk %zd failed\n", i );
+        return 1;
+      }
+    }
+  }
+  secs = lzxbench_elapsed ( &start );
+  printf ( "%u passes in %.3fs: %.1f MB/s output, %.1f MB/s input\n",
+           passes, secs, ( ( out_total * passes ) / secs / 1e6 ),
+           ( ( in_total * passes ) / secs / 1e6 ) );
+
+  free ( chunks );
+  free ( wim );
+  return 0;
+}
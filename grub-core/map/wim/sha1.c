@@ -26,6 +26,10 @@
  *
  * SHA-1 algorithm
  *
+ * Whole blocks are digested directly from the caller's buffer, using
+ * the SHA extensions or SSSE3 where the CPU supports them.  The
+ * portable implementation is used everywhere else.
+ *
  */
 
 #include <stddef.h>
@@ -36,78 +40,432 @@
 #include <rotate.h>
 #include <sha1.h>
 
-#if __GNUC__ >= 9
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Waddress-of-packed-member"
+/** Number of words in the SHA-1 message schedule */
+#define SHA1_SCHEDULE_LEN 80
+
+/**
+ * Digest whole blocks
+ *
+ * @v h			Digest (in host-endian order)
+ * @v data		Data
+ * @v blocks		Number of blocks
+ */
+typedef void ( * sha1_blocks_t ) ( uint32_t *h, const void *data,
+				   size_t blocks );
+
+/** Block digest function, selected on first use */
+static sha1_blocks_t sha1_blocks;
+
+/** Calculate one SHA-1 step
+ *
+ * @v f			f(b,c,d)
+ * @v k			Constant k
+ */
+#define SHA1_STEP( f, k ) do {						\
+		temp = ( rol32 ( a, 5 ) + (f) + e + (k) + w[i] );	\
+		e = d;							\
+		d = c;							\
+		c = rol32 ( b, 30 );					\
+		b = a;							\
+		a = temp;						\
+	} while ( 0 )
+
+/**
+ * Perform SHA-1 steps
+ *
+ * @v h			Digest (in host-endian order)
+ * @v w			Message schedule
+ */
+static void sha1_steps ( uint32_t *h, const uint32_t *w ) {
+	uint32_t a = h[0];
+	uint32_t b = h[1];
+	uint32_t c = h[2];
+	uint32_t d = h[3];
+	uint32_t e = h[4];
+	uint32_t temp;
+	unsigned int i;
+
+	for ( i = 0 ; i < 20 ; i++ )
+		SHA1_STEP ( ( ( b & c ) | ( (~b) & d ) ), 0x5a827999 );
+	for ( ; i < 40 ; i++ )
+		SHA1_STEP ( ( b ^ c ^ d ), 0x6ed9eba1 );
+	for ( ; i < 60 ; i++ )
+		SHA1_STEP ( ( ( b & c ) | ( b & d ) | ( c & d ) ), 0x8f1bbcdc );
+	for ( ; i < 80 ; i++ )
+		SHA1_STEP ( ( b ^ c ^ d ), 0xca62c1d6 );
+
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+}
+
+/**
+ * Digest whole blocks using portable code
+ *
+ * @v h			Digest (in host-endian order)
+ * @v data		Data
+ * @v blocks		Number of blocks
+ */
+static void sha1_blocks_generic ( uint32_t *h, const void *data,
+				  size_t blocks ) {
+	const uint8_t *block = data;
+	uint32_t w[SHA1_SCHEDULE_LEN];
+	unsigned int i;
+
+	for ( ; blocks ; blocks--, block += sizeof ( union sha1_block ) ) {
+
+		/* Initialise w[0..15] */
+		memcpy ( w, block, sizeof ( union sha1_block ) );
+		for ( i = 0 ; i < 16 ; i++ )
+			be32_to_cpus ( &w[i] );
+
+		/* Initialise w[16..79] */
+		for ( ; i < SHA1_SCHEDULE_LEN ; i++ ) {
+			w[i] = rol32 ( ( w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16] ),
+				       1 );
+		}
+
+		/* Perform steps */
+		sha1_steps ( h, w );
+	}
+}
+
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+
+/** List SSE registers as clobbered
+ *
+ * i386 builds disable SSE code generation, in which case the compiler
+ * refuses (and has no need) to hear about clobbered SSE registers.
+ */
+#ifdef __SSE__
+#define SHA1_XMM( ... ) __VA_ARGS__,
+#else
+#define SHA1_XMM( ... )
 #endif
 
-/** SHA-1 variables */
-struct sha1_variables {
-	/* This layout matches that of struct sha1_digest_data,
-	 * allowing for efficient endianness-conversion,
-	 */
-	uint32_t a;
-	uint32_t b;
-	uint32_t c;
-	uint32_t d;
-	uint32_t e;
-	uint32_t w[80];
-} __attribute__ (( packed ));
+/** Byte-swapping mask for PSHUFB */
+static const uint8_t sha1_bswap_dwords[16] = {
+	3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+/** Byte-reversing mask for PSHUFB (as used by the SHA extensions) */
+static const uint8_t sha1_bswap_block[16] = {
+	15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+};
 
 /**
- * f(a,b,c,d) for steps 0 to 19
+ * Digest whole blocks using SSSE3
  *
- * @v v		SHA-1 variables
- * @ret f	f(a,b,c,d)
+ * @v h			Digest (in host-endian order)
+ * @v data		Data
+ * @v blocks		Number of blocks
+ *
+ * The message schedule is vectorised.  Beyond w[32], the recurrence
+ * can be rewritten as
+ *
+ *   w[i] = rol32 ( w[i-6] ^ w[i-16] ^ w[i-28] ^ w[i-32], 2 )
+ *
+ * which has no dependencies within a group of four words.
  */
-static uint32_t sha1_f_0_19 ( struct sha1_variables *v ) {
-	return ( ( v->b & v->c ) | ( (~v->b) & v->d ) );
+static void sha1_blocks_ssse3 ( uint32_t *h, const void *data,
+				size_t blocks ) {
+	const uint8_t *block = data;
+	uint32_t w[SHA1_SCHEDULE_LEN];
+	unsigned int i;
+
+	for ( ; blocks ; blocks--, block += sizeof ( union sha1_block ) ) {
+
+		/* Initialise w[0..15] */
+		__asm__ __volatile__ ( "movdqu %2, %%xmm4\n\t"
+				       "movdqu 0(%1), %%xmm0\n\t"
+				       "movdqu 16(%1), %%xmm1\n\t"
+				       "movdqu 32(%1), %%xmm2\n\t"
+				       "movdqu 48(%1), %%xmm3\n\t"
+				       "pshufb %%xmm4, %%xmm0\n\t"
+				       "pshufb %%xmm4, %%xmm1\n\t"
+				       "pshufb %%xmm4, %%xmm2\n\t"
+				       "pshufb %%xmm4, %%xmm3\n\t"
+				       "movdqu %%xmm0, 0(%0)\n\t"
+				       "movdqu %%xmm1, 16(%0)\n\t"
+				       "movdqu %%xmm2, 32(%0)\n\t"
+				       "movdqu %%xmm3, 48(%0)\n\t"
+				       : : "r" ( w ), "r" ( block ),
+					 "m" ( sha1_bswap_dwords )
+				       : SHA1_XMM ( "xmm0", "xmm1", "xmm2",
+						    "xmm3", "xmm4" )
+					 "memory" );
+
+		/* Initialise w[16..31] */
+		for ( i = 16 ; i < 32 ; i++ ) {
+			w[i] = rol32 ( ( w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16] ),
+				       1 );
+		}
+
+		/* Initialise w[32..79] */
+		for ( ; i < SHA1_SCHEDULE_LEN ; i += 4 ) {
+			__asm__ __volatile__ ( "movdqu -24(%0), %%xmm0\n\t"
+					       "movdqu -64(%0), %%xmm1\n\t"
+					       "movdqu -112(%0), %%xmm2\n\t"
+					       "movdqu -128(%0), %%xmm3\n\t"
+					       "pxor %%xmm1, %%xmm0\n\t"
+					       "pxor %%xmm3, %%xmm2\n\t"
+					       "pxor %%xmm2, %%xmm0\n\t"
+					       "movdqa %%xmm0, %%xmm1\n\t"
+					       "pslld $2, %%xmm0\n\t"
+					       "psrld $30, %%xmm1\n\t"
+					       "por %%xmm1, %%xmm0\n\t"
+					       "movdqu %%xmm0, 0(%0)\n\t"
+					       : : "r" ( &w[i] )
+					       : SHA1_XMM ( "xmm0", "xmm1",
+							    "xmm2", "xmm3" )
+						 "memory" );
+		}
+
+		/* Perform steps */
+		sha1_steps ( h, w );
+	}
 }
 
 /**
- * f(a,b,c,d) for steps 20 to 39 and 60 to 79
+ * Digest whole blocks using the SHA extensions
  *
- * @v v		SHA-1 variables
- * @ret f	f(a,b,c,d)
+ * @v h			Digest (in host-endian order)
+ * @v data		Data
+ * @v blocks		Number of blocks
+ *
+ * Only %xmm0-%xmm7 are used, so that this works on i386.  The digest
+ * at the start of each block is saved to memory.
  */
-static uint32_t sha1_f_20_39_60_79 ( struct sha1_variables *v ) {
-	return ( v->b ^ v->c ^ v->d );
+static void sha1_blocks_shani ( uint32_t *h, const void *data,
+				size_t blocks ) {
+	uint32_t save[8];
+
+	if ( ! blocks )
+		return;
+
+	__asm__ __volatile__ (
+		/* Load digest, with a in the most significant dword */
+		"movdqu 0(%2), %%xmm0\n\t"
+		"pshufd $0x1b, %%xmm0, %%xmm0\n\t"
+		"movd 16(%2), %%xmm1\n\t"
+		"pslldq $12, %%xmm1\n\t"
+		"movdqu %4, %%xmm7\n\t"
+		"\n1:\n\t"
+		/* Save digest */
+		"movdqu %%xmm0, 0(%3)\n\t"
+		"movdqu %%xmm1, 16(%3)\n\t"
+		/* Rounds 0 to 3 */
+		"movdqu 0(%0), %%xmm3\n\t"
+		"pshufb %%xmm7, %%xmm3\n\t"
+		"paddd %%xmm3, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1rnds4 $0, %%xmm1, %%xmm0\n\t"
+		/* Rounds 4 to 7 */
+		"movdqu 16(%0), %%xmm4\n\t"
+		"pshufb %%xmm7, %%xmm4\n\t"
+		"sha1nexte %%xmm4, %%xmm2\n\t"
+		"movdqa %%xmm0, %%xmm1\n\t"
+		"sha1rnds4 $0, %%xmm2, %%xmm0\n\t"
+		"sha1msg1 %%xmm4, %%xmm3\n\t"
+		/* Rounds 8 to 11 */
+		"movdqu 32(%0), %%xmm5\n\t"
+		"pshufb %%xmm7, %%xmm5\n\t"
+		"sha1nexte %%xmm5, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1rnds4 $0, %%xmm1, %%xmm0\n\t"
+		"sha1msg1 %%xmm5, %%xmm4\n\t"
+		"pxor %%xmm5, %%xmm3\n\t"
+		/* Rounds 12 to 15 */
+		"movdqu 48(%0), %%xmm6\n\t"
+		"pshufb %%xmm7, %%xmm6\n\t"
+		"sha1nexte %%xmm6, %%xmm2\n\t"
+		"movdqa %%xmm0, %%xmm1\n\t"
+		"sha1msg2 %%xmm6, %%xmm3\n\t"
+		"sha1rnds4 $0, %%xmm2, %%xmm0\n\t"
+		"sha1msg1 %%xmm6, %%xmm5\n\t"
+		"pxor %%xmm6, %%xmm4\n\t"
+		/* Rounds 16 to 19 */
+		"sha1nexte %%xmm3, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1msg2 %%xmm3, %%xmm4\n\t"
+		"sha1rnds4 $0, %%xmm1, %%xmm0\n\t"
+		"sha1msg1 %%xmm3, %%xmm6\n\t"
+		"pxor %%xmm3, %%xmm5\n\t"
+		/* Rounds 20 to 23 */
+		"sha1nexte %%xmm4, %%xmm2\n\t"
+		"movdqa %%xmm0, %%xmm1\n\t"
+		"sha1msg2 %%xmm4, %%xmm5\n\t"
+		"sha1rnds4 $1, %%xmm2, %%xmm0\n\t"
+		"sha1msg1 %%xmm4, %%xmm3\n\t"
+		"pxor %%xmm4, %%xmm6\n\t"
+		/* Rounds 24 to 27 */
+		"sha1nexte %%xmm5, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1msg2 %%xmm5, %%xmm6\n\t"
+		"sha1rnds4 $1, %%xmm1, %%xmm0\n\t"
+		"sha1msg1 %%xmm5, %%xmm4\n\t"
+		"pxor %%xmm5, %%xmm3\n\t"
+		/* Rounds 28 to 31 */
+		"sha1nexte %%xmm6, %%xmm2\n\t"
+		"movdqa %%xmm0, %%xmm1\n\t"
+		"sha1msg2 %%xmm6, %%xmm3\n\t"
+		"sha1rnds4 $1, %%xmm2, %%xmm0\n\t"
+		"sha1msg1 %%xmm6, %%xmm5\n\t"
+		"pxor %%xmm6, %%xmm4\n\t"
+		/* Rounds 32 to 35 */
+		"sha1nexte %%xmm3, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1msg2 %%xmm3, %%xmm4\n\t"
+		"sha1rnds4 $1, %%xmm1, %%xmm0\n\t"
+		"sha1msg1 %%xmm3, %%xmm6\n\t"
+		"pxor %%xmm3, %%xmm5\n\t"
+		/* Rounds 36 to 39 */
+		"sha1nexte %%xmm4, %%xmm2\n\t"
+		"movdqa %%xmm0, %%xmm1\n\t"
+		"sha1msg2 %%xmm4, %%xmm5\n\t"
+		"sha1rnds4 $1, %%xmm2, %%xmm0\n\t"
+		"sha1msg1 %%xmm4, %%xmm3\n\t"
+		"pxor %%xmm4, %%xmm6\n\t"
+		/* Rounds 40 to 43 */
+		"sha1nexte %%xmm5, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1msg2 %%xmm5, %%xmm6\n\t"
+		"sha1rnds4 $2, %%xmm1, %%xmm0\n\t"
+		"sha1msg1 %%xmm5, %%xmm4\n\t"
+		"pxor %%xmm5, %%xmm3\n\t"
+		/* Rounds 44 to 47 */
+		"sha1nexte %%xmm6, %%xmm2\n\t"
+		"movdqa %%xmm0, %%xmm1\n\t"
+		"sha1msg2 %%xmm6, %%xmm3\n\t"
+		"sha1rnds4 $2, %%xmm2, %%xmm0\n\t"
+		"sha1msg1 %%xmm6, %%xmm5\n\t"
+		"pxor %%xmm6, %%xmm4\n\t"
+		/* Rounds 48 to 51 */
+		"sha1nexte %%xmm3, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1msg2 %%xmm3, %%xmm4\n\t"
+		"sha1rnds4 $2, %%xmm1, %%xmm0\n\t"
+		"sha1msg1 %%xmm3, %%xmm6\n\t"
+		"pxor %%xmm3, %%xmm5\n\t"
+		/* Rounds 52 to 55 */
+		"sha1nexte %%xmm4, %%xmm2\n\t"
+		"movdqa %%xmm0, %%xmm1\n\t"
+		"sha1msg2 %%xmm4, %%xmm5\n\t"
+		"sha1rnds4 $2, %%xmm2, %%xmm0\n\t"
+		"sha1msg1 %%xmm4, %%xmm3\n\t"
+		"pxor %%xmm4, %%xmm6\n\t"
+		/* Rounds 56 to 59 */
+		"sha1nexte %%xmm5, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1msg2 %%xmm5, %%xmm6\n\t"
+		"sha1rnds4 $2, %%xmm1, %%xmm0\n\t"
+		"sha1msg1 %%xmm5, %%xmm4\n\t"
+		"pxor %%xmm5, %%xmm3\n\t"
+		/* Rounds 60 to 63 */
+		"sha1nexte %%xmm6, %%xmm2\n\t"
+		"movdqa %%xmm0, %%xmm1\n\t"
+		"sha1msg2 %%xmm6, %%xmm3\n\t"
+		"sha1rnds4 $3, %%xmm2, %%xmm0\n\t"
+		"sha1msg1 %%xmm6, %%xmm5\n\t"
+		"pxor %%xmm6, %%xmm4\n\t"
+		/* Rounds 64 to 67 */
+		"sha1nexte %%xmm3, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1msg2 %%xmm3, %%xmm4\n\t"
+		"sha1rnds4 $3, %%xmm1, %%xmm0\n\t"
+		"sha1msg1 %%xmm3, %%xmm6\n\t"
+		"pxor %%xmm3, %%xmm5\n\t"
+		/* Rounds 68 to 71 */
+		"sha1nexte %%xmm4, %%xmm2\n\t"
+		"movdqa %%xmm0, %%xmm1\n\t"
+		"sha1msg2 %%xmm4, %%xmm5\n\t"
+		"sha1rnds4 $3, %%xmm2, %%xmm0\n\t"
+		"pxor %%xmm4, %%xmm6\n\t"
+		/* Rounds 72 to 75 */
+		"sha1nexte %%xmm5, %%xmm1\n\t"
+		"movdqa %%xmm0, %%xmm2\n\t"
+		"sha1msg2 %%xmm5, %%xmm6\n\t"
+		"sha1rnds4 $3, %%xmm1, %%xmm0\n\t"
+		/* Rounds 76 to 79 */
+		"sha1nexte %%xmm6, %%xmm2\n\t"
+		"movdqa %%xmm0, %%xmm1\n\t"
+		"sha1rnds4 $3, %%xmm2, %%xmm0\n\t"
+		/* Add saved digest */
+		"movdqu 16(%3), %%xmm3\n\t"
+		"sha1nexte %%xmm3, %%xmm1\n\t"
+		"movdqu 0(%3), %%xmm3\n\t"
+		"paddd %%xmm3, %%xmm0\n\t"
+		/* Move to next block */
+		"add $64, %0\n\t"
+		"dec %1\n\t"
+		"jnz 1b\n\t"
+		/* Store digest */
+		"pshufd $0x1b, %%xmm0, %%xmm0\n\t"
+		"movdqu %%xmm0, 0(%2)\n\t"
+		"psrldq $12, %%xmm1\n\t"
+		"movd %%xmm1, 16(%2)\n\t"
+		: "+r" ( data ), "+r" ( blocks )
+		: "r" ( h ), "r" ( save ), "m" ( sha1_bswap_block )
+		: SHA1_XMM ( "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",
+			     "xmm6", "xmm7" )
+		  "cc", "memory" );
 }
 
 /**
- * f(a,b,c,d) for steps 40 to 59
+ * Select block digest function
+ *
+ * @ret blocks		Block digest function
  *
- * @v v		SHA-1 variables
- * @ret f	f(a,b,c,d)
+ * The SHA extensions are reported by CPUID leaf 7 (EBX bit 29), and
+ * SSSE3 by CPUID leaf 1 (ECX bit 9).  Neither may be used unless SSE
+ * has been enabled (CR4.OSFXSR).  This is guaranteed on x86_64 and
+ * by any host operating system, so CR4 (which is readable only in
+ * ring 0) is checked only by i386 firmware builds.
  */
-static uint32_t sha1_f_40_59 ( struct sha1_variables *v ) {
-	return ( ( v->b & v->c ) | ( v->b & v->d ) | ( v->c & v->d ) );
+static sha1_blocks_t sha1_select ( void ) {
+#if defined ( __i386__ ) && defined ( GRUB_MACHINE_EFI )
+	unsigned long cr4;
+#endif
+	uint32_t max_leaf;
+	uint32_t eax;
+	uint32_t ebx;
+	uint32_t ecx;
+	uint32_t edx;
+
+	__asm__ ( "cpuid" : "=a" ( max_leaf ), "=b" ( ebx ), "=c" ( ecx ),
+		  "=d" ( edx ) : "0" ( 0 ), "2" ( 0 ) );
+#if defined ( __i386__ ) && defined ( GRUB_MACHINE_EFI )
+	__asm__ ( "mov %%cr4, %0" : "=r" ( cr4 ) );
+	if ( ! ( cr4 & ( 1 << 9 ) ) )
+		return sha1_blocks_generic;
+#endif
+	__asm__ ( "cpuid" : "=a" ( eax ), "=b" ( ebx ), "=c" ( ecx ),
+		  "=d" ( edx ) : "0" ( 1 ), "2" ( 0 ) );
+	if ( ! ( ecx & ( 1 << 9 ) ) )
+		return sha1_blocks_generic;
+	if ( max_leaf >= 7 ) {
+		__asm__ ( "cpuid" : "=a" ( eax ), "=b" ( ebx ), "=c" ( ecx ),
+			  "=d" ( edx ) : "0" ( 7 ), "2" ( 0 ) );
+		if ( ebx & ( 1 << 29 ) )
+			return sha1_blocks_shani;
+	}
+	return sha1_blocks_ssse3;
 }
 
-/** An SHA-1 step function */
-struct sha1_step {
-	/**
-	 * Calculate f(a,b,c,d)
-	 *
-	 * @v v		SHA-1 variables
-	 * @ret f	f(a,b,c,d)
-	 */
-	uint32_t ( * f ) ( struct sha1_variables *v );
-	/** Constant k */
-	uint32_t k;
-};
+#else /* __i386__ || __x86_64__ */
 
-/** SHA-1 steps */
-static struct sha1_step sha1_steps[4] = {
-	/** 0 to 19 */
-	{ .f = sha1_f_0_19,		.k = 0x5a827999 },
-	/** 20 to 39 */
-	{ .f = sha1_f_20_39_60_79,	.k = 0x6ed9eba1 },
-	/** 40 to 59 */
-	{ .f = sha1_f_40_59,		.k = 0x8f1bbcdc },
-	/** 60 to 79 */
-	{ .f = sha1_f_20_39_60_79,	.k = 0xca62c1d6 },
-};
+/**
+ * Select block digest function
+ *
+ * @ret blocks		Block digest function
+ */
+static sha1_blocks_t sha1_select ( void ) {
+	return sha1_blocks_generic;
+}
+
+#endif /* __i386__ || __x86_64__ */
 
 /**
  * Initialise SHA-1 algorithm
@@ -126,59 +484,27 @@ void sha1_init ( void *ctx ) {
 }
 
 /**
- * Calculate SHA-1 digest of accumulated data
+ * Digest whole blocks into context
  *
  * @v context		SHA-1 context
+ * @v data		Data
+ * @v blocks		Number of blocks
  */
-static void sha1_digest ( struct sha1_context *context ) {
-        union {
-		union sha1_digest_data_dwords ddd;
-		struct sha1_variables v;
-	} u;
-	uint32_t *a = &u.v.a;
-	uint32_t *b = &u.v.b;
-	uint32_t *c = &u.v.c;
-	uint32_t *d = &u.v.d;
-	uint32_t *e = &u.v.e;
-	uint32_t *w = u.v.w;
-	uint32_t f;
-	uint32_t k;
-	uint32_t temp;
-	struct sha1_step *step;
+static void sha1_digest ( struct sha1_context *context, const void *data,
+			  size_t blocks ) {
+	uint32_t h[5];
 	unsigned int i;
 
-	/* Convert h[0..4] to host-endian, and initialise a, b, c, d,
-	 * e, and w[0..15]
-	 */
-	for ( i = 0 ; i < ( sizeof ( u.ddd.dword ) /
-			    sizeof ( u.ddd.dword[0] ) ) ; i++ ) {
-		be32_to_cpus ( &context->ddd.dword[i] );
-		u.ddd.dword[i] = context->ddd.dword[i];
-	}
+	/* Select block digest function, if not already done */
+	if ( ! sha1_blocks )
+		sha1_blocks = sha1_select();
 
-	/* Initialise w[16..79] */
-	for ( i = 16 ; i < 80 ; i++ )
-		w[i] = rol32 ( ( w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16] ), 1 );
-
-	/* Main loop */
-	for ( i = 0 ; i < 80 ; i++ ) {
-		step = &sha1_steps[ i / 20 ];
-		f = step->f ( &u.v );
-		k = step->k;
-		temp = ( rol32 ( *a, 5 ) + f + *e + k + w[i] );
-		*e = *d;
-		*d = *c;
-		*c = rol32 ( *b, 30 );
-		*b = *a;
-		*a = temp;
-	}
-
-	/* Add chunk to hash and convert back to big-endian */
-	for ( i = 0 ; i < 5 ; i++ ) {
-		context->ddd.dd.digest.h[i] =
-			cpu_to_be32 ( context->ddd.dd.digest.h[i] +
-				      u.ddd.dd.digest.h[i] );
-	}
+	/* Convert digest to host-endian, digest blocks, and convert back */
+	for ( i = 0 ; i < 5 ; i++ )
+		h[i] = be32_to_cpu ( context->ddd.dd.digest.h[i] );
+	sha1_blocks ( h, data, blocks );
+	for ( i = 0 ; i < 5 ; i++ )
+		context->ddd.dd.digest.h[i] = cpu_to_be32 ( h[i] );
 }
 
 /**
@@ -191,18 +517,37 @@ static void sha1_digest ( struct sha1_context *context ) {
 void sha1_update ( void *ctx, const void *data, size_t len ) {
 	struct sha1_context *context = ctx;
 	const uint8_t *byte = data;
-	size_t offset;
-
-	/* Accumulate data a byte at a time, performing the digest
-	 * whenever we fill the data buffer
-	 */
-	while ( len-- ) {
-		offset = ( context->len % sizeof ( context->ddd.dd.data ) );
-		context->ddd.dd.data.byte[offset] = *(byte++);
-		context->len++;
-		if ( ( context->len % sizeof ( context->ddd.dd.data ) ) == 0 )
-			sha1_digest ( context );
+	size_t offset = ( context->len % sizeof ( context->ddd.dd.data ) );
+	size_t frag_len;
+	size_t blocks;
+
+	/* Complete any partially filled data buffer */
+	if ( offset ) {
+		frag_len = ( sizeof ( context->ddd.dd.data ) - offset );
+		if ( frag_len > len )
+			frag_len = len;
+		memcpy ( &context->ddd.dd.data.byte[offset], byte, frag_len );
+		context->len += frag_len;
+		byte += frag_len;
+		len -= frag_len;
+		if ( ( offset + frag_len ) < sizeof ( context->ddd.dd.data ) )
+			return;
+		sha1_digest ( context, &context->ddd.dd.data, 1 );
 	}
+
+	/* Digest whole blocks directly from the caller's buffer */
+	blocks = ( len / sizeof ( context->ddd.dd.data ) );
+	if ( blocks ) {
+		frag_len = ( blocks * sizeof ( context->ddd.dd.data ) );
+		sha1_digest ( context, byte, blocks );
+		context->len += frag_len;
+		byte += frag_len;
+		len -= frag_len;
+	}
+
+	/* Retain any remaining data */
+	memcpy ( &context->ddd.dd.data, byte, len );
+	context->len += len;
 }
 
 /**
@@ -235,7 +580,3 @@ void sha1_final ( void *ctx, void *out ) {
 	memcpy ( out, &context->ddd.dd.digest,
 		 sizeof ( context->ddd.dd.digest ) );
 }
-
-#if __GNUC__ >= 9
-#pragma GCC diagnostic pop
-#endif
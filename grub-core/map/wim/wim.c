@@ -30,16 +30,47 @@
 #include <string.h>
 #include <vfat.h>
 #include <lzx.h>
+#include <xpress.h>
 #include <wim.h>
 
 /**
- * WIM chunk buffer
+ * WIM chunk cache
  *
- * We place this in the .stack section to avoid crossing the Forbidden
- * Threshold at 0x30000.  (See comments in script.lds.)
+ * Allocated on first use, since it is too large to carry in the
+ * module image.
  */
-static struct wim_chunk_buffer wim_chunk_buffer
-  __attribute__ (( section ( ".stack" ) ));
+static struct wim_chunk_cache *wim_chunk_cache;
+
+/** WIM chunk cache usage counter */
+static unsigned int wim_chunk_cache_used;
+
+/** Chunk offsets within the most recently used solid resource
+ *
+ * A solid resource records only the compressed length of each chunk,
+ * so the offsets are accumulated once and retained.
+ */
+static struct {
+  /** Virtual file, or NULL if unused */
+  struct vfat_file *file;
+  /** Chunk table offset */
+  size_t resource_offset;
+  /** Number of chunks */
+  unsigned int chunks;
+  /** Chunk offsets (with an extra entry for the end of the final chunk) */
+  size_t *offsets;
+} wim_solid_table;
+
+/** Most recently located stream within a solid resource */
+static struct {
+  /** Virtual file, or NULL if unused */
+  struct vfat_file *file;
+  /** Stream resource header */
+  struct wim_resource_header resource;
+  /** Containing solid resource */
+  struct wim_chunked_resource chunked;
+  /** Offset of stream within solid resource */
+  size_t offset;
+} wim_solid_stream;
 
 /**
  * Get WIM header
@@ -62,20 +93,124 @@ int wim_header ( struct vfat_file *file, struct wim_header *header ) {
   return 0;
 }
 
+/**
+ * Identify decompressor
+ *
+ * @v compression    Compression format
+ * @v chunked    Chunked resource (with chunk length already set)
+ * @ret rc    Return status code
+ */
+static int wim_decompressor ( unsigned int compression,
+                              struct wim_chunked_resource *chunked ) {
+
+  /* Sanity check */
+  if ( ! chunked->chunk_len ) {
+    printf ( "Invalid zero chunk length\n" );
+    return -1;
+  }
+
+  switch ( compression ) {
+  case WIM_COMPRESSION_NONE:
+    /* Every chunk must be stored raw */
+    chunked->decompress = NULL;
+    break;
+  case WIM_COMPRESSION_XPRESS:
+    if ( chunked->chunk_len > XPRESS_BLOCK_LEN ) {
+      printf ( "Unsupported Xpress chunk length 0x%lx\n",
+               ( unsigned long ) chunked->chunk_len );
+      return -1;
+    }
+    chunked->decompress = xpress_decompress;
+    break;
+  case WIM_COMPRESSION_LZX:
+    /* The LZX decompressor handles only the default window size */
+    if ( chunked->chunk_len != WIM_CHUNK_LEN ) {
+      printf ( "Unsupported LZX chunk length 0x%lx\n",
+               ( unsigned long ) chunked->chunk_len );
+      return -1;
+    }
+    chunked->decompress = lzx_decompress;
+    break;
+  default:
+    printf ( "Unsupported compression format %d\n", compression );
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Get chunk offsets for a solid resource
+ *
+ * @v file    Virtual file
+ * @v chunked    Solid resource
+ * @ret offsets    Chunk offsets, or NULL on error
+ */
+static size_t * wim_solid_offsets ( struct vfat_file *file,
+                                    struct wim_chunked_resource *chunked ) {
+  unsigned int chunks;
+  uint32_t *lens;
+  size_t *offsets;
+  unsigned int i;
+
+  /* Use retained offsets, if applicable */
+  if ( ( wim_solid_table.file == file ) &&
+       ( wim_solid_table.resource_offset == chunked->offset ) )
+    return wim_solid_table.offsets;
+
+  /* Read chunk length table */
+  chunks = ( ( chunked->len + chunked->chunk_len - 1 ) / chunked->chunk_len );
+  if ( ( chunks * sizeof ( *lens ) ) > chunked->zlen ) {
+    printf ( "Resource too short for %d chunks\n", chunks );
+    return NULL;
+  }
+  lens = malloc ( chunks * sizeof ( *lens ) );
+  offsets = malloc ( ( chunks + 1 ) * sizeof ( *offsets ) );
+  if ( ( ! lens ) || ( ! offsets ) ) {
+    printf ( "Could not allocate chunk table for %d chunks\n", chunks );
+    free ( lens );
+    free ( offsets );
+    return NULL;
+  }
+  file->read ( file, lens, chunked->offset, ( chunks * sizeof ( *lens ) ) );
+
+  /* Accumulate offsets */
+  offsets[0] = ( chunks * sizeof ( *lens ) );
+  for ( i = 0 ; i < chunks ; i++ ) {
+    offsets[ i + 1 ] = ( offsets[i] + lens[i] );
+    if ( offsets[ i + 1 ] > chunked->zlen ) {
+      printf ( "Chunk %d offset lies outside resource\n", ( i + 1 ) );
+      free ( lens );
+      free ( offsets );
+      return NULL;
+    }
+  }
+  free ( lens );
+
+  /* Retain offsets */
+  free ( wim_solid_table.offsets );
+  wim_solid_table.file = file;
+  wim_solid_table.resource_offset = chunked->offset;
+  wim_solid_table.chunks = chunks;
+  wim_solid_table.offsets = offsets;
+
+  return offsets;
+}
+
 /**
  * Get compressed chunk offset
  *
  * @v file    Virtual file
- * @v resource    Resource
+ * @v chunked    Chunked resource
  * @v chunk    Chunk number
  * @v offset    Offset to fill in
  * @ret rc    Return status code
  */
 static int wim_chunk_offset ( struct vfat_file *file,
-            struct wim_resource_header *resource,
+            struct wim_chunked_resource *chunked,
             unsigned int chunk, size_t *offset ) {
-  size_t zlen = ( resource->zlen__flags & WIM_RESHDR_ZLEN_MASK );
   unsigned int chunks;
+  size_t *offsets;
   size_t offset_offset;
   size_t offset_len;
   size_t chunks_len;
@@ -85,19 +220,39 @@ static int wim_chunk_offset ( struct vfat_file *file,
   } u;
 
   /* Special case: zero-length files have no chunks */
-  if ( ! resource->len ) {
+  if ( ! chunked->len ) {
     *offset = 0;
     return 0;
   }
 
   /* Calculate chunk parameters */
-  chunks = ( ( resource->len + WIM_CHUNK_LEN - 1 ) / WIM_CHUNK_LEN );
-  offset_len = ( ( resource->len > 0xffffffffULL ) ?
+  chunks = ( ( chunked->len + chunked->chunk_len - 1 ) / chunked->chunk_len );
+
+  /* Treat out-of-range chunks as being at the end of the
+   * resource, to allow for length calculation on the final
+   * chunk.
+   */
+  if ( chunk >= chunks ) {
+    *offset = chunked->zlen;
+    return 0;
+  }
+
+  /* Solid resources record the length of every chunk */
+  if ( chunked->solid ) {
+    offsets = wim_solid_offsets ( file, chunked );
+    if ( ! offsets )
+      return -1;
+    *offset = offsets[chunk];
+    return 0;
+  }
+
+  /* Other resources record the offset of every chunk but the first */
+  offset_len = ( ( chunked->len > 0xffffffffULL ) ?
            sizeof ( u.offset_64 ) : sizeof ( u.offset_32 ) );
   chunks_len = ( ( chunks - 1 ) * offset_len );
 
   /* Sanity check */
-  if ( chunks_len > zlen ) {
+  if ( chunks_len > chunked->zlen ) {
     printf ( "Resource too short for %d chunks\n", chunks );
     return -1;
   }
@@ -108,22 +263,13 @@ static int wim_chunk_offset ( struct vfat_file *file,
     return 0;
   }
 
-  /* Treat out-of-range chunks as being at the end of the
-   * resource, to allow for length calculation on the final
-   * chunk.
-   */
-  if ( chunk >= chunks ) {
-    *offset = zlen;
-    return 0;
-  }
-
   /* Otherwise, read the chunk offset */
   offset_offset = ( ( chunk - 1 ) * offset_len );
-  file->read ( file, &u, ( resource->offset + offset_offset ),
+  file->read ( file, &u, ( chunked->offset + offset_offset ),
          offset_len );
   *offset = ( chunks_len + ( ( offset_len == sizeof ( u.offset_64 ) ) ?
            u.offset_64 : u.offset_32 ) );
-  if ( *offset > zlen ) {
+  if ( *offset > chunked->zlen ) {
     printf ( "Chunk %d offset lies outside resource\n", chunk );
     return -1;
   }
@@ -134,60 +280,69 @@ static int wim_chunk_offset ( struct vfat_file *file,
  * Read chunk from a compressed resource
  *
  * @v file    Virtual file
- * @v header    WIM header
- * @v resource    Resource
+ * @v chunked    Chunked resource
  * @v chunk    Chunk number
  * @v buf    Chunk buffer
  * @ret rc    Return status code
  */
-static int wim_chunk ( struct vfat_file *file, struct wim_header *header,
-           struct wim_resource_header *resource,
-           unsigned int chunk, struct wim_chunk_buffer *buf ) {
-  ssize_t ( * decompress ) ( const void *data, size_t len, void *buf );
+static int wim_chunk ( struct vfat_file *file,
+           struct wim_chunked_resource *chunked,
+           unsigned int chunk, uint8_t *buf ) {
   unsigned int chunks;
   size_t offset;
   size_t next_offset;
   size_t len;
   size_t expected_out_len;
   ssize_t out_len;
+  uint8_t *zbuf;
   int rc;
 
   /* Get chunk compressed data offset and length */
-  if ( ( rc = wim_chunk_offset ( file, resource, chunk,
+  if ( ( rc = wim_chunk_offset ( file, chunked, chunk,
                &offset ) ) != 0 )
     return rc;
-  if ( ( rc = wim_chunk_offset ( file, resource, ( chunk + 1 ),
+  if ( ( rc = wim_chunk_offset ( file, chunked, ( chunk + 1 ),
                &next_offset ) ) != 0 )
     return rc;
+  if ( next_offset < offset ) {
+    printf ( "Chunk %d has negative length\n", chunk );
+    return -1;
+  }
   len = ( next_offset - offset );
 
   /* Calculate uncompressed length */
-  chunks = ( ( resource->len + WIM_CHUNK_LEN - 1 ) / WIM_CHUNK_LEN );
+  chunks = ( ( chunked->len + chunked->chunk_len - 1 ) / chunked->chunk_len );
   expected_out_len = ( ( chunk >= ( chunks - 1 ) ) ?
-           ( resource->len % WIM_CHUNK_LEN ) : WIM_CHUNK_LEN);
+           ( chunked->len - ( chunk * chunked->chunk_len ) ) :
+           chunked->chunk_len );
 
   /* Read possibly-compressed data */
   if ( len == expected_out_len ) {
 
     /* Chunk did not compress; read raw data */
-    file->read ( file, buf->data, ( resource->offset + offset ),
-           len );
+    file->read ( file, buf, ( chunked->offset + offset ), len );
 
   } else {
-    uint8_t zbuf[len];
-
-    /* Read compressed data into a temporary buffer */
-    file->read ( file, zbuf, ( resource->offset + offset ), len );
 
     /* Identify decompressor */
-    if ( header->flags & WIM_HDR_LZX ) {
-      decompress = lzx_decompress;
-    } else {
+    if ( ! chunked->decompress ) {
+      printf ( "Chunk %d is compressed in an uncompressed resource\n",
+               chunk );
       return -1;
     }
 
+    /* Read compressed data into a temporary buffer */
+    zbuf = malloc ( len );
+    if ( ! zbuf ) {
+      printf ( "Could not allocate 0x%lx-byte chunk\n",
+               ( unsigned long ) len );
+      return -1;
+    }
+    file->read ( file, zbuf, ( chunked->offset + offset ), len );
+
     /* Decompress data */
-    out_len = decompress ( zbuf, len, NULL );
+    out_len = chunked->decompress ( zbuf, len, buf, expected_out_len );
+    free ( zbuf );
     if ( out_len < 0 )
       return out_len;
     if ( ( ( size_t ) out_len ) != expected_out_len ) {
@@ -195,12 +350,248 @@ static int wim_chunk ( struct vfat_file *file, struct wim_header *header,
             out_len, (unsigned long)expected_out_len );
       return -1;
     }
-    decompress ( zbuf, len, buf->data );
   }
 
   return 0;
 }
 
+/**
+ * Get cached chunk from a compressed resource
+ *
+ * @v file    Virtual file
+ * @v chunked    Chunked resource
+ * @v chunk    Chunk number
+ * @ret data    Chunk data, or NULL on error
+ */
+static uint8_t * wim_cached_chunk ( struct vfat_file *file,
+                                    struct wim_chunked_resource *chunked,
+                                    unsigned int chunk ) {
+  struct wim_chunk_cache *entry;
+  struct wim_chunk_cache *victim;
+  unsigned int i;
+
+  /* Allocate cache, if required */
+  if ( ! wim_chunk_cache ) {
+    wim_chunk_cache = calloc ( WIM_CHUNK_CACHE_COUNT,
+                               sizeof ( *wim_chunk_cache ) );
+    if ( ! wim_chunk_cache ) {
+      printf ( "Could not allocate WIM chunk cache\n" );
+      return NULL;
+    }
+  }
+
+  /* Look for chunk in cache, remembering least recently used entry */
+  victim = &wim_chunk_cache[0];
+  for ( i = 0 ; i < WIM_CHUNK_CACHE_COUNT ; i++ ) {
+    entry = &wim_chunk_cache[i];
+    if ( ( entry->file == file ) &&
+         ( entry->resource_offset == chunked->offset ) &&
+         ( entry->chunk == chunk ) ) {
+      entry->used = ++wim_chunk_cache_used;
+      return entry->data;
+    }
+    if ( ( ! entry->file ) ||
+         ( ( victim->file ) && ( entry->used < victim->used ) ) )
+      victim = entry;
+  }
+
+  /* Ensure that the least recently used entry is large enough.
+   * Solid resources may use very large chunks, so only one chunk
+   * larger than the default chunk length is ever retained.
+   */
+  victim->file = NULL;
+  if ( victim->size < chunked->chunk_len ) {
+    if ( chunked->chunk_len > WIM_CHUNK_LEN ) {
+      for ( i = 0 ; i < WIM_CHUNK_CACHE_COUNT ; i++ ) {
+        entry = &wim_chunk_cache[i];
+        if ( entry->size > WIM_CHUNK_LEN ) {
+          free ( entry->data );
+          entry->data = NULL;
+          entry->size = 0;
+          entry->file = NULL;
+        }
+      }
+    }
+    free ( victim->data );
+    victim->size = 0;
+    victim->data = malloc ( chunked->chunk_len );
+    if ( ! victim->data ) {
+      printf ( "Could not allocate 0x%lx-byte chunk buffer\n",
+               ( unsigned long ) chunked->chunk_len );
+      return NULL;
+    }
+    victim->size = chunked->chunk_len;
+  }
+
+  /* Read chunk into least recently used entry */
+  if ( wim_chunk ( file, chunked, chunk, victim->data ) != 0 )
+    return NULL;
+  victim->file = file;
+  victim->resource_offset = chunked->offset;
+  victim->chunk = chunk;
+  victim->used = ++wim_chunk_cache_used;
+
+  return victim->data;
+}
+
+/**
+ * Describe a (non-solid) compressed resource
+ *
+ * @v file    Virtual file
+ * @v header    WIM header
+ * @v resource    Resource
+ * @v chunked    Chunked resource to fill in
+ * @ret rc    Return status code
+ */
+static int wim_chunked ( struct vfat_file *file, struct wim_header *header,
+                         struct wim_resource_header *resource,
+                         struct wim_chunked_resource *chunked ) {
+  size_t zlen = ( resource->zlen__flags & WIM_RESHDR_ZLEN_MASK );
+  unsigned int compression;
+
+  /* Sanity check */
+  if ( ( resource->offset + zlen ) > file->len ) {
+    printf ( "Resource exceeds length of file\n" );
+    return -1;
+  }
+
+  /* The compression format and chunk length are global */
+  chunked->offset = resource->offset;
+  chunked->zlen = zlen;
+  chunked->len = resource->len;
+  chunked->chunk_len = ( header->chunk_len ?
+                         header->chunk_len : WIM_CHUNK_LEN );
+  chunked->solid = 0;
+  if ( header->flags & WIM_HDR_LZX ) {
+    compression = WIM_COMPRESSION_LZX;
+  } else if ( header->flags & WIM_HDR_XPRESS ) {
+    compression = WIM_COMPRESSION_XPRESS;
+  } else if ( header->flags & WIM_HDR_LZMS ) {
+    compression = WIM_COMPRESSION_LZMS;
+  } else {
+    compression = WIM_COMPRESSION_NONE;
+  }
+
+  return wim_decompressor ( compression, chunked );
+}
+
+/**
+ * Locate a stream within a solid resource
+ *
+ * @v file    Virtual file
+ * @v header    WIM header
+ * @v resource    Stream resource
+ * @v chunked    Solid resource to fill in
+ * @v offset    Offset of stream within solid resource to fill in
+ * @ret rc    Return status code
+ *
+ * The stream's lookup table entry is found by scanning the lookup
+ * table, which also identifies the run of solid resources preceding
+ * it.  The stream offset is relative to the start of that run.
+ */
+static int wim_solid ( struct vfat_file *file, struct wim_header *header,
+                       struct wim_resource_header *resource,
+                       struct wim_chunked_resource *chunked,
+                       size_t *offset ) {
+  struct wim_lookup_entry entry;
+  struct wim_solid_header solid;
+  size_t entry_offset;
+  size_t run_offset = 0;
+  size_t stream_offset;
+  size_t zlen;
+  int in_run = 0;
+  int found = 0;
+  int rc;
+
+  /* Use most recently located stream, if applicable */
+  if ( ( wim_solid_stream.file == file ) &&
+       ( memcmp ( &wim_solid_stream.resource, resource,
+                  sizeof ( *resource ) ) == 0 ) ) {
+    memcpy ( chunked, &wim_solid_stream.chunked, sizeof ( *chunked ) );
+    *offset = wim_solid_stream.offset;
+    return 0;
+  }
+
+  /* Find stream, and the start of its run of solid resources */
+  for ( entry_offset = 0 ;
+        ( entry_offset + sizeof ( entry ) ) <= header->lookup.len ;
+        entry_offset += sizeof ( entry ) ) {
+
+    /* Read entry */
+    if ( ( rc = wim_read ( file, header, &header->lookup, &entry,
+                           entry_offset, sizeof ( entry ) ) ) != 0 )
+      return rc;
+
+    /* Track runs of solid resources, and look for our stream */
+    if ( entry.resource.zlen__flags & WIM_RESHDR_PACKED_STREAMS ) {
+      if ( entry.resource.len == WIM_SOLID_LEN ) {
+        if ( ! in_run )
+          run_offset = entry_offset;
+        in_run = 1;
+        continue;
+      }
+      if ( memcmp ( &entry.resource, resource, sizeof ( *resource ) ) == 0 ) {
+        found = 1;
+        break;
+      }
+    }
+    in_run = 0;
+  }
+  if ( ! found ) {
+    printf ( "Cannot find solid stream at +0x%lx\n",
+             ( unsigned long ) resource->offset );
+    return -1;
+  }
+
+  /* Find solid resource containing the stream */
+  stream_offset = resource->offset;
+  for ( entry_offset = run_offset ; ; entry_offset += sizeof ( entry ) ) {
+
+    /* Read solid resource entry */
+    if ( ( rc = wim_read ( file, header, &header->lookup, &entry,
+                           entry_offset, sizeof ( entry ) ) ) != 0 )
+      return rc;
+    if ( ( entry.resource.len != WIM_SOLID_LEN ) ||
+         ( ! ( entry.resource.zlen__flags & WIM_RESHDR_PACKED_STREAMS ) ) ) {
+      printf ( "Solid stream at +0x%lx lies outside its resources\n",
+               ( unsigned long ) resource->offset );
+      return -1;
+    }
+
+    /* Read solid resource header */
+    zlen = ( entry.resource.zlen__flags & WIM_RESHDR_ZLEN_MASK );
+    if ( ( zlen < sizeof ( solid ) ) ||
+         ( ( entry.resource.offset + zlen ) > file->len ) ) {
+      printf ( "Solid resource exceeds length of file\n" );
+      return -1;
+    }
+    file->read ( file, &solid, entry.resource.offset, sizeof ( solid ) );
+
+    /* Stop if this resource contains the stream */
+    if ( ( stream_offset + resource->len ) <= solid.len )
+      break;
+    stream_offset -= solid.len;
+  }
+
+  /* Describe solid resource */
+  chunked->offset = ( entry.resource.offset + sizeof ( solid ) );
+  chunked->zlen = ( zlen - sizeof ( solid ) );
+  chunked->len = solid.len;
+  chunked->chunk_len = solid.chunk_len;
+  chunked->solid = 1;
+  if ( ( rc = wim_decompressor ( solid.compression, chunked ) ) != 0 )
+    return rc;
+  *offset = stream_offset;
+
+  /* Remember stream */
+  wim_solid_stream.file = file;
+  memcpy ( &wim_solid_stream.resource, resource, sizeof ( *resource ) );
+  memcpy ( &wim_solid_stream.chunked, chunked, sizeof ( *chunked ) );
+  wim_solid_stream.offset = stream_offset;
+
+  return 0;
+}
+
 /**
  * Read from a (possibly compressed) resource
  *
@@ -215,10 +606,10 @@ static int wim_chunk ( struct vfat_file *file, struct wim_header *header,
 int wim_read ( struct vfat_file *file, struct wim_header *header,
          struct wim_resource_header *resource, void *data,
          size_t offset, size_t len ) {
-  static struct vfat_file *cached_file;
-  static size_t cached_resource_offset;
-  static unsigned int cached_chunk;
+  struct wim_chunked_resource chunked;
   size_t zlen = ( resource->zlen__flags & WIM_RESHDR_ZLEN_MASK );
+  size_t solid_offset;
+  uint8_t *buf;
   unsigned int chunk;
   size_t skip_len;
   size_t frag_len;
@@ -228,46 +619,46 @@ int wim_read ( struct vfat_file *file, struct wim_header *header,
   if ( ( offset + len ) > resource->len ) {
     return -1;
   }
-  if ( ( resource->offset + zlen ) > file->len ) {
-    printf ( "Resource exceeds length of file\n" );
-    return -1;
-  }
 
   /* If resource is uncompressed, just read the raw data */
   if ( ! ( resource->zlen__flags & ( WIM_RESHDR_COMPRESSED |
              WIM_RESHDR_PACKED_STREAMS ) ) ) {
+    if ( ( resource->offset + zlen ) > file->len ) {
+      printf ( "Resource exceeds length of file\n" );
+      return -1;
+    }
     file->read ( file, data, ( resource->offset + offset ), len );
     return 0;
   }
 
+  /* Identify chunked resource holding the data */
+  if ( resource->zlen__flags & WIM_RESHDR_PACKED_STREAMS ) {
+    if ( ( rc = wim_solid ( file, header, resource, &chunked,
+                            &solid_offset ) ) != 0 )
+      return rc;
+    offset += solid_offset;
+  } else {
+    if ( ( rc = wim_chunked ( file, header, resource, &chunked ) ) != 0 )
+      return rc;
+  }
+
   /* Read from each chunk overlapping the target region */
   while ( len ) {
 
     /* Calculate chunk number */
-    chunk = ( offset / WIM_CHUNK_LEN );
+    chunk = ( offset / chunked.chunk_len );
 
     /* Read chunk, if not already cached */
-    if ( ( file != cached_file ) ||
-         ( resource->offset != cached_resource_offset ) ||
-         ( chunk != cached_chunk ) ) {
-
-      /* Read chunk */
-      if ( ( rc = wim_chunk ( file, header, resource, chunk,
-            &wim_chunk_buffer ) ) != 0 )
-        return rc;
-
-      /* Update cache */
-      cached_file = file;
-      cached_resource_offset = resource->offset;
-      cached_chunk = chunk;
-    }
+    buf = wim_cached_chunk ( file, &chunked, chunk );
+    if ( ! buf )
+      return -1;
 
     /* Copy fragment from this chunk */
-    skip_len = ( offset % WIM_CHUNK_LEN );
-    frag_len = ( WIM_CHUNK_LEN - skip_len );
+    skip_len = ( offset % chunked.chunk_len );
+    frag_len = ( chunked.chunk_len - skip_len );
     if ( frag_len > len )
       frag_len = len;
-    memcpy ( data, ( wim_chunk_buffer.data + skip_len ), frag_len );
+    memcpy ( data, ( buf + skip_len ), frag_len );
 
     /* Move to next chunk */
     data = (char *)data + frag_len;
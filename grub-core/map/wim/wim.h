@@ -99,6 +99,8 @@ enum wim_header_flags {
 	WIM_HDR_XPRESS = 0x00020000,
 	/** WIM uses LZX compression */
 	WIM_HDR_LZX = 0x00040000,
+	/** WIM uses LZMS compression */
+	WIM_HDR_LZMS = 0x00080000,
 };
 
 /** A WIM file hash */
@@ -119,13 +121,81 @@ struct wim_lookup_entry {
 	struct wim_hash hash;
 } __attribute__ (( packed ));
 
-/** WIM chunk length */
+/** WIM chunk length
+ *
+ * Used when the WIM header does not specify a chunk length.
+ */
 #define WIM_CHUNK_LEN 32768
 
-/** A WIM chunk buffer */
-struct wim_chunk_buffer {
-	/** Data */
-	uint8_t data[WIM_CHUNK_LEN];
+/** Uncompressed length recorded in lookup table entries for solid resources
+ *
+ * The lookup table entries for streams within a solid resource
+ * follow the entries for the solid resources themselves.  The offset
+ * of each such stream is relative to the start of the uncompressed
+ * data of the run of consecutive solid resources.
+ */
+#define WIM_SOLID_LEN 0x100000000ULL
+
+/** Solid resource compression formats */
+enum wim_compression {
+	/** Uncompressed */
+	WIM_COMPRESSION_NONE = 0,
+	/** Xpress compression */
+	WIM_COMPRESSION_XPRESS = 1,
+	/** LZX compression */
+	WIM_COMPRESSION_LZX = 2,
+	/** LZMS compression */
+	WIM_COMPRESSION_LZMS = 3,
+};
+
+/** A solid resource header
+ *
+ * The header is followed by a table of compressed chunk lengths (not
+ * offsets), one for every chunk, and then by the chunks themselves.
+ */
+struct wim_solid_header {
+	/** Uncompressed length */
+	uint64_t len;
+	/** Chunk length */
+	uint32_t chunk_len;
+	/** Compression format */
+	uint32_t compression;
+} __attribute__ (( packed ));
+
+/** A WIM chunked resource */
+struct wim_chunked_resource {
+	/** Offset of chunk table within file */
+	size_t offset;
+	/** Length of chunk table and chunks */
+	size_t zlen;
+	/** Uncompressed length */
+	size_t len;
+	/** Chunk length */
+	size_t chunk_len;
+	/** Chunk table holds chunk lengths for every chunk */
+	int solid;
+	/** Decompressor */
+	ssize_t ( * decompress ) ( const void *data, size_t len, void *buf,
+				   size_t buf_len );
+};
+
+/** Number of chunks held in the WIM chunk cache */
+#define WIM_CHUNK_CACHE_COUNT 8
+
+/** A WIM chunk cache entry */
+struct wim_chunk_cache {
+	/** Virtual file, or NULL if entry is unused */
+	struct vfat_file *file;
+	/** Chunk table offset */
+	size_t resource_offset;
+	/** Chunk number */
+	unsigned int chunk;
+	/** Time of last use */
+	unsigned int used;
+	/** Chunk data */
+	uint8_t *data;
+	/** Size of chunk data buffer */
+	size_t size;
 };
 
 /** Security data */
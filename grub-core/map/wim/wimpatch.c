@@ -104,6 +104,10 @@ union wim_patch_regions {
   struct wim_patch_region region[0];
 };
 
+/** Maximum number of regions in a patched WIM file */
+#define WIM_PATCH_MAX_REGIONS \
+  ( sizeof ( union wim_patch_regions ) / sizeof ( struct wim_patch_region ) )
+
 /** An injected directory entry */
 struct wim_patch_dir_entry {
   /** Directory entry */
@@ -142,6 +146,12 @@ struct wim_patch {
   struct wim_patch_dir dir;
   /** Patched regions */
   union wim_patch_regions regions;
+  /** Used patched regions, sorted by starting offset */
+  struct wim_patch_region *index[WIM_PATCH_MAX_REGIONS];
+  /** Highest end offset of any region up to each index entry */
+  size_t index_end[WIM_PATCH_MAX_REGIONS];
+  /** Number of used patched regions */
+  unsigned int count;
 };
 
 /**
@@ -162,7 +172,7 @@ static size_t wim_align ( size_t len ) {
  */
 static void wim_hash ( struct vfat_file *vfile, struct wim_hash *hash ) {
   uint8_t ctx[SHA1_CTX_SIZE];
-  uint8_t buf[512];
+  uint8_t buf[4096];
   size_t offset;
   size_t len;
 
@@ -677,8 +687,8 @@ static int wim_construct_patch ( struct vfat_file *file,
     return 0;
 
   /* Construct injected files */
-  for ( i = 0 ; i < VDISK_MAX_FILES ; i++ ) {
-    vfile = &vfat_files[i];
+  for ( i = 0 ; i < vfat_file_count ; i++ ) {
+    vfile = vfat_files[i];
     if ( ! wim_inject_file ( vfile ) )
       continue;
     offset = wim_construct_region ( &regions->file[i], vfile->name,
@@ -745,6 +755,46 @@ static int wim_construct_patch ( struct vfat_file *file,
   return 0;
 }
 
+/**
+ * Construct index of used WIM patch regions
+ *
+ * @v patch    WIM patch
+ *
+ * Regions are sorted by starting offset.  Regions sharing a starting
+ * offset keep their original order, so that a region nested within
+ * another is still patched after it.
+ */
+static void wim_index_patch ( struct wim_patch *patch ) {
+  struct wim_patch_region *region;
+  size_t end;
+  unsigned int i;
+  unsigned int j;
+
+  /* Insert used regions in order of starting offset */
+  patch->count = 0;
+  for ( i = 0 ; i < WIM_PATCH_MAX_REGIONS ; i++ ) {
+    region = &patch->regions.region[i];
+    if ( ! region->patch )
+      continue;
+    for ( j = patch->count ; j > 0 ; j-- ) {
+      if ( patch->index[ j - 1 ]->offset <= region->offset )
+        break;
+      patch->index[j] = patch->index[ j - 1 ];
+    }
+    patch->index[j] = region;
+    patch->count++;
+  }
+
+  /* Record running maximum end offset */
+  end = 0;
+  for ( i = 0 ; i < patch->count ; i++ ) {
+    region = patch->index[i];
+    if ( end < ( region->offset + region->len ) )
+      end = ( region->offset + region->len );
+    patch->index_end[i] = end;
+  }
+}
+
 /**
  * Patch WIM file
  *
@@ -759,6 +809,9 @@ void patch_wim ( struct vfat_file *file, void *data, size_t offset,
   struct wim_patch *patch = &cached_patch;
   struct wim_patch_region *region;
   unsigned int boot_index;
+  unsigned int low;
+  unsigned int high;
+  unsigned int mid;
   unsigned int i;
   int inject;
   int rc;
@@ -775,13 +828,27 @@ void patch_wim ( struct vfat_file *file, void *data, size_t offset,
               patch ) ) != 0 ) {
       die ( "Could not patch WIM %s\n", file->name );
     }
+    wim_index_patch ( patch );
   }
   patch = &cached_patch;
 
+  /* Find first region which may end after this offset */
+  low = 0;
+  high = patch->count;
+  while ( low < high ) {
+    mid = ( ( low + high ) / 2 );
+    if ( patch->index_end[mid] <= offset ) {
+      low = ( mid + 1 );
+    } else {
+      high = mid;
+    }
+  }
+
   /* Patch regions */
-  for ( i = 0 ; i < ( sizeof ( patch->regions ) /
-          sizeof ( patch->regions.region[0] ) ) ; i++ ) {
-    region = &patch->regions.region[i];
+  for ( i = low ; i < patch->count ; i++ ) {
+    region = patch->index[i];
+    if ( region->offset >= ( offset + len ) )
+      break;
     if ( ( rc = wim_patch_region ( patch, region, data, offset,
                  len ) ) != 0 ) {
       die ( "Could not patch WIM %s %s at [0x%lx,0x%lx)\n",
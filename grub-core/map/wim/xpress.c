@@ -0,0 +1,235 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * @file
+ *
+ * XPRESS Huffman decompression
+ *
+ * This algorithm is derived from the "LZ77+Huffman" section of the
+ * document "[MS-XCA]: Xpress Compression Algorithm", and from the
+ * file xpress_decompress.c in the wimlib source code.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <huffman.h>
+#include <xpress.h>
+
+/**
+ * XPRESS decompressor
+ *
+ * Allocated on first use, since its lookup table is too large to
+ * carry on the stack or in the module image.
+ */
+static struct xpress *xpress_decompressor;
+
+/**
+ * Get 16-bit word from XPRESS input stream
+ *
+ * @v input    Input stream
+ * @ret word    Next little-endian word, or zero beyond end of stream
+ */
+static inline __attribute__ (( always_inline )) uint32_t
+xpress_word ( struct xpress_input_stream *input ) {
+  const uint8_t *src;
+
+  if ( ( input->offset + 2 ) > input->len )
+    return 0;
+  src = ( input->data + input->offset );
+  input->offset += 2;
+  return ( src[0] | ( src[1] << 8 ) );
+}
+
+/**
+ * Consume bits from XPRESS bitstream
+ *
+ * @v input    Input stream
+ * @v bits    Number of bits to consume (at most 16)
+ *
+ * The accumulator always holds at least 16 bits, and is refilled
+ * with exactly one word as soon as it drops below that.  This fixes
+ * the point within the input stream from which any interleaved
+ * match length bytes are taken.
+ */
+static inline __attribute__ (( always_inline )) void
+xpress_consume ( struct xpress_input_stream *input, unsigned int bits ) {
+
+  input->accumulator <<= bits;
+  input->extra -= bits;
+  if ( input->extra < 0 ) {
+    input->accumulator |= ( xpress_word ( input ) << ( -input->extra ) );
+    input->extra += 16;
+  }
+}
+
+/**
+ * Get byte from XPRESS input stream
+ *
+ * @v input    Input stream
+ * @ret byte    Byte, or negative error
+ */
+static int xpress_byte ( struct xpress_input_stream *input ) {
+
+  if ( input->offset >= input->len )
+    return -1;
+  return input->data[ input->offset++ ];
+}
+
+/**
+ * Get match length from XPRESS input stream
+ *
+ * @v input    Input stream
+ * @v len    Length from Huffman symbol
+ * @ret len    Match length, or negative error
+ */
+static int xpress_match_len ( struct xpress_input_stream *input,
+                              unsigned int len ) {
+  int byte;
+  int byte_hi;
+
+  /* Short lengths are held entirely within the symbol */
+  if ( len < 0xf )
+    return ( len + XPRESS_MIN_MATCH_LEN );
+
+  /* Longer lengths have an extra byte */
+  if ( ( byte = xpress_byte ( input ) ) < 0 )
+    return byte;
+  len += byte;
+  if ( len < ( 0xf + 0xff ) )
+    return ( len + XPRESS_MIN_MATCH_LEN );
+
+  /* Longest lengths have an extra 16-bit word */
+  if ( ( ( byte = xpress_byte ( input ) ) < 0 ) ||
+       ( ( byte_hi = xpress_byte ( input ) ) < 0 ) )
+    return -1;
+  return ( ( byte | ( byte_hi << 8 ) ) + XPRESS_MIN_MATCH_LEN );
+}
+
+/**
+ * Decompress XPRESS-compressed data
+ *
+ * @v data    Compressed data
+ * @v len    Length of compressed data
+ * @v buf    Decompression buffer
+ * @v buf_len    Length of decompression buffer
+ * @ret out_len    Length of decompressed data, or negative error
+ */
+ssize_t xpress_decompress ( const void *data, size_t len, void *buf,
+                            size_t buf_len ) {
+  struct xpress *xpress = xpress_decompressor;
+  struct xpress_input_stream input;
+  const uint8_t *lengths = data;
+  uint8_t *out = buf;
+  huffman_entry_t entry;
+  size_t out_offset = 0;
+  unsigned int symbol;
+  unsigned int offset_bits;
+  size_t match_offset;
+  int match_len;
+  unsigned int i;
+  int rc;
+
+  /* Sanity checks */
+  if ( buf_len > XPRESS_BLOCK_LEN ) {
+    printf ( "XPRESS cannot handle 0x%lx-byte chunks\n",
+             ( unsigned long ) buf_len );
+    return -1;
+  }
+  if ( len < ( XPRESS_CODES / 2 ) ) {
+    printf ( "XPRESS data too short for Huffman table\n" );
+    return -1;
+  }
+
+  /* Allocate decompressor, if required */
+  if ( ! xpress ) {
+    xpress = malloc ( sizeof ( *xpress ) );
+    if ( ! xpress ) {
+      printf ( "Could not allocate XPRESS decompressor\n" );
+      return -1;
+    }
+    xpress->alphabet.table = xpress->table;
+    xpress_decompressor = xpress;
+  }
+
+  /* Generate Huffman alphabet from packed 4-bit code lengths */
+  for ( i = 0 ; i < ( XPRESS_CODES / 2 ) ; i++ ) {
+    xpress->lengths[ 2 * i ] = ( lengths[i] & 0x0f );
+    xpress->lengths[ 2 * i + 1 ] = ( lengths[i] >> 4 );
+  }
+  if ( ( rc = huffman_alphabet ( &xpress->alphabet, xpress->lengths,
+                                 XPRESS_CODES ) ) != 0 ) {
+    printf ( "Could not generate XPRESS alphabet\n" );
+    return rc;
+  }
+
+  /* Initialise bitstream with two words */
+  input.data = data;
+  input.len = len;
+  input.offset = ( XPRESS_CODES / 2 );
+  input.accumulator = ( xpress_word ( &input ) << 16 );
+  input.accumulator |= xpress_word ( &input );
+  input.extra = 16;
+
+  /* Decode literals and matches */
+  while ( out_offset < buf_len ) {
+
+    /* Decode symbol */
+    entry = huffman_lookup ( &xpress->alphabet,
+                             ( input.accumulator >> 16 ) );
+    xpress_consume ( &input, huffman_len ( entry ) );
+    symbol = huffman_raw ( entry );
+
+    /* Literals are copied directly */
+    if ( symbol < XPRESS_LIT_CODES ) {
+      out[ out_offset++ ] = symbol;
+      continue;
+    }
+
+    /* Matches carry their offset in the bitstream, and any extra
+     * length in the byte stream following the bits already loaded.
+     */
+    symbol -= XPRESS_LIT_CODES;
+    offset_bits = ( symbol >> 4 );
+    match_offset = ( ( 1 << offset_bits ) |
+                     ( ( input.accumulator >> 16 ) >>
+                       ( 16 - offset_bits ) ) );
+    match_len = xpress_match_len ( &input, ( symbol & 0xf ) );
+    if ( match_len < 0 ) {
+      printf ( "XPRESS match length overrun\n" );
+      return -1;
+    }
+    xpress_consume ( &input, offset_bits );
+
+    /* Copy match, which may overlap itself */
+    if ( ( match_offset > out_offset ) ||
+         ( ( size_t ) match_len > ( buf_len - out_offset ) ) ) {
+      printf ( "XPRESS match overrun\n" );
+      return -1;
+    }
+    for ( ; match_len ; match_len-- ) {
+      out[out_offset] = out[ out_offset - match_offset ];
+      out_offset++;
+    }
+  }
+
+  return out_offset;
+}
@@ -0,0 +1,86 @@
+#ifndef _XPRESS_H
+#define _XPRESS_H
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * @file
+ *
+ * XPRESS Huffman decompression
+ *
+ * The format is documented as "LZ77+Huffman" in the document
+ * "[MS-XCA]: Xpress Compression Algorithm".
+ *
+ */
+
+#include <stdint.h>
+#include <huffman.h>
+
+/** Number of XPRESS Huffman codes */
+#define XPRESS_CODES 512
+
+/** Number of literal codes */
+#define XPRESS_LIT_CODES 256
+
+/** Maximum length of data covered by a single Huffman table
+ *
+ * WIM chunks never exceed this length, so each chunk consists of
+ * exactly one block.
+ */
+#define XPRESS_BLOCK_LEN 65536
+
+/** Minimum match length */
+#define XPRESS_MIN_MATCH_LEN 3
+
+/** An XPRESS input stream */
+struct xpress_input_stream {
+	/** Data */
+	const uint8_t *data;
+	/** Length */
+	size_t len;
+	/** Offset within stream */
+	size_t offset;
+	/** Accumulator
+	 *
+	 * The next bit of the bitstream is held in the most
+	 * significant bit.
+	 */
+	uint32_t accumulator;
+	/** Number of bits in accumulator beyond the first 16 */
+	int extra;
+};
+
+/** XPRESS decompressor */
+struct xpress {
+	/** Huffman alphabet */
+	struct huffman_alphabet alphabet;
+	/** Raw symbols
+	 *
+	 * Must immediately follow the Huffman alphabet.
+	 */
+	huffman_raw_symbol_t raw[XPRESS_CODES];
+	/** Code lengths */
+	uint8_t lengths[XPRESS_CODES];
+	/** Lookup table */
+	huffman_entry_t table[ HUFFMAN_TABLE_SIZE ( XPRESS_CODES ) ];
+};
+
+extern ssize_t xpress_decompress ( const void *data, size_t len, void *buf,
+				   size_t buf_len );
+
+#endif /* _XPRESS_H */
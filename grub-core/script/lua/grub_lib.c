@@ -286,7 +286,13 @@ enum_file (const char *name, const struct grub_dirhook_info *info,
   lua_pushvalue (state, 1);
   lua_pushstring (state, name);
   lua_pushinteger (state, info->dir != 0);
-  lua_call (state, 2, 1);
+  /* Pass the size where the filesystem reports it, so that callers
+     need not open each file.  */
+  if (info->sizeset)
+    lua_pushinteger (state, info->size);
+  else
+    lua_pushnil (state);
+  lua_call (state, 3, 1);
   result = lua_tointeger (state, -1);
   lua_pop (state, 1);
 
@@ -546,6 +552,8 @@ grub_lua_file_exist (lua_State *state)
   return 1;
 }
 
+#define FILE_CRC32_BUF_SIZE 0x100000
+
 static int
 grub_lua_file_crc32 (lua_State *state)
 {
@@ -553,18 +561,26 @@ grub_lua_file_crc32 (lua_State *state)
   const char *name;
   int crc;
   char crcstr[10];
-  char buf[GRUB_DISK_SECTOR_SIZE];
+  char *buf;
   grub_ssize_t size;
   name = luaL_checkstring (state, 1);
+  buf = grub_malloc (FILE_CRC32_BUF_SIZE);
+  if (! buf)
+    {
+      save_errno (state);
+      return 0;
+    }
   file = grub_file_open (name, GRUB_FILE_TYPE_TO_HASH);
   if (file)
     {
       crc = 0;
-      while ((size = grub_file_read (file, buf, sizeof (buf))) > 0)
+      while ((size = grub_file_read (file, buf, FILE_CRC32_BUF_SIZE)) > 0)
         crc = grub_getcrc32c (crc, buf, size);
+      grub_file_close (file);
       grub_snprintf (crcstr, 10, "%08x", crc);
       lua_pushstring (state, crcstr);
     }
+  grub_free (buf);
   return 1;
 }
 
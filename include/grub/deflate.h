@@ -19,6 +19,8 @@
 #ifndef GRUB_DEFLATE_HEADER
 #define GRUB_DEFLATE_HEADER 1
 
+#include <grub/file.h>
+
 grub_ssize_t
 grub_zlib_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
 		      char *outbuf, grub_size_t outsize);
@@ -27,4 +29,13 @@ grub_ssize_t
 grub_deflate_decompress (char *inbuf, grub_size_t insize, grub_off_t off,
 			 char *outbuf, grub_size_t outsize);
 
+/* Inflate FILE, opened through the gzip filter, to the end so that its
+   random access index covers the whole file.  */
+grub_err_t
+grub_gzio_index_build (grub_file_t file);
+
+/* Serialize the random access index of FILE into a new buffer *DATA.  */
+grub_err_t
+grub_gzio_index_export (grub_file_t file, void **data, grub_size_t *size);
+
 #endif
@@ -135,6 +135,13 @@ struct grub_disk
   /* The id used by the disk cache manager.  */
   unsigned long id;
 
+  /* Byte address just past the end of the previous read.  */
+  grub_uint64_t ra_next;
+
+  /* Current read-ahead window in units of GRUB_DISK_CACHE_SIZE, grown
+     while reads are sequential.  */
+  unsigned int ra_window;
+
   /* The partition information. This is machine-specific.  */
   struct grub_partition *partition;
 
@@ -163,14 +170,21 @@ typedef struct grub_disk_memberlist *grub_disk_memberlist_t;
 #define GRUB_DISK_SECTOR_SIZE	0x200
 #define GRUB_DISK_SECTOR_BITS	9
 
-/* The maximum number of disk caches.  */
-#define GRUB_DISK_CACHE_NUM	1021
+/* The number of entries in each disk cache set.  */
+#define GRUB_DISK_CACHE_WAYS	4
+
+/* The default number of disk cache sets.  */
+#define GRUB_DISK_CACHE_SETS	256
 
 /* The size of a disk cache in 512B units. Must be at least as big as the
    largest supported sector size, currently 16K.  */
 #define GRUB_DISK_CACHE_BITS	6
 #define GRUB_DISK_CACHE_SIZE	(1 << GRUB_DISK_CACHE_BITS)
 
+/* The maximum read-ahead window in units of GRUB_DISK_CACHE_SIZE.  Once a
+   sequential stream reaches it, large reads bypass the disk cache.  */
+#define GRUB_DISK_READAHEAD_MAX	32
+
 #define GRUB_DISK_MAX_MAX_AGGLOMERATE ((1 << (30 - GRUB_DISK_CACHE_BITS - GRUB_DISK_SECTOR_BITS)) - 1)
 
 /* Return value of grub_disk_get_size() in case disk size is unknown. */
@@ -217,14 +231,34 @@ extern grub_err_t (*EXPORT_VAR(grub_disk_write_weak)) (grub_disk_t disk,
 						       grub_off_t offset,
 						       grub_size_t size,
 						       const void *buf);
+/* Incremented by every grub_disk_write, so that caches built from
+   filesystem contents can tell when they may be stale.  */
+extern unsigned long EXPORT_VAR(grub_disk_write_count);
+
+/* Called when an existing disk name may now refer to different contents,
+   e.g. when loopback replaces its image.  Drops the cached sectors and
+   filesystem probe results.  */
+void EXPORT_FUNC(grub_disk_changed) (void);
+/* Incremented by every grub_disk_changed, for caches kept by modules.  */
+extern unsigned long EXPORT_VAR(grub_disk_change_count);
 
 
 grub_uint64_t EXPORT_FUNC(grub_disk_get_size) (grub_disk_t disk);
 
-#if DISK_CACHE_STATS
+struct grub_disk_cache_stats
+{
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  /* Number of sets and of entries currently holding data.  */
+  unsigned sets;
+  unsigned used;
+};
+
 void
-EXPORT_FUNC(grub_disk_cache_get_performance) (unsigned long *hits, unsigned long *misses);
-#endif
+EXPORT_FUNC(grub_disk_cache_get_stats) (struct grub_disk_cache_stats *stats);
+void EXPORT_FUNC(grub_disk_cache_reset_stats) (void);
+grub_err_t EXPORT_FUNC(grub_disk_cache_resize) (unsigned sets);
 
 extern void (* EXPORT_VAR(grub_disk_firmware_fini)) (void);
 extern int EXPORT_VAR(grub_disk_firmware_is_tainted);
@@ -249,9 +283,13 @@ struct grub_disk_cache
   grub_disk_addr_t sector;
   char *data;
   int lock;
+  /* Value of the cache clock when this entry was last used.  */
+  grub_uint32_t last_used;
 };
 
-extern struct grub_disk_cache EXPORT_VAR(grub_disk_cache_table)[GRUB_DISK_CACHE_NUM];
+/* GRUB_DISK_CACHE_WAYS entries for each of grub_disk_cache_sets sets.  */
+extern struct grub_disk_cache *EXPORT_VAR(grub_disk_cache_table);
+extern unsigned EXPORT_VAR(grub_disk_cache_sets);
 
 #if defined (GRUB_UTIL)
 void grub_lvm_init (void);
@@ -264,6 +264,9 @@ struct grub_ext3_journal_sblock
 };
 
 #define EXT4_EXT_MAGIC		0xf30a
+/* An extent longer than this is unwritten (preallocated) and reads as
+   zeros; its length is the excess.  */
+#define EXT4_EXT_INIT_MAX_LEN	32768
 
 struct grub_ext4_extent_header
 {
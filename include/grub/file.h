@@ -185,9 +185,10 @@ typedef enum grub_file_filter_id
     GRUB_FILE_FILTER_LZMAIO,
     GRUB_FILE_FILTER_XZIO,
     GRUB_FILE_FILTER_LZOPIO,
+    GRUB_FILE_FILTER_ZSTDIO,
     GRUB_FILE_FILTER_MAX,
     GRUB_FILE_FILTER_COMPRESSION_FIRST = GRUB_FILE_FILTER_GZIO,
-    GRUB_FILE_FILTER_COMPRESSION_LAST = GRUB_FILE_FILTER_LZOPIO,
+    GRUB_FILE_FILTER_COMPRESSION_LAST = GRUB_FILE_FILTER_ZSTDIO,
   } grub_file_filter_id_t;
 
 typedef grub_file_t (*grub_file_filter_t) (grub_file_t in, enum grub_file_type type);
@@ -236,6 +237,20 @@ grub_file_seekable (const grub_file_t file)
   return !file->not_easily_seekable;
 }
 
+/* Size the input buffer of a decompression filter on top of FILE: small
+   files are read whole, large ones MAX bytes at a time, so the underlying
+   filesystem sees a few large reads rather than many small ones.  */
+static inline grub_size_t
+grub_file_filter_bufsize (const grub_file_t file, grub_size_t min,
+			  grub_size_t max)
+{
+  grub_size_t size = min;
+
+  while (size < max && size < file->size)
+    size <<= 1;
+  return size;
+}
+
 grub_file_t
 grub_file_offset_open (grub_file_t parent, enum grub_file_type type,
 		       grub_off_t start, grub_off_t size);
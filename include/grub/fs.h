@@ -39,8 +39,10 @@ struct grub_dirhook_info
   unsigned mtimeset:1;
   unsigned case_insensitive:1;
   unsigned inodeset:1;
+  unsigned sizeset:1;
   grub_int32_t mtime;
   grub_uint64_t inode;
+  grub_uint64_t size;
 };
 
 typedef int (*grub_fs_dir_hook_t) (const char *filename,
@@ -117,11 +119,19 @@ typedef int (*grub_fs_autoload_hook_t) (void);
 extern grub_fs_autoload_hook_t EXPORT_VAR(grub_fs_autoload_hook);
 extern grub_fs_t EXPORT_VAR (grub_fs_list);
 
+/* Forget all cached grub_fs_probe results.  */
+void EXPORT_FUNC(grub_fs_probe_cache_invalidate_all) (void);
+
+/* Look up a cached grub_fs_probe result for DEVICE without probing.  Returns
+   non-zero on a hit and sets *FS, which is NULL if no filesystem was found.  */
+int EXPORT_FUNC(grub_fs_probe_cached) (grub_device_t device, grub_fs_t *fs);
+
 #ifndef GRUB_LST_GENERATOR
 static inline void
 grub_fs_register (grub_fs_t fs)
 {
   grub_list_push (GRUB_AS_LIST_P (&grub_fs_list), GRUB_AS_LIST (fs));
+  grub_fs_probe_cache_invalidate_all ();
 }
 #endif
 
@@ -129,6 +139,7 @@ static inline void
 grub_fs_unregister (grub_fs_t fs)
 {
   grub_list_remove (GRUB_AS_LIST (fs));
+  grub_fs_probe_cache_invalidate_all ();
 }
 
 #define FOR_FILESYSTEMS(var) FOR_LIST_ELEMENTS((var), (grub_fs_list))
@@ -88,4 +88,25 @@ EXPORT_FUNC(grub_fshelp_read_file) (grub_disk_t disk, grub_fshelp_node_t node,
 				    grub_off_t filesize, int log2blocksize,
 				    grub_disk_addr_t blocks_start);
 
+/* Translate the file block BLOCK of NODE to a disk block, or 0 if it is not
+   stored on disk, and set *COUNT to the number of blocks, at least 1, for
+   which the translation goes on contiguously (or which are holes too).  */
+typedef grub_disk_addr_t (*grub_fshelp_get_extent_t) (grub_fshelp_node_t node,
+						       grub_disk_addr_t block,
+						       grub_disk_addr_t *count);
+
+/* Like grub_fshelp_read_file, for filesystems which map files as extents.
+   GET_EXTENT translates file blocks to runs of disk blocks.  */
+grub_ssize_t
+EXPORT_FUNC(grub_fshelp_read_file_extents) (grub_disk_t disk,
+					    grub_fshelp_node_t node,
+					    grub_disk_read_hook_t read_hook,
+					    void *read_hook_data, int blocklist,
+					    grub_off_t pos, grub_size_t len,
+					    char *buf,
+					    grub_fshelp_get_extent_t get_extent,
+					    grub_off_t filesize,
+					    int log2blocksize,
+					    grub_disk_addr_t blocks_start);
+
 #endif /* ! GRUB_FSHELP_HEADER */
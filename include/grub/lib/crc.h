@@ -22,4 +22,10 @@
 
 grub_uint32_t grub_getcrc32c (grub_uint32_t crc, const void *buf, int size);
 
+#ifdef GRUB_UTIL
+/* For the tests: when FORCE is set, use the portable code even if the CPU
+   has the crc32 instruction.  */
+void grub_crc32c_force_portable (int force);
+#endif
+
 #endif /* ! GRUB_CRC_H */
@@ -63,6 +63,41 @@ perform_quick_sort (void *buf_to_sort, const grub_size_t count,
                     const grub_size_t element_size,
                     sort_compare compare_function);
 
+/**
+  Function to perform a stable Merge Sort on a buffer of comparable elements.
+
+  Each element must be equally sized.  Needs a scratch buffer as large as
+  BufferToSort, and falls back to perform_quick_sort if that cannot be
+  allocated.
+
+  If Count is < 2 , then perform no action.
+  If Size is < 1 , then perform no action.
+
+  @param[in, out] BufferToSort   On call, a Buffer of (possibly sorted) elements;
+                                 on return, a buffer of sorted elements.
+  @param[in]  Count              The number of elements in the buffer to sort.
+  @param[in]  ElementSize        The size of an element in bytes.
+  @param[in]  CompareFunction    The function to call to perform the comparison
+                                 of any two elements.
+**/
+void
+perform_merge_sort (void *buf_to_sort, const grub_size_t count,
+                    const grub_size_t element_size,
+                    sort_compare compare_function);
+
+/**
+  Function to compare 2 strings in natural order ("file2" < "file10").
+
+  @param[in] s1                 First string to compare.
+  @param[in] s2                 Second string to compare.
+
+  @retval 0                     s1 equal to s2.
+  @return < 0                   s1 is less than s2.
+  @return > 0                   s1 is greater than s2.
+**/
+int
+natural_compare (const char *s1, const char *s2);
+
 /**
   Function to compare 2 strings.
 
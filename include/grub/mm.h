@@ -22,6 +22,7 @@
 
 #include <grub/types.h>
 #include <grub/symbol.h>
+#include <grub/err.h>
 #include <config.h>
 
 #ifndef NULL
@@ -29,6 +30,21 @@
 #endif
 
 void grub_mm_init_region (void *addr, grub_size_t size);
+
+#define GRUB_MM_ADD_REGION_NONE		0
+#define GRUB_MM_ADD_REGION_CONSECUTIVE	(1 << 0)
+
+/* Add at least SIZE bytes of heap through grub_mm_init_region.  FLAGS is a
+   mask of GRUB_MM_ADD_REGION_*; with GRUB_MM_ADD_REGION_CONSECUTIVE the
+   memory must be a single region.  */
+typedef grub_err_t (*grub_mm_add_region_func_t) (grub_size_t size,
+						 unsigned int flags);
+
+#ifndef GRUB_MACHINE_EMU
+/* Set by platforms which can hand out more memory when the heap runs
+   out.  */
+extern grub_mm_add_region_func_t EXPORT_VAR (grub_mm_add_region_fn);
+#endif
 void *EXPORT_FUNC(grub_malloc) (grub_size_t size);
 void *EXPORT_FUNC(grub_zalloc) (grub_size_t size);
 void EXPORT_FUNC(grub_free) (void *ptr);
@@ -37,6 +53,45 @@ void *EXPORT_FUNC(grub_realloc) (void *ptr, grub_size_t size);
 void *EXPORT_FUNC(grub_memalign) (grub_size_t align, grub_size_t size);
 #endif
 
+#if !defined (GRUB_MACHINE_EMU) && !defined (GRUB_UTIL)
+/* Occupancy of one slab size class.  */
+struct grub_mm_slab_info
+{
+  grub_size_t size;
+  grub_size_t slabs;
+  grub_size_t objects;
+  grub_size_t inuse;
+};
+
+/* Fill INFO for size class CLS.  Return 0 once CLS is past the last one.  */
+int EXPORT_FUNC(grub_mm_slab_info) (unsigned cls,
+				    struct grub_mm_slab_info *info);
+
+/* Allocation counts are kept per power of two bucket, the first for
+   blocks of up to GRUB_MM_STAT_BUCKET_MIN bytes and the last for all
+   blocks too large for the others.  */
+#define GRUB_MM_STAT_BUCKETS	16
+#define GRUB_MM_STAT_BUCKET_MIN	16
+
+struct grub_mm_stats
+{
+  /* Bytes managed by all regions.  */
+  grub_size_t heap_size;
+  /* Bytes in blocks handed out, headers included, and their maximum since
+     startup or the last grub_mm_reset_stats.  */
+  grub_size_t in_use;
+  grub_size_t peak;
+  /* Bytes in the free rings and the largest single free block.  */
+  grub_size_t free;
+  grub_size_t largest_free;
+  grub_size_t allocs[GRUB_MM_STAT_BUCKETS];
+};
+
+void EXPORT_FUNC(grub_mm_get_stats) (struct grub_mm_stats *stats);
+/* Restart the peak from the current usage and clear allocation counts.  */
+void EXPORT_FUNC(grub_mm_reset_stats) (void);
+#endif
+
 void grub_mm_check_real (const char *file, int line);
 #define grub_mm_check() grub_mm_check_real (GRUB_FILE, __LINE__);
 
@@ -48,6 +103,21 @@ extern int EXPORT_VAR(grub_mm_debug);
 void grub_mm_dump_free (void);
 void grub_mm_dump (unsigned lineno);
 
+/* Heap usage by call site of the allocation.  */
+struct grub_mm_site_info
+{
+  const char *file;
+  int line;
+  grub_size_t allocs;
+  grub_size_t in_use;
+  grub_size_t peak;
+};
+
+/* Fill INFO for call site slot I, whose FILE is NULL if it is unused.
+   Return 0 once I is past the last slot.  */
+int EXPORT_FUNC(grub_mm_site_info) (unsigned i,
+				    struct grub_mm_site_info *info);
+
 #define grub_malloc(size)	\
   grub_debug_malloc (GRUB_FILE, __LINE__, size)
 
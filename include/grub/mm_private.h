@@ -24,6 +24,8 @@
 /* Magic words.  */
 #define GRUB_MM_FREE_MAGIC	0x2d3c2808
 #define GRUB_MM_ALLOC_MAGIC	0x6db08fa4
+#define GRUB_MM_SLAB_FREE_MAGIC	0x5f1ab0f3
+#define GRUB_MM_SLAB_ALLOC_MAGIC	0x5a1ab0c7
 
 typedef struct grub_mm_header
 {
@@ -48,6 +50,28 @@ typedef struct grub_mm_header
 
 #define GRUB_MM_ALIGN	(1 << GRUB_MM_ALIGN_LOG2)
 
+/* Small allocations are served from slabs of equal sized objects, one size
+   class per power of two from one cell up to 2 KiB.  */
+#define GRUB_MM_SLAB_MAX_LOG2	11
+#define GRUB_MM_SLAB_MAX	(1 << GRUB_MM_SLAB_MAX_LOG2)
+#define GRUB_MM_SLAB_CLASSES	(GRUB_MM_SLAB_MAX_LOG2 - GRUB_MM_ALIGN_LOG2 + 1)
+
+/* A slab is an ordinary allocated block starting with this descriptor.
+   Each object in it is preceded by a grub_mm_header cell whose size is that
+   of the object, header included, as for any other allocated block.  While
+   the object is in use, NEXT points back to its slab; while it is free, NEXT
+   links it into the free list of the slab.  */
+typedef struct grub_mm_slab
+{
+  struct grub_mm_slab *next;
+  struct grub_mm_slab *prev;
+  struct grub_mm_header *free;
+  grub_size_t cls;
+  grub_size_t inuse;
+  grub_size_t total;
+}
+*grub_mm_slab_t;
+
 typedef struct grub_mm_region
 {
   struct grub_mm_header *first;
@@ -0,0 +1,127 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2020 Free Software Foundation, Inc.
+ *
+ *  GRUB is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GRUB is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <grub/misc.h>
+#include <grub/lib/crc.h>
+#include <grub/test.h>
+
+#define BUF_SIZE	4096
+#define BENCH_SIZE	(1 << 20)
+#define BENCH_ROUNDS	256
+
+/* Bit at a time, straight from the definition.  */
+static grub_uint32_t
+crc32c_ref (grub_uint32_t crc, const grub_uint8_t *data, grub_size_t size)
+{
+  int k;
+
+  crc = ~crc;
+  while (size--)
+    {
+      crc ^= *data++;
+      for (k = 0; k < 8; k++)
+	crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0);
+    }
+  return ~crc;
+}
+
+/* Check the current implementation against the reference.  */
+static void
+crc_check (const grub_uint8_t *buf, const char *name)
+{
+  grub_uint32_t crc;
+  unsigned off, len, i;
+
+  grub_test_assert (grub_getcrc32c (0, "123456789", 9) == 0xe3069283,
+		    "%s: bad check value %08x", name,
+		    grub_getcrc32c (0, "123456789", 9));
+
+  /* Every alignment and all the short tails.  */
+  for (off = 0; off < 16; off++)
+    for (len = 0; len < 80; len++)
+      grub_test_assert (grub_getcrc32c (0, buf + off, len)
+			== crc32c_ref (0, buf + off, len),
+			"%s: mismatch at offset %u length %u", name, off, len);
+
+  srand (7);
+  for (i = 0; i < 100; i++)
+    {
+      off = rand () % 64;
+      len = rand () % (BUF_SIZE - 64);
+      crc = grub_getcrc32c (0, buf + off, len / 3);
+      crc = grub_getcrc32c (crc, buf + off + len / 3, len - len / 3);
+      grub_test_assert (crc == crc32c_ref (0, buf + off, len),
+			"%s: chained mismatch at offset %u length %u", name,
+			off, len);
+    }
+}
+
+static grub_uint32_t
+crc_bench (const grub_uint8_t *buf, const char *name)
+{
+  grub_uint32_t crc = 0;
+  clock_t start;
+  double secs;
+  unsigned i;
+
+  start = clock ();
+  for (i = 0; i < BENCH_ROUNDS; i++)
+    crc = grub_getcrc32c (crc, buf, BENCH_SIZE);
+  secs = (double) (clock () - start) / CLOCKS_PER_SEC;
+  if (secs > 0)
+    printf ("crc32c (%s): %d MiB in %.3f s, %.0f MiB/s\n", name,
+	    BENCH_ROUNDS, secs, BENCH_ROUNDS / secs);
+  return crc;
+}
+
+static void
+crc_test (void)
+{
+  grub_uint8_t *buf;
+  grub_uint32_t fast, portable;
+  unsigned i;
+
+  buf = malloc (BENCH_SIZE);
+  grub_test_assert (buf != NULL, "out of memory");
+  if (!buf)
+    return;
+
+  srand (42);
+  for (i = 0; i < BENCH_SIZE; i++)
+    buf[i] = rand ();
+
+  /* Whatever the CPU offers, then the portable code on its own.  */
+  crc_check (buf, "default");
+  fast = crc_bench (buf, "default");
+
+  grub_crc32c_force_portable (1);
+  crc_check (buf, "portable");
+  portable = crc_bench (buf, "portable");
+  grub_crc32c_force_portable (0);
+
+  grub_test_assert (fast == portable,
+		    "implementations disagree: %08x != %08x", fast, portable);
+
+  free (buf);
+}
+
+GRUB_UNIT_TEST ("crc_unit_test", crc_test);